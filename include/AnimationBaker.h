@@ -0,0 +1,53 @@
+#ifndef ANIMATIONBAKER_H_
+#define ANIMATIONBAKER_H_
+#include "AnimationCache.h"
+#include "MorphEngine.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file AnimationBaker.h
+/// @brief exports a weight timeline as an AnimationCache file, this has no Qt / GL / NGL dependency
+/// @class AnimationBaker
+/// @brief bake() is a three stage pipeline. The calling thread steps the timeline for a batch of frames (a chunk per
+/// pool worker), then the pool blends, quantises and delta encodes one chunk per task, then a writer thread appends
+/// the chunks to the file in order while the next batch is being encoded. At most c_maxQueuedBatches batches wait for
+/// the writer, so the memory used is the same for a shot of any length.
+//----------------------------------------------------------------------------------------------------------------------
+class AnimationBaker
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the batches that can be waiting for the writer before the encoders stop and wait for it
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_maxQueuedBatches = 2;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief fill in the engine's numTargets() weights for a frame, this is called for every frame in order on the
+    /// calling thread so it can step a WeightAnimator
+    //----------------------------------------------------------------------------------------------------------------------
+    using Timeline = std::function<void(size_t _frame, float *o_weights)>;
+    struct Stats
+    {
+      size_t frames = 0;
+      size_t rawBytes = 0;        ///< the frames as floats
+      size_t fileBytes = 0;
+      size_t peakQueuedBytes = 0; ///< the most encoded data waiting for the writer at once
+      double seconds = 0.0;
+    };
+    AnimationBaker(const MorphEngine &_engine, ThreadPool &_pool);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bake _numFrames frames, the file is written to a temp file then renamed so readers never see part of one
+    /// @returns true on success
+    //----------------------------------------------------------------------------------------------------------------------
+    bool bake(const std::string &_file, size_t _numFrames, float _fps, const Timeline &_timeline, const AnimationCache::Options &_options = {});
+    const Stats &stats() const { return m_stats; }
+
+  private:
+    const MorphEngine &m_engine;
+    ThreadPool &m_pool;
+    Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef ANIMATIONCACHE_H_
+#define ANIMATIONCACHE_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file AnimationCache.h
+/// @brief a baked morph animation, the deformed mesh of every frame for tools that want geometry rather than weights
+/// and targets, this has no Qt / GL / NGL dependency. The file is laid out as
+/// [Header][reference frame][chunk]*numChunks[ChunkRecord]*numChunks
+/// A frame is 6 floats per vertex (position then normal, the same as vertData) quantised to a fixed step per
+/// component. The reference frame is the first frame stored against zero. Each chunk holds framesPerChunk frames,
+/// the first against the reference and every other one against the frame before it, so any chunk decodes on its own
+/// and a frame is at most framesPerChunk - 1 deltas from the start of its chunk. The deltas of a frame are zigzag
+/// varints with runs of zeros (vertices that didn't move) stored as a single count.
+/// @class AnimationCache
+/// @brief memory maps a baked animation and decodes frames from it, moving forward a frame at a time only decodes
+/// the one delta. encodeFrame / the Header and ChunkRecord layouts are public so the AnimationBaker can write it.
+//----------------------------------------------------------------------------------------------------------------------
+class AnimationCache
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bump this whenever the layout changes
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t c_version = 1;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief floats per vertex in a frame
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_components = 6;
+    struct Options
+    {
+      float positionStep = 1e-4f;      ///< model units, the largest position error is half of this
+      float normalStep = 1.0f / 4096;  ///< the largest normal component error is half of this
+      uint32_t framesPerChunk = 32;    ///< longer chunks compress better, shorter ones seek faster
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief on disk structures, these are all naturally aligned so there is no padding added by the compiler
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Header
+    {
+      char magic[4];
+      uint32_t version;
+      uint32_t numVerts;
+      uint32_t numFrames;
+      uint32_t framesPerChunk;
+      uint32_t numChunks;
+      float fps;
+      float positionStep;
+      float normalStep;
+      uint32_t pad;
+      uint64_t referenceOffset;
+      uint64_t referenceSize;
+      uint64_t indexOffset;
+    };
+    struct ChunkRecord
+    {
+      uint64_t offset;
+      uint64_t size;
+    };
+    static constexpr char c_magic[4] = {'M', 'B', 'A', 'K'};
+    AnimationCache() = default;
+    ~AnimationCache();
+    AnimationCache(const AnimationCache &) = delete;
+    AnimationCache &operator=(const AnimationCache &) = delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief map and validate a baked animation
+    /// @returns true if the file can be read
+    //----------------------------------------------------------------------------------------------------------------------
+    bool open(const std::string &_file);
+    void close();
+    size_t numVerts() const { return m_header.numVerts; }
+    size_t numFrames() const { return m_header.numFrames; }
+    size_t numChunks() const { return m_header.numChunks; }
+    float fps() const { return m_header.fps; }
+    size_t fileSize() const { return m_size; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief decode a frame
+    /// @param [in] _frame any frame, going forward from the last one decoded is the cheapest
+    /// @param [out] o_frame numVerts() * c_components floats
+    /// @returns false if _frame is out of range or the data is corrupt
+    //----------------------------------------------------------------------------------------------------------------------
+    bool frame(size_t _frame, float *o_frame);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief quantise a frame to the steps in _options
+    //----------------------------------------------------------------------------------------------------------------------
+    static void quantise(const float *_frame, size_t _numVerts, const Options &_options, int32_t *o_quantised);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief append the delta of one quantised frame against _previous (nullptr for zero) to io_data
+    //----------------------------------------------------------------------------------------------------------------------
+    static void encodeFrame(const int32_t *_frame, const int32_t *_previous, size_t _numVerts, std::vector<uint8_t> &io_data);
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add one encoded frame from _data to io_frame
+    /// @returns the byte after it or nullptr if it runs past _end
+    //----------------------------------------------------------------------------------------------------------------------
+    const uint8_t *decodeFrame(const uint8_t *_data, const uint8_t *_end, int32_t *io_frame) const;
+    bool validate();
+    Header m_header = {};
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<uint8_t> m_fallback;
+    std::vector<ChunkRecord> m_chunks;
+    std::vector<int32_t> m_reference;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the last frame decoded and where the next one in its chunk starts, so playback only decodes one delta
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<int32_t> m_current;
+    size_t m_currentFrame = ~size_t(0);
+    const uint8_t *m_cursor = nullptr;
+};
+
+#endif
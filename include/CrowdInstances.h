@@ -0,0 +1,81 @@
+#ifndef CROWDINSTANCES_H_
+#define CROWDINSTANCES_H_
+#include <ngl/Types.h>
+#include <ngl/Mat4.h>
+#include <ngl/Vec3.h>
+#include "MorphBasis.h"
+#include "PunchTimeline.h"
+#include <cstdint>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file CrowdInstances.h
+/// @brief the per instance state for drawing a crowd of the same morph mesh in one instanced call
+/// @class CrowdInstances
+/// @brief Each instance has a transform and its own weight vector. The weights are a PunchTimeline (one channel per
+/// instance) animated on the CPU so the crowd doesn't move in step. pack() writes everything into one
+/// float array for an RGBA32F texture buffer, instance i starts at texel i*texelsPerInstance() with the four model
+/// matrix columns then the weights four to a texel.
+//----------------------------------------------------------------------------------------------------------------------
+class CrowdInstances
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief lay out a grid of instances
+    /// @param [in] _count the number of instances
+    /// @param [in] _numTargets the number of morph targets (weights per instance)
+    /// @param [in] _spacing the distance between neighbouring instances on the ground plane
+    /// @param [in] _seed seed for the random facing and punch triggers so runs are repeatable
+    //----------------------------------------------------------------------------------------------------------------------
+    void create(size_t _count, size_t _numTargets, ngl::Real _spacing, uint32_t _seed = 1234);
+    size_t size() const { return m_transforms.size(); }
+    size_t numTargets() const { return m_timeline.numTargets(); }
+    size_t texelsPerInstance() const { return 4 + (numPackedWeights() + 3) / 4; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pack each instance's weights folded through a basis (for a texture buffer of basis shapes), nullptr packs
+    /// the target weights. The basis must live as long as it is set.
+    //----------------------------------------------------------------------------------------------------------------------
+    void setBasis(const MorphBasis *_basis) { m_basis = _basis; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a punch of one target on every instance, it adds to any punch already playing
+    /// @param [in] _target the target to punch
+    /// @param [in] _time the time to start the punch
+    //----------------------------------------------------------------------------------------------------------------------
+    void punchAll(size_t _target, double _time) { m_timeline.punchAll(_target, _time); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief trigger new random punches and evaluate all the playing ones
+    /// @param [in] _time the frame time in seconds
+    /// @param [in] _dt the time since the last update
+    /// @returns true if any weight changed
+    //----------------------------------------------------------------------------------------------------------------------
+    bool update(double _time, double _dt) { return m_timeline.update(_time, _dt); }
+    ngl::Real weight(size_t _instance, size_t _target) const { return m_timeline.weight(_instance, _target); }
+    const ngl::Mat4 &transform(size_t _instance) const { return m_transforms[_instance]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief does any instance have a non zero weight on the target
+    //----------------------------------------------------------------------------------------------------------------------
+    bool targetInUse(size_t _target) const { return m_timeline.targetInUse(_target); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the targets of the punches that start within _window seconds of _time
+    //----------------------------------------------------------------------------------------------------------------------
+    void upcomingTargets(double _time, double _window, std::vector<uint32_t> &o_targets) const
+    {
+      m_timeline.upcomingTargets(_time, _window, o_targets);
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pack the transforms and weights for the instance texture buffer
+    //----------------------------------------------------------------------------------------------------------------------
+    void pack(std::vector<GLfloat> &o_data) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pack in a different order, slot i of the buffer holds instance _order[i]
+    //----------------------------------------------------------------------------------------------------------------------
+    void pack(std::vector<GLfloat> &o_data, const std::vector<uint32_t> &_order) const;
+
+  private:
+    size_t numPackedWeights() const { return m_basis ? m_basis->numShapes() : numTargets(); }
+    const MorphBasis *m_basis = nullptr;
+    std::vector<ngl::Mat4> m_transforms;
+    PunchTimeline m_timeline;
+};
+
+#endif
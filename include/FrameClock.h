@@ -0,0 +1,72 @@
+#ifndef FRAMECLOCK_H_
+#define FRAMECLOCK_H_
+#include <chrono>
+#include <cstdint>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file FrameClock.h
+/// @brief the animation time, read once per frame so everything animated in a frame sees the same time
+/// @class FrameClock
+/// @brief By default this follows a monotonic real time clock. With a fixed step every tick() advances by exactly
+/// that amount whatever the real time so runs (and tests) are repeatable. While paused the time doesn't move in
+/// either mode.
+//----------------------------------------------------------------------------------------------------------------------
+class FrameClock
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief use a fixed step in seconds, 0 goes back to real time
+    //----------------------------------------------------------------------------------------------------------------------
+    void setFixedStep(double _step) { m_step = _step; }
+    double fixedStep() const { return m_step; }
+    void setPaused(bool _paused)
+    {
+      if (_paused == m_paused)
+        return;
+      // the real time spent paused is skipped by moving the start forward
+      auto t = std::chrono::steady_clock::now();
+      if (_paused)
+        m_pausedAt = t;
+      else
+        m_start += t - m_pausedAt;
+      m_paused = _paused;
+    }
+    bool paused() const { return m_paused; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief advance to the next frame
+    /// @returns the time since the last frame
+    //----------------------------------------------------------------------------------------------------------------------
+    double tick()
+    {
+      auto last = m_time;
+      if (!m_paused)
+        m_time = m_step > 0.0 ? m_time + m_step : now();
+      ++m_frame;
+      return m_time - last;
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the time of the current frame in seconds
+    //----------------------------------------------------------------------------------------------------------------------
+    double time() const { return m_time; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the time right now, for starting things between frames. With a fixed step this is the frame time.
+    //----------------------------------------------------------------------------------------------------------------------
+    double now() const
+    {
+      if (m_step > 0.0)
+        return m_time;
+      auto t = m_paused ? m_pausedAt : std::chrono::steady_clock::now();
+      return std::chrono::duration<double>(t - m_start).count();
+    }
+    uint64_t frame() const { return m_frame; }
+
+  private:
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point m_pausedAt;
+    bool m_paused = false;
+    double m_step = 0.0;
+    double m_time = 0.0;
+    uint64_t m_frame = 0;
+};
+
+#endif
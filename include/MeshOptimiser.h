@@ -0,0 +1,46 @@
+#ifndef MESHOPTIMISER_H_
+#define MESHOPTIMISER_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MeshOptimiser.h
+/// @brief reorders an indexed triangle mesh for the GPU's vertex caches, this has no Qt / GL / NGL dependency
+/// @class MeshOptimiser
+/// @brief optimiseVertexCache() reorders the triangles so recently transformed vertices are reused (Forsyth's linear
+/// speed vertex cache optimisation) and fetchRemap() then numbers the vertices in the order they are first used so
+/// the vertex and delta fetches walk through memory. simulate() runs the index list through a FIFO cache to measure
+/// the result without a GPU.
+//----------------------------------------------------------------------------------------------------------------------
+class MeshOptimiser
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the entries in the FIFO simulate() uses by default, about the post-transform cache of current GPUs
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_defaultCacheSize = 16;
+    struct CacheStats
+    {
+      float acmr = 0.0f; ///< average cache miss ratio, vertices transformed per triangle (0.5 is the best possible)
+      float atvr = 0.0f; ///< average transform to vertex ratio, vertices transformed per vertex used (1 is the best)
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief reorder the triangles in place, the vertices are not changed
+    /// @param [in,out] io_indices three per triangle
+    /// @param [in] _numIndices a multiple of three
+    /// @param [in] _numVerts one more than the largest index
+    //----------------------------------------------------------------------------------------------------------------------
+    static void optimiseVertexCache(uint32_t *io_indices, size_t _numIndices, size_t _numVerts);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief number the vertices in the order the indices first use them, any that aren't used go at the end
+    /// @returns the new number of each old vertex
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::vector<uint32_t> fetchRemap(const uint32_t *_indices, size_t _numIndices, size_t _numVerts);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief count the misses of a FIFO post-transform cache
+    //----------------------------------------------------------------------------------------------------------------------
+    static CacheStats simulate(const uint32_t *_indices, size_t _numIndices, size_t _numVerts, size_t _cacheSize = c_defaultCacheSize);
+};
+
+#endif
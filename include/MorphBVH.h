@@ -0,0 +1,81 @@
+#ifndef MORPHBVH_H_
+#define MORPHBVH_H_
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphBVH.h
+/// @brief a bounding volume hierarchy for ray casts against a morphing mesh, this has no Qt / GL / NGL dependency
+/// @class MorphBVH
+/// @brief build() splits the triangles of the base pose with the surface area heuristic once. A blend only moves the
+/// vertices, the topology stays the same, so when the weights change refit() recomputes the node boxes bottom up
+/// from the new positions without changing the tree. That is a fraction of the cost of a build and the boxes stay
+/// tight as long as the targets don't move triangles far from their base neighbours.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphBVH
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the most triangles in a leaf
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_maxLeafTriangles = 4;
+    struct Hit
+    {
+      float distance = std::numeric_limits<float>::max(); ///< along the ray, in units of the direction's length
+      uint32_t triangle = 0;                             ///< the index of the triangle's first corner / 3
+      float u = 0.0f;                                    ///< barycentric weight of the second corner
+      float v = 0.0f;                                    ///< barycentric weight of the third corner
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the tree, the positions are copied and the indices are kept by pointer so must outlive the tree
+    /// @param [in] _x _y _z the first vertex's components, every vertex is _stride floats after the last so this
+    /// takes interleaved (_y = _x + 1, _z = _x + 2) or structure of arrays (stride 1) data
+    //----------------------------------------------------------------------------------------------------------------------
+    void build(const float *_x, const float *_y, const float *_z, size_t _stride, size_t _numVerts, const uint32_t *_indices,
+               size_t _numIndices);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief move the vertices and recompute the boxes, the data is laid out as for build
+    //----------------------------------------------------------------------------------------------------------------------
+    void refit(const float *_x, const float *_y, const float *_z, size_t _stride);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief find the nearest triangle the ray hits (either side)
+    /// @param [in] _origin the start of the ray
+    /// @param [in] _direction doesn't have to be unit length
+    /// @param [out] o_hit only written if there is a hit closer than o_hit.distance
+    /// @returns true if there is a hit
+    //----------------------------------------------------------------------------------------------------------------------
+    bool intersect(const float *_origin, const float *_direction, Hit &o_hit) const;
+    size_t numNodes() const { return m_nodes.size(); }
+    size_t numTriangles() const { return m_triangles.size(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the box around everything, low xyz then high xyz
+    //----------------------------------------------------------------------------------------------------------------------
+    void bounds(float *o_bounds) const;
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a leaf has count triangles from first in m_triangles, an inner node has count 0 with its first child
+    /// straight after it and its second child at first, so a node always comes before its children
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Node
+    {
+      float low[3];
+      uint32_t first;
+      float high[3];
+      uint32_t count;
+    };
+    void setPositions(const float *_x, const float *_y, const float *_z, size_t _stride);
+    void leafBounds(Node &io_node) const;
+    std::vector<Node> m_nodes;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the triangles in leaf order, each the index of its first corner / 3
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<uint32_t> m_triangles;
+    std::vector<float> m_positions;
+    const uint32_t *m_indices = nullptr;
+    size_t m_numVerts = 0;
+};
+
+#endif
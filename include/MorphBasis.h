@@ -0,0 +1,85 @@
+#ifndef MORPHBASIS_H_
+#define MORPHBASIS_H_
+#include <cstddef>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphBasis.h
+/// @brief compresses a set of morph targets into a smaller set of shared shapes, this has no Qt / GL / NGL dependency
+/// @class MorphBasis
+/// @brief Correlated targets (variations of the same expression, in-betweens) are close to a few shapes mixed in
+/// different amounts. build() does a principal component analysis of the stacked target deltas and keeps the fewest
+/// basis shapes that get every target within the tolerance, each target is then a coefficient per shape. A blend
+/// of the targets is the same blend of the shapes with the weights folded through the coefficients (fold()), so the
+/// shader blends numShapes() shapes rather than every target.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphBasis
+{
+  public:
+    struct Options
+    {
+      float tolerance = 1e-3f; ///< largest allowed error (in model units) of any target's position or normal delta
+      size_t maxShapes = 64;   ///< never keep more shapes than this
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the distance between the exact and the compressed deltas over every vertex
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Error
+    {
+      float maxPosition = 0.0f;
+      float rmsPosition = 0.0f;
+      float maxNormal = 0.0f;
+      float rmsNormal = 0.0f;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a new set of targets
+    /// @param [in] _numVerts the vertices in each target
+    //----------------------------------------------------------------------------------------------------------------------
+    void setVertexCount(size_t _numVerts);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add a target's deltas, a position then a normal delta (six floats) per vertex. Not copied.
+    //----------------------------------------------------------------------------------------------------------------------
+    void addTarget(const float *_deltas);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief find the basis, the shapes are laid out like the targets
+    //----------------------------------------------------------------------------------------------------------------------
+    void build(const Options &_options);
+    size_t numTargets() const { return m_targets.size(); }
+    size_t numShapes() const { return m_numShapes; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the shapes one after the other, six floats per vertex. Each is scaled so its largest coefficient is
+    /// one, that keeps them in model units like the targets so they quantise the same way
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<float> &shapes() const { return m_shapes; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the coefficient of shape s in target t is at t*numShapes()+s
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<float> &coefficients() const { return m_coefficients; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief turn target weights into shape weights
+    /// @param [in] _weights numTargets() weights
+    /// @param [out] o_shapeWeights numShapes() weights
+    //----------------------------------------------------------------------------------------------------------------------
+    void fold(const float *_weights, float *o_shapeWeights) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the error of the worst target on its own at weight 1 and of all the targets at weight 1 together, the
+    /// error of any other blend is at most the weighted sum of the single target errors
+    //----------------------------------------------------------------------------------------------------------------------
+    const Error &targetError() const { return m_targetError; }
+    const Error &blendError() const { return m_blendError; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the size of the targets over the size of the shapes plus coefficients
+    //----------------------------------------------------------------------------------------------------------------------
+    float compressionRatio() const;
+
+  private:
+    size_t m_numVerts = 0;
+    std::vector<const float *> m_targets;
+    size_t m_numShapes = 0;
+    std::vector<float> m_shapes;
+    std::vector<float> m_coefficients;
+    Error m_targetError;
+    Error m_blendError;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef MORPHCACHE_H_
+#define MORPHCACHE_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphCache.h
+/// @brief a versioned binary cache of the packed morph mesh so we don't have to re-parse the pose obj files
+/// every time the demo starts.
+/// The file is laid out as
+/// [Header][SourceRecord + path]*numSources[SectionRecord]*numSections [padding] [section data]...
+/// each section is 16 byte aligned so the mapped pointers can be passed straight to glBufferData.
+/// @class MorphCache
+/// @brief writes the packed buffers on the first run and memory maps them on later runs, the cache is
+/// only used if the source obj files still match (size and either timestamp or content hash)
+//----------------------------------------------------------------------------------------------------------------------
+
+class MorphCache
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bump this whenever the layout of any section (or how pack fills it) changes so old caches are rebuilt
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t c_version = 5;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the sections we store, the id is written to the file so only ever append to this
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class Section : uint32_t
+    {
+      VERTDATA = 0,
+      TARGETS = 1,
+      INDICES = 2
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a view of one section of the cache, data points into the mapped file (or the fallback buffer)
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Blob
+    {
+      const void *data = nullptr;
+      size_t size = 0;
+      size_t count = 0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor
+    /// @param [in] _cacheFile the file to read / write
+    /// @param [in] _sources the obj files the cache is built from, these are checked for changes
+    //----------------------------------------------------------------------------------------------------------------------
+    MorphCache(std::string_view _cacheFile, const std::vector<std::string> &_sources);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief dtor will unmap the file
+    //----------------------------------------------------------------------------------------------------------------------
+    ~MorphCache();
+    MorphCache(const MorphCache &) = delete;
+    MorphCache &operator=(const MorphCache &) = delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief map the cache file and validate it against the sources
+    /// @returns true if the cache is usable, false if it needs to be rebuilt
+    //----------------------------------------------------------------------------------------------------------------------
+    bool load();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief get a section from a loaded cache
+    /// @param [in] _s the section to get, the blob will be empty if not present
+    //----------------------------------------------------------------------------------------------------------------------
+    Blob section(Section _s) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief tell the OS a range of a section isn't needed for now, the pages are read back from the file if it is
+    /// touched again. Does nothing unless the cache is memory mapped.
+    //----------------------------------------------------------------------------------------------------------------------
+    void release(const void *_data, size_t _size) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add a section to be written, the data is not copied so must live until write is called
+    //----------------------------------------------------------------------------------------------------------------------
+    void addSection(Section _s, const void *_data, size_t _size, size_t _count);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write the cache (to a temp file then renamed so other instances never see a partial file)
+    /// @returns true on success
+    //----------------------------------------------------------------------------------------------------------------------
+    bool write();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief 64 bit FNV-1a hash used for the source files
+    //----------------------------------------------------------------------------------------------------------------------
+    static uint64_t hash(const void *_data, size_t _size, uint64_t _seed = 14695981039346656037ULL);
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what we know about a source file
+    //----------------------------------------------------------------------------------------------------------------------
+    struct SourceInfo
+    {
+      uint64_t size = 0;
+      int64_t mtime = 0;
+      uint64_t hash = 0;
+      bool valid = false;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stat the file, only hashes the contents if _hash is true as this means reading it
+    //----------------------------------------------------------------------------------------------------------------------
+    static SourceInfo sourceInfo(const std::string &_path, bool _hash);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief parse and validate the mapped data
+    //----------------------------------------------------------------------------------------------------------------------
+    bool validate();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write new timestamps into the source records of the cache file in place
+    /// @param [in] _records the file offset of each record to update and the timestamp to store
+    //----------------------------------------------------------------------------------------------------------------------
+    void storeTimestamps(const std::vector<std::pair<size_t, int64_t>> &_records) const;
+    void unmap();
+
+    struct PendingSection
+    {
+      Section id;
+      const void *data;
+      size_t size;
+      size_t count;
+    };
+    std::string m_cacheFile;
+    std::vector<std::string> m_sources;
+    std::vector<PendingSection> m_pending;
+    std::vector<std::pair<Section, Blob>> m_sections;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the mapped file (or the read buffer where mmap isn't available)
+    //----------------------------------------------------------------------------------------------------------------------
+    const unsigned char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<unsigned char> m_fallback;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef MORPHCROWD_H_
+#define MORPHCROWD_H_
+#include "MorphEngine.h"
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphCrowd.h
+/// @brief batch evaluation of one MorphEngine rig for many characters, each with its own weight vector
+/// @class MorphCrowd
+/// @brief The work is split into vertex range x character tiles and run on a ThreadPool. Inside a tile the
+/// characters are blended one after the other over the same vertex range, so the deltas for that range are pulled
+/// into cache by the first character and reused by the rest rather than streaming the whole rig per character.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphCrowd
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief default tile sizes, 2048 vertices of 6 float components is 48K per target
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_defaultVertexTile = 2048;
+    static constexpr size_t c_defaultCharacterTile = 8;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, both the engine and pool must outlive the crowd
+    //----------------------------------------------------------------------------------------------------------------------
+    MorphCrowd(const MorphEngine &_engine, ThreadPool &_pool);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the tile sizes, the vertex tile is rounded up to a multiple of MorphEngine::c_padding
+    //----------------------------------------------------------------------------------------------------------------------
+    void setTileSize(size_t _vertices, size_t _characters);
+    size_t vertexTile() const { return m_vertexTile; }
+    size_t characterTile() const { return m_characterTile; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief evaluate the blend for every character
+    /// @param [in] _weights numTargets() weights per character, character c starts at _weights + c * _weightStride
+    /// @param [in] _numCharacters the number of characters
+    /// @param [in] _weightStride the distance in floats between one character's weights and the next
+    /// @param [in,out] io_results one result per character, grown (never shrunk) to _numCharacters
+    //----------------------------------------------------------------------------------------------------------------------
+    void evaluate(const float *_weights, size_t _numCharacters, size_t _weightStride, std::vector<MorphEngine::Result> &io_results);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief as above but writes interleaved position / normal buffers ready for a VBO, character c starts at
+    /// o_dst + c * numVerts * 6. The SoA results are kept internally as scratch.
+    //----------------------------------------------------------------------------------------------------------------------
+    void evaluateInterleaved(const float *_weights, size_t _numCharacters, size_t _weightStride, float *o_dst);
+
+  private:
+    const MorphEngine &m_engine;
+    ThreadPool &m_pool;
+    size_t m_vertexTile = c_defaultVertexTile;
+    size_t m_characterTile = c_defaultCharacterTile;
+    std::vector<MorphEngine::Result> m_scratch;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef MORPHENGINE_H_
+#define MORPHENGINE_H_
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphEngine.h
+/// @brief CPU evaluation of the morph blend base + sum(w[i] * delta[i]) for positions and (renormalised) normals.
+/// This has no Qt / GL / NGL dependency so it can be used on render nodes and in tools without a GPU.
+/// @class MorphEngine
+/// @brief The base mesh and deltas are held as structure of arrays, each of the 6 components (px py pz nx ny nz) is
+/// its own block of paddedVerts() floats so the kernels are straight multiply adds over contiguous memory.
+/// The blend is done in tiles of vertices, each tile is initialised from the base and then every active target is
+/// accumulated into it so the output stays in cache while the deltas are streamed through.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphEngine
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the kernel implementations, AUTO picks the widest the CPU supports
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class Kernel
+    {
+      SCALAR,
+      SSE,
+      AVX2,
+      AUTO
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief number of components per vertex, position xyz then normal xyz
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_components = 6;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief vertices are padded to a multiple of this so every kernel can run whole vectors
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_padding = 16;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief number of vertices blended per tile
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_tileSize = 512;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a structure of arrays result, each component block is paddedVerts() long
+    //----------------------------------------------------------------------------------------------------------------------
+    class Result
+    {
+      public:
+        float *component(size_t _c) { return m_data.get() + _c * m_padded; }
+        const float *component(size_t _c) const { return m_data.get() + _c * m_padded; }
+        size_t numVerts() const { return m_numVerts; }
+        //----------------------------------------------------------------------------------------------------------------------
+        /// @brief copy out as interleaved position / normal (6 floats per vertex) for a VBO
+        //----------------------------------------------------------------------------------------------------------------------
+        void interleave(float *o_dst, size_t _first, size_t _last) const;
+
+      private:
+        friend class MorphEngine;
+        std::unique_ptr<float[], void (*)(float *)> m_data{nullptr, nullptr};
+        size_t m_numVerts = 0;
+        size_t m_padded = 0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the kernel functions, all pointers are to padded component blocks
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Kernels
+    {
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief o_dst[i] += _w * _src[i] for _count floats (a multiple of c_padding)
+      //----------------------------------------------------------------------------------------------------------------------
+      void (*axpy)(float *o_dst, const float *_src, float _w, size_t _count);
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief normalise _count 3 component vectors stored as three blocks
+      //----------------------------------------------------------------------------------------------------------------------
+      void (*normalize)(float *io_x, float *io_y, float *io_z, size_t _count);
+    };
+
+    MorphEngine();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the base mesh from interleaved data
+    /// @param [in] _positions the first position
+    /// @param [in] _normals the first normal
+    /// @param [in] _numVerts the number of vertices
+    /// @param [in] _stride the distance in floats between one vertex and the next (6 for a position / normal pair)
+    //----------------------------------------------------------------------------------------------------------------------
+    void setBase(const float *_positions, const float *_normals, size_t _numVerts, size_t _stride);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add a target from interleaved deltas, setBase must be called first
+    /// @returns the index of the target
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t addTarget(const float *_positionDeltas, const float *_normalDeltas, size_t _stride);
+    size_t numVerts() const { return m_numVerts; }
+    size_t paddedVerts() const { return m_padded; }
+    size_t numTargets() const { return m_deltas.size(); }
+    const float *base(size_t _c) const { return m_base.get() + _c * m_padded; }
+    const float *delta(size_t _target, size_t _c) const { return m_deltas[_target].get() + _c * m_padded; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief choose the kernels, if the requested one isn't supported by the CPU the next narrowest is used
+    /// @returns the kernel actually used
+    //----------------------------------------------------------------------------------------------------------------------
+    Kernel setKernel(Kernel _k);
+    Kernel kernel() const { return m_kernel; }
+    static bool kernelSupported(Kernel _k);
+    static const char *kernelName(Kernel _k);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief allocate a result sized for this mesh
+    //----------------------------------------------------------------------------------------------------------------------
+    Result createResult() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief evaluate the blend for all vertices
+    /// @param [in] _weights one weight per target, zero weights are skipped
+    /// @param [out] o_result the blended mesh
+    //----------------------------------------------------------------------------------------------------------------------
+    void evaluate(const float *_weights, Result &o_result) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief evaluate a range of vertices, _first should be a multiple of c_padding
+    //----------------------------------------------------------------------------------------------------------------------
+    void evaluate(const float *_weights, size_t _first, size_t _last, Result &o_result) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief plain scalar version of the blend with no tiling used as the reference for the vector paths
+    //----------------------------------------------------------------------------------------------------------------------
+    void evaluateReference(const float *_weights, Result &o_result) const;
+
+  private:
+    using AlignedArray = std::unique_ptr<float[], void (*)(float *)>;
+    static AlignedArray allocate(size_t _count);
+    static Kernels kernels(Kernel _k);
+    size_t m_numVerts = 0;
+    size_t m_padded = 0;
+    AlignedArray m_base{nullptr, nullptr};
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one SoA block of c_components * m_padded floats per target
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<AlignedArray> m_deltas;
+    Kernel m_kernel = Kernel::SCALAR;
+    Kernels m_kernels;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the per instruction set kernels, these live in their own translation units so they can be built with
+/// the right compiler flags, the AVX2 one is only called if the CPU supports it
+//----------------------------------------------------------------------------------------------------------------------
+namespace MorphKernels
+{
+  void axpyScalar(float *o_dst, const float *_src, float _w, size_t _count);
+  void normalizeScalar(float *io_x, float *io_y, float *io_z, size_t _count);
+  void axpySSE(float *o_dst, const float *_src, float _w, size_t _count);
+  void normalizeSSE(float *io_x, float *io_y, float *io_z, size_t _count);
+  void axpyAVX2(float *o_dst, const float *_src, float _w, size_t _count);
+  void normalizeAVX2(float *io_x, float *io_y, float *io_z, size_t _count);
+} // end namespace MorphKernels
+
+#endif
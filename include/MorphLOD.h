@@ -0,0 +1,70 @@
+#ifndef MORPHLOD_H_
+#define MORPHLOD_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphLOD.h
+/// @brief builds a level of detail chain for a morph mesh, this has no Qt / GL / NGL dependency
+/// @class MorphLOD
+/// @brief Each level is made from the one before with half edge collapses (a vertex is merged into a neighbour) so
+/// every level only uses a subset of the original vertices. The levels are just index lists into the full vertex
+/// buffer, the deltas of a kept vertex are its own and the vertices that were collapsed into it follow its deltas, so
+/// the same VBO and TBO are used at every level.
+/// A collapse is costed with the usual plane quadric error in the base pose plus the error in every target of the
+/// collapsed vertices taking on the kept vertex's delta. Vertices that move differently to their neighbours in any
+/// target (a punching arm against the chest) are expensive to merge so the silhouette of a punch survives to the
+/// coarse levels. Border and non manifold vertices are never collapsed and collapses that flip a triangle in the base
+/// pose are rejected.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphLOD
+{
+  public:
+    struct Options
+    {
+      float ratio = 0.5f;        ///< triangles kept from one level to the next
+      size_t minTriangles = 256; ///< no level goes below this
+      size_t maxLevels = 6;      ///< including the full mesh
+      float deltaWeight = 1.0f;  ///< scale of the target error against the base pose quadric error
+    };
+    struct Level
+    {
+      std::vector<uint32_t> indices;
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief the square root of the largest collapse cost so far, about how far (in model units) the surface has
+      /// moved from the full mesh. Zero for the full mesh.
+      //----------------------------------------------------------------------------------------------------------------------
+      float error = 0.0f;
+      size_t numVerts = 0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the base pose, the data is not copied so must live until build is called
+    /// @param [in] _positions xyz of each vertex, _stride floats apart
+    /// @param [in] _indices the triangles
+    //----------------------------------------------------------------------------------------------------------------------
+    void setBase(const float *_positions, size_t _numVerts, size_t _stride, const uint32_t *_indices, size_t _numIndices);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add a target's position deltas, _stride floats apart. Not copied.
+    //----------------------------------------------------------------------------------------------------------------------
+    void addTarget(const float *_deltas, size_t _stride);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the chain, level 0 is the full mesh
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<Level> build(const Options &_options) const;
+
+  private:
+    struct Target
+    {
+      const float *deltas;
+      size_t stride;
+    };
+    const float *m_positions = nullptr;
+    size_t m_numVerts = 0;
+    size_t m_stride = 3;
+    const uint32_t *m_indices = nullptr;
+    size_t m_numIndices = 0;
+    std::vector<Target> m_targets;
+};
+
+#endif
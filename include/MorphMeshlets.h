@@ -0,0 +1,100 @@
+#ifndef MORPHMESHLETS_H_
+#define MORPHMESHLETS_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphMeshlets.h
+/// @brief splits a morph mesh into small clusters of triangles that can be culled, this has no Qt / GL / NGL dependency
+/// @class MorphMeshlets
+/// @brief build() groups neighbouring triangles into meshlets and reorders the index list so each one is a contiguous
+/// range. Every meshlet has a bounding sphere and a cone around its face normals in the base pose, the smallest
+/// height of its triangles and, for every target, the largest delta of its vertices. cull() grows the sphere by the
+/// weighted deltas. A blended face normal is quadratic in the weights (two targets can each leave a triangle facing
+/// the same way and flip it together) so the angles the targets turn the normals through at weight 1 say nothing
+/// about a blend, instead the cone is widened by how far moving the corners of the flattest triangle by the summed
+/// weighted deltas can tilt it. The bounds hold for any weights without looking at the vertices again.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphMeshlets
+{
+  public:
+    struct Options
+    {
+      size_t maxTriangles = 128; ///< triangles in a meshlet
+      size_t maxVertices = 96;   ///< distinct vertices in a meshlet
+      float minFacing = 0.5f;    ///< smallest cosine between a triangle and the meshlet's average normal
+    };
+    struct Meshlet
+    {
+      uint32_t firstIndex = 0;
+      uint32_t numIndices = 0;
+      float centre[3] = {0.0f, 0.0f, 0.0f};
+      float radius = 0.0f;
+      float coneAxis[3] = {0.0f, 0.0f, 0.0f};
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief half angle (radians) of the cone holding the base pose face normals
+      //----------------------------------------------------------------------------------------------------------------------
+      float coneAngle = 0.0f;
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief the smallest distance from a corner of one of its triangles to the opposite edge in the base pose
+      //----------------------------------------------------------------------------------------------------------------------
+      float minHeight = 0.0f;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief how far one target can take a meshlet from its base pose bounds at weight 1
+    //----------------------------------------------------------------------------------------------------------------------
+    struct TargetBound
+    {
+      float maxDelta = 0.0f;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the base pose, the data is not copied so must live until build is called
+    /// @param [in] _positions xyz of each vertex, _stride floats apart
+    /// @param [in] _indices the triangles
+    //----------------------------------------------------------------------------------------------------------------------
+    void setBase(const float *_positions, size_t _numVerts, size_t _stride, const uint32_t *_indices, size_t _numIndices);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add a target's position deltas, _stride floats apart. Not copied.
+    //----------------------------------------------------------------------------------------------------------------------
+    void addTarget(const float *_deltas, size_t _stride);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the meshlets and their bounds
+    //----------------------------------------------------------------------------------------------------------------------
+    void build(const Options &_options);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the triangles of the base index list reordered so every meshlet is a contiguous range
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<uint32_t> &indices() const { return m_outIndices; }
+    const std::vector<Meshlet> &meshlets() const { return m_meshlets; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the bounds of meshlet m in target t are at m*numTargets+t
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<TargetBound> &targetBounds() const { return m_targetBounds; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief find the meshlets that may be visible with these weights
+    /// @param [in] _mvp the column major model view projection, the frustum planes are taken from it
+    /// @param [in] _eye the camera position in model space
+    /// @param [in] _weights one per target
+    /// @param [out] o_visible the meshlets that are inside the frustum and not entirely back facing, in order
+    //----------------------------------------------------------------------------------------------------------------------
+    void cull(const float *_mvp, const float *_eye, const float *_weights, std::vector<uint32_t> &o_visible) const;
+
+  private:
+    struct Target
+    {
+      const float *deltas;
+      size_t stride;
+    };
+    const float *m_positions = nullptr;
+    size_t m_numVerts = 0;
+    size_t m_stride = 3;
+    const uint32_t *m_indices = nullptr;
+    size_t m_numIndices = 0;
+    std::vector<Target> m_targets;
+    std::vector<uint32_t> m_outIndices;
+    std::vector<Meshlet> m_meshlets;
+    std::vector<TargetBound> m_targetBounds;
+};
+
+#endif
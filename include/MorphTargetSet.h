@@ -0,0 +1,329 @@
+#ifndef MORPHTARGETSET_H_
+#define MORPHTARGETSET_H_
+#include <ngl/Types.h>
+#include <ngl/Vec3.h>
+#include "MorphBasis.h"
+#include "MorphLOD.h"
+#include "MorphMeshlets.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MorphCache;
+class MorphEngine;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a simple structure to hold our vertex data
+//----------------------------------------------------------------------------------------------------------------------
+struct vertData
+{
+  ngl::Vec3 p1;
+  ngl::Vec3 n1;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MorphTargetSet.h
+/// @brief holds a welded base mesh and an arbitrary number of morph targets plus their weights
+/// @class MorphTargetSet
+/// @brief The first pose file is the base mesh, every other file is a target. The deltas are stored target major
+/// so the TBO index for target t of vertex v is 2*(t*numVerts+v) with the position delta first then the normal.
+/// The weights are kept in one contiguous array and a compacted list of the active (non zero) targets is rebuilt
+/// when they change so the shader only loops over the targets that contribute. If the targets have been compressed
+/// (buildBasis) the TBO holds the basis shapes in place of the targets and the active list is of the shapes.
+//----------------------------------------------------------------------------------------------------------------------
+class MorphTargetSet
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the maximum number of targets the shader will blend at once, must match MAX_ACTIVE_TARGETS in the shader
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_maxActiveTargets = 64;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief deltas smaller than this (in every component) are treated as not moving the vertex
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr ngl::Real c_defaultSparseThreshold = 1e-6f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the vertices a target actually moves, deltas holds a position / normal pair per index
+    //----------------------------------------------------------------------------------------------------------------------
+    struct SparseTarget
+    {
+      std::vector<GLuint> indices;
+      std::vector<ngl::Vec3> deltas;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief how the deltas are stored in the TBO, the normalised formats use a per target range
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class DeltaFormat
+    {
+      RGB32F,  ///< 12 bytes per delta, exact
+      RGBA16F, ///< 8 bytes per delta, half floats
+      RGBA16,  ///< 8 bytes per delta, 16 bit normalised over the target range
+      RGBA8,   ///< 4 bytes per delta, 8 bit normalised over the target range
+      AUTO     ///< the smallest of the above that meets the tolerance
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the per target decode range, delta = texel * scale + bias (scale 1 bias 0 for the float formats)
+    //----------------------------------------------------------------------------------------------------------------------
+    struct DeltaRange
+    {
+      ngl::Vec3 posScale = {1.0f, 1.0f, 1.0f};
+      ngl::Vec3 posBias = {0.0f, 0.0f, 0.0f};
+      ngl::Vec3 normalScale = {1.0f, 1.0f, 1.0f};
+      ngl::Vec3 normalBias = {0.0f, 0.0f, 0.0f};
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one entry of the active list, laid out as a std140 struct of two vec4. The weight is folded into the
+    /// decode scale and the biases are summed over all active targets (see activeBias) so the shader only does a
+    /// multiply add per target whatever the format.
+    //----------------------------------------------------------------------------------------------------------------------
+    struct ActiveTarget
+    {
+      GLfloat posScale[3];
+      GLfloat index;
+      GLfloat normalScale[3];
+      GLfloat weight;
+    };
+    MorphTargetSet();
+    ~MorphTargetSet();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the poses, from the cache if it is valid else by parsing the obj files (the cache is then written)
+    /// @param [in] _poseFiles the base mesh followed by the targets
+    /// @param [in] _cacheFile the binary cache to use
+    /// @returns false if the poses could not be loaded
+    //----------------------------------------------------------------------------------------------------------------------
+    bool load(const std::vector<std::string> &_poseFiles, std::string_view _cacheFile);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the Bruce poses in models/, the base first then the targets
+    //----------------------------------------------------------------------------------------------------------------------
+    static const std::vector<std::string> &defaultPoseFiles();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the name of the binary cache for a set of poses, it lives next to the base pose
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::string cacheFileName(const std::vector<std::string> &_poseFiles);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the base pose and every target of a CPU engine, which keeps its own SoA copy of them
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadEngine(MorphEngine &o_engine) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief how far through the obj parse load is (0.0 -> 1.0), safe to read from another thread while load runs
+    //----------------------------------------------------------------------------------------------------------------------
+    float loadProgress() const { return m_loadProgress.load(std::memory_order_relaxed); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the vertices and normals of one pose, all the poses share the base face list
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Pose
+    {
+      std::vector<ngl::Vec3> verts;
+      std::vector<ngl::Vec3> normals;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one triangle corner, the position and normal index in the pose
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Corner
+    {
+      uint32_t vert;
+      uint32_t normal;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief weld the face corners and pack the base pose and target deltas, this is what load does after parsing
+    /// the obj files and is public so it can be used (and timed) with poses that didn't come from files
+    /// @param [in] _base the base pose
+    /// @param [in] _corners the triangles, three corners each, shared by every pose. The indices must be in range.
+    /// @param [in] _targets the target poses, any that don't match the base vertex / normal count get zero deltas
+    //----------------------------------------------------------------------------------------------------------------------
+    void pack(const Pose &_base, const std::vector<Corner> &_corners, const std::vector<Pose> &_targets);
+    size_t numVerts() const { return m_numVerts; }
+    size_t numIndices() const { return m_numIndices; }
+    size_t numTargets() const { return m_weights.size(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the packed base pose, this may point into the mapped cache file
+    //----------------------------------------------------------------------------------------------------------------------
+    const vertData *vertices() const { return m_verts; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the deltas for all targets (2 per vertex per target)
+    //----------------------------------------------------------------------------------------------------------------------
+    const ngl::Vec3 *deltas() const { return m_deltas; }
+    size_t deltaBytes() const { return m_numVerts * numTargets() * 2 * sizeof(ngl::Vec3); }
+    const GLuint *indices() const { return m_indices; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief compress the targets into fewer shared shapes with MorphBasis, the shape count, compression ratio and
+    /// the error against the exact blend are logged. The basis is only used if it has fewer shapes than there are
+    /// targets. Call before encodeDeltas.
+    /// @returns true if the basis is used
+    //----------------------------------------------------------------------------------------------------------------------
+    bool buildBasis(const MorphBasis::Options &_options);
+    bool hasBasis() const { return m_useBasis; }
+    const MorphBasis &basis() const { return m_basis; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what the TBO holds, the basis shapes if there is a basis else the targets
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t numShapes() const { return m_useBasis ? m_basis.numShapes() : numTargets(); }
+    const ngl::Vec3 *shapeDeltas() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief encode the deltas for the TBO, the maximum reconstruction error of each format tried is logged
+    /// @param [in] _format the format to use, AUTO picks the smallest one within _tolerance
+    /// @param [in] _tolerance the largest allowed error (in model units) for AUTO
+    /// @returns the format used
+    //----------------------------------------------------------------------------------------------------------------------
+    DeltaFormat encodeDeltas(DeltaFormat _format, ngl::Real _tolerance = 1e-3f);
+    DeltaFormat deltaFormat() const { return m_format; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the TBO payload in deltaFormat(), numShapes() blocks of deltas
+    //----------------------------------------------------------------------------------------------------------------------
+    const void *encodedDeltas() const;
+    size_t encodedBytes() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one shape's block of the encoded deltas, the shapes are stored one after the other
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t encodedTargetBytes() const { return m_numVerts * 2 * bytesPerDelta(m_format); }
+    const void *encodedTarget(size_t _target) const
+    {
+      return static_cast<const unsigned char *>(encodedDeltas()) + _target * encodedTargetBytes();
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief let the OS drop the host pages of a shape until it is next read, only the float targets used straight
+    /// from the mapped cache can be released (the other formats and the basis are in memory) so this may do nothing
+    //----------------------------------------------------------------------------------------------------------------------
+    void releaseTarget(size_t _target) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the GL internal format to use with glTexBuffer for a delta format
+    //----------------------------------------------------------------------------------------------------------------------
+    static GLenum glFormat(DeltaFormat _format);
+    static size_t bytesPerDelta(DeltaFormat _format);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the per shape decode ranges for deltaFormat(), empty until encodeDeltas has been called
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<DeltaRange> &deltaRanges() const { return m_ranges; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the weight of a target, it is clamped to the 0-1 range
+    //----------------------------------------------------------------------------------------------------------------------
+    void setWeight(size_t _target, ngl::Real _w);
+    ngl::Real weight(size_t _target) const { return m_weights[_target]; }
+    const std::vector<ngl::Real> &weights() const { return m_weights; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief rebuild the compacted active list if any weight has changed, with a basis the weights are folded into
+    /// shape weights first
+    /// @returns true if the list was rebuilt and needs to be uploaded again
+    //----------------------------------------------------------------------------------------------------------------------
+    bool updateActive();
+    const std::vector<ActiveTarget> &activeTargets() const { return m_active; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief sum of weight * bias for the active targets, xyz position and normal
+    //----------------------------------------------------------------------------------------------------------------------
+    const ngl::Vec3 &activePosBias() const { return m_activePosBias; }
+    const ngl::Vec3 &activeNormalBias() const { return m_activeNormalBias; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the sparse version of each target from the dense deltas, the sparsity of each target is logged
+    /// @param [in] _threshold a vertex is moved if any component of its position or normal delta is above this
+    //----------------------------------------------------------------------------------------------------------------------
+    void buildSparse(ngl::Real _threshold = c_defaultSparseThreshold);
+    const std::vector<SparseTarget> &sparseTargets() const { return m_sparse; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one level of detail, a range of lodIndices() into the same vertices (and TBO) as the full mesh
+    //----------------------------------------------------------------------------------------------------------------------
+    struct LOD
+    {
+      size_t firstIndex = 0;
+      size_t numIndices = 0;
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief about how far (in model units) the surface of this level is from the full mesh in any pose
+      //----------------------------------------------------------------------------------------------------------------------
+      ngl::Real error = 0.0f;
+      size_t numVerts = 0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the level of detail chain with MorphLOD from the base pose and the position deltas, the levels
+    /// are logged. Also works out the bounding sphere, needs the deltas so call after load.
+    //----------------------------------------------------------------------------------------------------------------------
+    void buildLODs(const MorphLOD::Options &_options = {});
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the index lists of every level one after the other, level 0 is indices()
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<GLuint> &lodIndices() const { return m_lodIndices; }
+    const std::vector<LOD> &lods() const { return m_lods; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a sphere around the base pose that still holds every vertex with all the target weights at 1
+    //----------------------------------------------------------------------------------------------------------------------
+    const ngl::Vec3 &boundsCentre() const { return m_boundsCentre; }
+    ngl::Real boundsRadius() const { return m_boundsRadius; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief split the full mesh (LOD 0) into meshlets for culling, the triangles of level 0 in lodIndices() are
+    /// reordered to match so call after buildLODs and before the indices are uploaded. The sizes are logged.
+    //----------------------------------------------------------------------------------------------------------------------
+    void buildMeshlets(const MorphMeshlets::Options &_options = {});
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the meshlets, their index ranges are into lodIndices()
+    //----------------------------------------------------------------------------------------------------------------------
+    const MorphMeshlets &meshlets() const { return m_meshlets; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief blend the current weights into the morphed buffer by scattering only the vertices each active target
+    /// moves, vertices touched last time but not now are reset to the base pose
+    /// @param [out] o_first the first vertex that changed
+    /// @param [out] o_last one past the last vertex that changed (equal to o_first if nothing changed)
+    //----------------------------------------------------------------------------------------------------------------------
+    void applySparse(size_t &o_first, size_t &o_last);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief put the morphed buffer back to the base pose
+    //----------------------------------------------------------------------------------------------------------------------
+    void resetSparse();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the result of applySparse
+    //----------------------------------------------------------------------------------------------------------------------
+    const vertData *morphedVertices() const { return m_morphed.data(); }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief parse the obj files and pack them into the m_own buffers
+    //----------------------------------------------------------------------------------------------------------------------
+    bool build(const std::vector<std::string> &_poseFiles);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief encode into one format
+    /// @param [out] o_data the encoded deltas
+    /// @param [out] o_ranges the decode range for each target
+    /// @param [out] o_posError the max position error
+    /// @param [out] o_normalError the max normal error
+    //----------------------------------------------------------------------------------------------------------------------
+    void encode(DeltaFormat _format, std::vector<unsigned char> &o_data, std::vector<DeltaRange> &o_ranges, ngl::Real &o_posError,
+                ngl::Real &o_normalError) const;
+    std::unique_ptr<MorphCache> m_cache;
+    std::atomic<float> m_loadProgress{0.0f};
+    std::vector<vertData> m_ownVerts;
+    std::vector<ngl::Vec3> m_ownDeltas;
+    std::vector<GLuint> m_ownIndices;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief views of the data, either the m_own buffers or the mapped cache
+    //----------------------------------------------------------------------------------------------------------------------
+    const vertData *m_verts = nullptr;
+    const ngl::Vec3 *m_deltas = nullptr;
+    const GLuint *m_indices = nullptr;
+    size_t m_numVerts = 0;
+    size_t m_numIndices = 0;
+    std::vector<ngl::Real> m_weights;
+    MorphBasis m_basis;
+    bool m_useBasis = false;
+    std::vector<ngl::Real> m_shapeWeights;
+    std::vector<ActiveTarget> m_active;
+    ngl::Vec3 m_activePosBias;
+    ngl::Vec3 m_activeNormalBias;
+    bool m_weightsDirty = true;
+    DeltaFormat m_format = DeltaFormat::RGB32F;
+    std::vector<unsigned char> m_encoded;
+    std::vector<DeltaRange> m_ranges;
+    std::vector<SparseTarget> m_sparse;
+    std::vector<GLuint> m_lodIndices;
+    std::vector<LOD> m_lods;
+    ngl::Vec3 m_boundsCentre;
+    ngl::Real m_boundsRadius = 0.0f;
+    MorphMeshlets m_meshlets;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the sparse blend result plus the list of vertices that currently differ from the base
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<vertData> m_morphed;
+    std::vector<GLuint> m_touched;
+    std::vector<unsigned char> m_touchedFlag;
+};
+
+#endif
@@ -2,12 +2,28 @@
 #define NGLSCENE_H_
 #include <QTimer>
 #include <ngl/AbstractVAO.h>
-#include <ngl/Obj.h>
 #include <ngl/Text.h>
 #include <ngl/Mat4.h>
 #include "WindowParams.h"
+#include "MorphTargetSet.h"
+#include "MorphEngine.h"
+#include "CrowdInstances.h"
+#include "SceneState.h"
+#include "FrameClock.h"
+#include "WeightAnimator.h"
+#include "ShaderCache.h"
+#include "UniformRing.h"
+#include "TargetResidency.h"
+#include "MorphBVH.h"
 #include <QOpenGLWindow>
+#include <QSurfaceFormat>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 //----------------------------------------------------------------------------------------------------------------------
 /// @file NGLScene.h
@@ -28,9 +44,9 @@ class NGLScene : public QOpenGLWindow
   public:
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief ctor for our NGL drawing class
-    /// @param [in] parent the parent window to the class
+    /// @param [in] _poseFiles the base pose followed by the morph targets, if empty the Bruce models are used
     //----------------------------------------------------------------------------------------------------------------------
-    NGLScene();
+    explicit NGLScene(const std::vector<std::string> &_poseFiles = {});
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief dtor must close down ngl and release OpenGL resources
     //----------------------------------------------------------------------------------------------------------------------
@@ -48,6 +64,71 @@ class NGLScene : public QOpenGLWindow
     /// @brief this is called everytime we resize
     //----------------------------------------------------------------------------------------------------------------------
     void resizeGL(int _w, int _h);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the TBO delta format, must be called before the window is shown
+    //----------------------------------------------------------------------------------------------------------------------
+    void setDeltaFormat(MorphTargetSet::DeltaFormat _format) { m_deltaFormat = _format; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief compress the targets into a shared basis that gets every target within _tolerance (model units), 0 keeps
+    /// the targets as they are. Must be called before the window is shown.
+    //----------------------------------------------------------------------------------------------------------------------
+    void setBasisTolerance(ngl::Real _tolerance) { m_basisTolerance = _tolerance; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the number of characters drawn in crowd mode, must be called before the window is shown. With more
+    /// than one the demo starts in crowd mode
+    //----------------------------------------------------------------------------------------------------------------------
+    void setCrowdSize(size_t _count) { m_crowdSize = _count; m_crowdMode = _count > 1; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief enable the morph pre-pass, the GPU blend is captured once with transform feedback when the weights
+    /// change and drawn as plain geometry
+    //----------------------------------------------------------------------------------------------------------------------
+    void setPrePass(bool _enabled) { m_prePass = _enabled; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the memory the morph targets may use, in bytes. The GPU pool holds as many targets as fit (but never
+    /// fewer than can be active at once) and the rest are streamed in when their weight becomes non zero. Must be
+    /// called before the window is shown.
+    //----------------------------------------------------------------------------------------------------------------------
+    void setTargetBudget(size_t _gpuBytes, size_t _hostBytes) { m_gpuTargetBudget = _gpuBytes; m_hostTargetBudget = _hostBytes; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frames drawn and frame requests dropped because nothing had changed
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t framesRendered() const { return m_state.framesRendered(); }
+    size_t framesSkipped() const { return m_state.framesSkipped(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief step the animation clock by a fixed amount (in seconds) every tick instead of following real time
+    //----------------------------------------------------------------------------------------------------------------------
+    void setFixedTimestep(double _step) { m_clock.setFixedStep(_step); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write the profiler zones to this file as a Chrome trace when the scene is destroyed, T writes it at any
+    /// time
+    //----------------------------------------------------------------------------------------------------------------------
+    void setTraceFile(std::string_view _fileName) { m_traceFile = _fileName; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the poses are loaded on a worker thread and the targets uploaded a slice per frame, this waits for the
+    /// load and does the whole upload now. Call after initializeGL when frames aren't being drawn (the benchmark).
+    /// @returns false if the poses couldn't be loaded
+    //----------------------------------------------------------------------------------------------------------------------
+    bool finishLoading();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build every shader program in an offscreen context so the binaries are in the cache before the demo is
+    /// run, a session started after this never compiles a shader (until the sources or driver change)
+    /// @returns the process exit code
+    //----------------------------------------------------------------------------------------------------------------------
+    static int warmShaderCache(const QSurfaceFormat &_format);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the scripting interface used by the keys and the offscreen benchmark, these need initializeGL to have
+    /// been called. setKeyWeight sets the weight the clips are added to.
+    //----------------------------------------------------------------------------------------------------------------------
+    void setKeyWeight(size_t _target, ngl::Real _w);
+    void punch(size_t _target);
+    void toggleCrowd();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief advance the clock one frame and evaluate all the animation (single character and crowd)
+    //----------------------------------------------------------------------------------------------------------------------
+    void advanceAnimation();
+    size_t numTargets() const { return m_morph.numTargets(); }
+    size_t numVerts() const { return m_morph.numVerts(); }
+    size_t crowdSize() const { return m_crowdMode ? m_crowd.size() : 1; }
 
 private:
     //----------------------------------------------------------------------------------------------------------------------
@@ -67,63 +148,299 @@ private:
     /// @brief the model position for mouse movement
     //----------------------------------------------------------------------------------------------------------------------
     ngl::Vec3 m_modelPos;
-    enum class Weights{POSE1,POSE2};
     enum class Direction{UP,DOWN};
-    void changeWeight(Weights _w,Direction _d );
+    void changeWeight(size_t _target,Direction _d );
 
-    inline void toggleAnimation(){m_animation^=true;}
-    void punchLeft();
-    void punchRight();
-    //----------------------------------------------------------------------------------------------------------------------
-    /// @brief our model
-    //----------------------------------------------------------------------------------------------------------------------
-    std::vector< std::unique_ptr<ngl::Obj >> m_meshes;
+    void toggleAnimation();
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief text for rendering
+    /// @brief the pose files we load, the first is the base mesh
     //----------------------------------------------------------------------------------------------------------------------
-    std::unique_ptr<ngl::Text> m_text;
+    std::vector<std::string> m_poseFiles;
+    std::string m_traceFile;
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief the weight of pose one
+    /// @brief our model, the base mesh and all the morph targets with their weights
     //----------------------------------------------------------------------------------------------------------------------
-    ngl::Real m_weight1;
+    MorphTargetSet m_morph;
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief the weight of pose two
+    /// @brief text for rendering
     //----------------------------------------------------------------------------------------------------------------------
-    ngl::Real m_weight2;
+    std::unique_ptr<ngl::Text> m_text;
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief the mesh with all the data in it
     //----------------------------------------------------------------------------------------------------------------------
     std::unique_ptr<ngl::AbstractVAO> m_vaoMesh;
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief left animation timer
+    /// @brief the one animation tick, it only runs while something is animating
     //----------------------------------------------------------------------------------------------------------------------
-    QTimer *m_timerLeft;
+    QTimer *m_timerAnimation;
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief right animation timer
+    /// animation flag, when false the clock is paused
     //----------------------------------------------------------------------------------------------------------------------
-    QTimer *m_timerRight;
+    bool m_animation;
     //----------------------------------------------------------------------------------------------------------------------
-    /// animation flag for timers
+    /// @brief the animation time, read once per tick
     //----------------------------------------------------------------------------------------------------------------------
-    bool m_animation;
+    FrameClock m_clock;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the punch clips for the single character, added on top of the weights set from the keys
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief flag to indicate if punching left
+    WeightAnimator m_animator;
+    WeightAnimator::CurveID m_punchCurve = 0;
+    std::vector<ngl::Real> m_keyWeights;
+    std::vector<ngl::Real> m_animatedWeights;
     //----------------------------------------------------------------------------------------------------------------------
-    bool m_punchLeft;
+    /// @brief start the tick if it isn't running
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief flag to indicate if punching right
+    void startAnimation();
     //----------------------------------------------------------------------------------------------------------------------
-    bool m_punchRight;
+    /// @brief set the morph weights to the key weights plus the clips at _time
+    //----------------------------------------------------------------------------------------------------------------------
+    void applyWeights(double _time);
     /// @brief the id for the texture buffer object
     GLuint m_tboID;
+    /// @brief the uniform buffer holding the compacted active target list
+    GLuint m_weightUBO = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the VAO, weight buffer and an empty TBO from the loaded morph targets, the base pose can be drawn
+    /// straight away and the deltas follow with uploadDeltaSlice
+    //----------------------------------------------------------------------------------------------------------------------
+    void uploadMorphMesh();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief copy the next (at most _bytes) of the encoded deltas into the TBO
+    /// @returns true once all of them are resident
+    //----------------------------------------------------------------------------------------------------------------------
+    bool uploadDeltaSlice(size_t _bytes);
+    GLuint m_deltaBuffer = 0;
+    size_t m_deltaBytesUploaded = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief which targets are in the delta pool (m_deltaBuffer), the shaders find a target through its slot. The
+    /// single character's active list carries the slot in place of the target index and the crowd reads a slot
+    /// table in the MorphRanges block.
+    //----------------------------------------------------------------------------------------------------------------------
+    TargetResidency m_residency;
+    size_t m_gpuTargetBudget = size_t(256) << 20;
+    size_t m_hostTargetBudget = size_t(1024) << 20;
+    std::vector<TargetResidency::Upload> m_residencyUploads;
+    std::vector<uint32_t> m_residencyReleased;
+    std::vector<uint32_t> m_upcomingTargets;
+    std::vector<MorphTargetSet::ActiveTarget> m_activeSlots;
+    bool m_activeSlotsDirty = false;
+    bool m_crowdSlotsDirty = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief request the targets this frame needs, prefetch the ones the clips are about to need and copy any that
+    /// were given a slot into the pool
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateResidency();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write the crowd's target to slot table into the MorphRanges block
+    //----------------------------------------------------------------------------------------------------------------------
+    void uploadCrowdSlots();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief where the background load is up to, the worker moves it through LOADING and PROCESSING and the render
+    /// thread takes it from UPLOADING to READY. Until READY only the base pose is drawn and the keys are ignored.
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class LoadStage{LOADING,PROCESSING,UPLOADING,READY,FAILED};
+    std::atomic<LoadStage> m_loadStage{LoadStage::LOADING};
+    std::thread m_loadThread;
+    std::chrono::steady_clock::time_point m_loadStart;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief runs on m_loadThread, parse (or map the cache) and do all the CPU side packing and encoding
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadPoses();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread side of the load, called each frame until READY. Once the worker has finished this
+    /// creates the mesh and uploads the deltas in _sliceBytes pieces, then sets up everything that needs the targets.
+    /// @param [in] _wait block until the worker is done instead of returning straight away
+    //----------------------------------------------------------------------------------------------------------------------
+    void continueLoading(size_t _sliceBytes, bool _wait);
+    bool ready() const { return m_loadStage == LoadStage::READY; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the progress overlay drawn over the base pose while loading
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawLoadingText();
     //----------------------------------------------------------------------------------------------------------------------
-    /// do our morphing for the 3 meshes
+    /// @brief the pool size and residency counters, one line at _y
     //----------------------------------------------------------------------------------------------------------------------
-    void createMorphMesh();
+    void drawResidencyText(int _y);
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief method to load transform matrices to the shader
+    /// @brief every program the scene uses, all built at startup so this is also what warmShaderCache builds
     //----------------------------------------------------------------------------------------------------------------------
-    void loadMatricesToShader();
+    static std::vector<ShaderCache::Program> shaderPrograms();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the program binaries are kept in shadercache next to the executable
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::string shaderCacheDirectory();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build all the programs (from the binary cache where it can) and set their material and light uniforms
+    //----------------------------------------------------------------------------------------------------------------------
+    void createShaders();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief upload the active target list if any of the weights have changed
+    //----------------------------------------------------------------------------------------------------------------------
+    void uploadWeights();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief where the blend is done, in the shader from the TBO or on the CPU (sparse scatter or the SIMD engine)
+    /// with the result written into the VBO
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class BlendMode{GPU,CPU_SPARSE,CPU_SIMD};
+    BlendMode m_blendMode = BlendMode::GPU;
+    void cycleBlendMode();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the base and targets into the CPU morph engine
+    //----------------------------------------------------------------------------------------------------------------------
+    void createEngine();
+    MorphEngine m_engine;
+    MorphEngine::Result m_engineResult;
+    std::vector<GLfloat> m_engineVerts;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief mouse picking, a left click casts a ray from the camera through the morphed mesh (or every crowd
+    /// instance whose bounds it enters). The tree is built once from the base pose and only refit, from an engine
+    /// blend, when the weights of the character being tested differ from the ones it was last fit to.
+    //----------------------------------------------------------------------------------------------------------------------
+    MorphBVH m_bvh;
+    std::vector<ngl::Real> m_bvhWeights;
+    MorphEngine::Result m_pickResult;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pick at window position _x _y (logical pixels, from the top left)
+    //----------------------------------------------------------------------------------------------------------------------
+    void pick(float _x, float _y);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief refit m_bvh to _weights if they aren't the ones it was last fit to
+    //----------------------------------------------------------------------------------------------------------------------
+    void refitBVH(const std::vector<ngl::Real> &_weights);
+    void drawPickText(int _y);
+    bool m_picked = false;
+    size_t m_pickInstance = 0;
+    uint32_t m_pickTriangle = 0;
+    ngl::Vec3 m_pickPoint;
+    size_t m_pickRefits = 0;
+    double m_pickMs = 0.0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the format the deltas are stored in the TBO
+    //----------------------------------------------------------------------------------------------------------------------
+    MorphTargetSet::DeltaFormat m_deltaFormat = MorphTargetSet::DeltaFormat::AUTO;
+    ngl::Real m_basisTolerance = 0.0f;
+    bool m_morphModeChanged = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the crowd, every instance has its own transform and weights in the instance TBO and the whole crowd is
+    /// drawn with one glDrawElementsInstanced using the GPU blend
+    //----------------------------------------------------------------------------------------------------------------------
+    CrowdInstances m_crowd;
+    size_t m_crowdSize = 1;
+    bool m_crowdMode = false;
+    bool m_crowdDirty = true;
+    GLuint m_instanceBuffer = 0;
+    GLuint m_instanceTBO = 0;
+    GLuint m_rangeUBO = 0;
+    std::vector<GLfloat> m_instanceData;
+    ngl::Mat4 m_crowdView;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief lay out the crowd and create the instance TBO and the target range block
+    //----------------------------------------------------------------------------------------------------------------------
+    void createCrowd();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the crowd, one instanced call per level of detail in use
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawCrowd();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the level of detail, a level is picked for the single character and for each crowd instance from how
+    /// big its error is on screen. The crowd instances are packed sorted by level (m_lodOrder) so the instances of a
+    /// level are contiguous and the Transforms block tells the shader where they start.
+    //----------------------------------------------------------------------------------------------------------------------
+    bool m_lod = true;
+    size_t m_lodLevel = 0;
+    bool m_crowdLODDirty = true;
+    std::vector<uint32_t> m_lodOrder;
+    std::vector<size_t> m_lodCounts;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the coarsest level whose error projects to under c_lodPixelError pixels
+    /// @param [in] _MV the model view matrix of the character
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t selectLOD(const ngl::Mat4 &_MV) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief sort the crowd instances by level into m_lodOrder, marks the crowd dirty if the order changed
+    //----------------------------------------------------------------------------------------------------------------------
+    void selectCrowdLODs();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw one level with the bound VAO, the levels share the element buffer so this is an offset draw
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawLOD(size_t _level, size_t _instances = 1);
+    void toggleLOD();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief meshlet culling for the single character, at LOD 0 the meshlets are culled against the frustum and
+    /// their normal cones (grown by the current weights) and the runs of visible ones drawn with one multi draw.
+    /// glMultiDrawElementsIndirect needs GL 4.3, older contexts (macOS) take the same ranges through glMultiDrawElements.
+    //----------------------------------------------------------------------------------------------------------------------
+    struct DrawElementsCommand
+    {
+      GLuint count;
+      GLuint instanceCount;
+      GLuint firstIndex;
+      GLint baseVertex;
+      GLuint baseInstance;
+    };
+    bool m_meshletCulling = true;
+    bool m_multiDrawIndirect = false;
+    GLuint m_indirectBuffer = 0;
+    std::vector<uint32_t> m_visibleMeshlets;
+    std::vector<DrawElementsCommand> m_drawCommands;
+    std::vector<GLsizei> m_drawCounts;
+    std::vector<const void *> m_drawOffsets;
+    size_t m_meshletTriangles = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the single character with the bound VAO, the culled meshlets at LOD 0 else the whole level
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawMesh();
+    void toggleMeshletCulling();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the morph pre-pass, m_vaoMorphed shares the index data with m_vaoMesh but its vertex buffer is the
+    /// transform feedback output. It is only re-run when uploadWeights has changed the MorphWeights block.
+    //----------------------------------------------------------------------------------------------------------------------
+    std::unique_ptr<ngl::AbstractVAO> m_vaoMorphed;
+    bool m_prePass = false;
+    bool m_prePassDirty = true;
+    size_t m_prePassRuns = 0;
+    size_t m_prePassSkips = 0;
+    void morphPrePass();
+    void togglePrePass();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the std140 Transforms block all the drawing programs read, normalMatrix is a mat3 so each column is
+    /// padded to a vec4. The crowd's MV / MVP are the camera, the instance model matrix is applied in the shader.
+    /// firstInstance is only read by the crowd shader, the slot of the first instance in the draw.
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Transforms
+    {
+      GLfloat MVP[16];
+      GLfloat MV[16];
+      GLfloat normalMatrix[12];
+      GLint firstInstance;
+      GLint pad[3];
+    };
+    Transforms m_transforms;
+    Transforms m_crowdTransforms;
+    ngl::Mat4 m_MV;
+    ngl::Mat4 m_crowdMV;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief work out the Transforms blocks, only called when the camera is dirty
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateTransforms();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the per frame constants, each draw writes its Transforms into the ring and binds that range
+    //----------------------------------------------------------------------------------------------------------------------
+    UniformRing m_uniformRing;
+    void bindTransforms(const Transforms &_transforms);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the light and material block, these never change so it is written once by createShaders
+    //----------------------------------------------------------------------------------------------------------------------
+    GLuint m_lightingUBO = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what has changed since the last frame
+    //----------------------------------------------------------------------------------------------------------------------
+    SceneState m_state;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief schedule a frame if anything is dirty, else count it as skipped
+    //----------------------------------------------------------------------------------------------------------------------
+    void requestFrame();
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief Qt Event called when a key is pressed
     /// @param [in] _event the Qt event to query for size etc
@@ -155,13 +472,9 @@ private:
     void wheelEvent( QWheelEvent *_event);
   private slots :
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief the timers are connected to slots to trigger the events
-    //----------------------------------------------------------------------------------------------------------------------
-    void updateLeft();
-    //----------------------------------------------------------------------------------------------------------------------
-    /// @brief the timers are connected to slots to trigger the events
+    /// @brief the animation timer, advances the animation and requests a frame
     //----------------------------------------------------------------------------------------------------------------------
-    void updateRight();
+    void tick();
 };
 
 
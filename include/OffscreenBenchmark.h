@@ -0,0 +1,59 @@
+#ifndef OFFSCREENBENCHMARK_H_
+#define OFFSCREENBENCHMARK_H_
+#include <QSurfaceFormat>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class NGLScene;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file OffscreenBenchmark.h
+/// @brief renders an NGLScene into an FBO on a QOffscreenSurface with no window, so it can run on a render farm
+/// (including Mesa llvmpipe on machines without a GPU)
+/// @class OffscreenBenchmark
+/// @brief The scene is driven by a scripted sweep of the key weights plus regular punches on a fixed 60Hz clock so
+/// every run animates the same. Each frame is timed on the CPU and with a GL_TIME_ELAPSED query (read back a few
+/// frames late so the query doesn't stall the pipeline), the distributions are printed and written out as JSON.
+//----------------------------------------------------------------------------------------------------------------------
+class OffscreenBenchmark
+{
+  public:
+    struct Options
+    {
+      size_t frames = 600;
+      int width = 1024;
+      int height = 720;
+      std::string output = "benchmark.json";
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief summary of a set of frame times in ms, the percentiles are nearest rank
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Stats
+    {
+      double mean = 0.0;
+      double p50 = 0.0;
+      double p95 = 0.0;
+      double p99 = 0.0;
+      double min = 0.0;
+      double max = 0.0;
+    };
+    static Stats stats(std::vector<double> _times);
+    explicit OffscreenBenchmark(const Options &_options) : m_options(_options) {}
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the context and FBO, initialise the scene in it and run the frames
+    /// @param [in] _scene the scene, it must not have been shown
+    /// @param [in] _format the format for the context, the sample count is used for the FBO
+    /// @returns the process exit code
+    //----------------------------------------------------------------------------------------------------------------------
+    int run(NGLScene &_scene, const QSurfaceFormat &_format);
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set up the animation for a frame, a sine sweep of every key weight and a punch every half second
+    //----------------------------------------------------------------------------------------------------------------------
+    static void script(NGLScene &_scene, size_t _frame);
+    Options m_options;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef POSESETLOADER_H_
+#define POSESETLOADER_H_
+#include "MorphTargetSet.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PoseSetLoader.h
+/// @brief reads a set of pose obj files straight into the arrays MorphTargetSet::pack wants
+/// @class PoseSetLoader
+/// @brief Every file is memory mapped and cut into chunks at line breaks, large files into many. All the chunks of all
+/// the files are parsed in parallel on the pool in two passes: the first counts the v / vn / f lines so each chunk knows
+/// where its data goes (and what relative indices refer to), the second parses directly into arrays allocated once at
+/// the final size. Only the base face list is kept, for the targets each chunk hashes its triangles by position so the
+/// faces can be compared to the base without storing them. Targets with a different vertex or normal count (or that
+/// fail to parse) are left empty, which pack treats as having no effect. Different faces with the same counts are
+/// only reported as the base faces are used for every pose anyway.
+//----------------------------------------------------------------------------------------------------------------------
+class PoseSetLoader
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief files are split into chunks of about this many bytes
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_chunkSize = 1 << 22;
+    explicit PoseSetLoader(ThreadPool &_pool) : m_pool(_pool) {}
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief called with the fraction (0.0 -> 1.0) of the parse done as each chunk finishes, it is called from the pool
+    /// threads so must be thread safe
+    //----------------------------------------------------------------------------------------------------------------------
+    using Progress = std::function<void(float _done)>;
+    void setProgress(Progress _progress) { m_progress = std::move(_progress); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief parse the poses, polygons are fanned into triangles
+    /// @param [in] _poseFiles the base mesh followed by the targets
+    /// @returns false if the base couldn't be read or has no normals, a bad target is reported and left empty
+    //----------------------------------------------------------------------------------------------------------------------
+    bool load(const std::vector<std::string> &_poseFiles);
+    const MorphTargetSet::Pose &base() const { return m_base; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the base triangles, three corners each
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<MorphTargetSet::Corner> &corners() const { return m_corners; }
+    const std::vector<MorphTargetSet::Pose> &targets() const { return m_targets; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief free the parsed data once it has been packed
+    //----------------------------------------------------------------------------------------------------------------------
+    void clear();
+
+  private:
+    struct File;
+    struct Chunk;
+    void countChunk(Chunk &io_chunk) const;
+    void parseChunk(File &io_file, Chunk &io_chunk, bool _keepCorners);
+    ThreadPool &m_pool;
+    Progress m_progress;
+    MorphTargetSet::Pose m_base;
+    std::vector<MorphTargetSet::Corner> m_corners;
+    std::vector<MorphTargetSet::Pose> m_targets;
+};
+
+#endif
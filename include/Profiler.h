@@ -0,0 +1,175 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+#include <ngl/Types.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Profiler.h
+/// @brief a lightweight scoped zone profiler with CPU timers and GL timestamp queries that writes Chrome / Perfetto
+/// trace JSON. Use the PROFILE_ macros below, they compile to nothing unless MORPH_PROFILE is defined (the CMake
+/// option of the same name, on by default).
+/// @class Profiler
+/// @brief Zones are recorded into a fixed size ring so memory use doesn't grow and the last few hundred frames are
+/// always available. A CPU zone costs two clock reads and a ring write, a GPU zone two glQueryCounter calls, the
+/// queries are read back in frame() once their results are available so it never stalls the GPU.
+//----------------------------------------------------------------------------------------------------------------------
+class Profiler
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the number of zones kept, older ones are overwritten
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t c_capacity = 1 << 16;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the thread id used for the GPU zones in the trace
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t c_gpuThread = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the thread id of the thread that called registerMainThread, the others count up from the one after
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t c_mainThread = 1;
+    struct Zone
+    {
+      const char *name;
+      int64_t start; ///< ns since the profiler was created
+      int64_t duration;
+      uint32_t frame;
+      uint32_t thread;
+    };
+    static Profiler &instance();
+    void setEnabled(bool _enabled) { m_enabled = _enabled; }
+    bool enabled() const { return m_enabled; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief mark the start of a frame and collect any GPU zones whose queries have finished, call with the GL
+    /// context current
+    //----------------------------------------------------------------------------------------------------------------------
+    void frame();
+    uint32_t frameNumber() const { return m_frame.load(std::memory_order_relaxed); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ns since the profiler was created
+    //----------------------------------------------------------------------------------------------------------------------
+    int64_t now() const;
+    void record(const char *_name, int64_t _start, int64_t _end, uint32_t _thread);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the small id of the calling thread, c_mainThread for the registered main thread
+    //----------------------------------------------------------------------------------------------------------------------
+    static uint32_t threadID();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief give the calling thread c_mainThread and the "Main" track in the trace, call at startup before it
+    /// records anything
+    //----------------------------------------------------------------------------------------------------------------------
+    static void registerMainThread();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start / end a GPU zone, the returned handle is passed to endGPU. Needs the GL context current.
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t beginGPU(const char *_name);
+    void endGPU(size_t _handle);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the zones currently in the ring, oldest first
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<Zone> zones() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write the ring as Chrome trace event JSON (load it in chrome://tracing or ui.perfetto.dev)
+    /// @returns false if the file couldn't be written
+    //----------------------------------------------------------------------------------------------------------------------
+    bool writeChromeTrace(std::string_view _fileName) const;
+
+  private:
+    Profiler();
+    struct GPUZone
+    {
+      const char *name;
+      GLuint begin;
+      GLuint end;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief map GL_TIMESTAMP time on to our clock, redone every so often as the two clocks drift
+    //----------------------------------------------------------------------------------------------------------------------
+    void calibrate();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a ring entry, sequence is 1 + the number of the zone held once its fields are written (0 while empty or
+    /// being written) so a reader can tell a finished zone from a torn one. The fields are relaxed atomics as a
+    /// writer can be part way through a slot while zones() reads it.
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Slot
+    {
+      std::atomic<uint64_t> sequence{0};
+      std::atomic<const char *> name{nullptr};
+      std::atomic<int64_t> start{0};
+      std::atomic<int64_t> duration{0};
+      std::atomic<uint32_t> frame{0};
+      std::atomic<uint32_t> thread{0};
+    };
+    std::unique_ptr<Slot[]> m_ring;
+    std::atomic<uint64_t> m_next{0};
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bumped on the GL thread and read by every thread that records a zone
+    //----------------------------------------------------------------------------------------------------------------------
+    std::atomic<uint32_t> m_frame{0};
+    bool m_enabled = true;
+    int64_t m_origin;
+    int64_t m_gpuOffset = 0;
+    uint32_t m_calibratedFrame = 0;
+    bool m_calibrated = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GPU zones waiting for their queries, and the query pairs free for re-use
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<GPUZone> m_gpuZones;
+    std::vector<size_t> m_pending;
+    std::vector<size_t> m_free;
+};
+
+#ifdef MORPH_PROFILE
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief RAII CPU zone, records from construction to destruction. The name must be a string literal.
+//----------------------------------------------------------------------------------------------------------------------
+class ProfileZone
+{
+  public:
+    explicit ProfileZone(const char *_name) : m_name(_name), m_start(Profiler::instance().enabled() ? Profiler::instance().now() : -1) {}
+    ~ProfileZone()
+    {
+      if (m_start >= 0)
+        Profiler::instance().record(m_name, m_start, Profiler::instance().now(), Profiler::threadID());
+    }
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+  private:
+    const char *m_name;
+    int64_t m_start;
+};
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief RAII GPU zone, times the GL commands issued in its scope with a pair of timestamp queries
+//----------------------------------------------------------------------------------------------------------------------
+class ProfileGPUZone
+{
+  public:
+    explicit ProfileGPUZone(const char *_name) : m_handle(Profiler::instance().enabled() ? Profiler::instance().beginGPU(_name) : ~size_t(0)) {}
+    ~ProfileGPUZone()
+    {
+      if (m_handle != ~size_t(0))
+        Profiler::instance().endGPU(m_handle);
+    }
+    ProfileGPUZone(const ProfileGPUZone &) = delete;
+    ProfileGPUZone &operator=(const ProfileGPUZone &) = delete;
+
+  private:
+    size_t m_handle;
+};
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) ProfileGPUZone PROFILE_CONCAT(profileGPUZone, __LINE__)(name)
+#define PROFILE_FRAME() Profiler::instance().frame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#define PROFILE_FRAME()
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef PUNCHTIMELINE_H_
+#define PUNCHTIMELINE_H_
+#include "WeightAnimator.h"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PunchTimeline.h
+/// @brief the random punches a crowd plays, without the instance transforms so tools can use it with no NGL
+/// @class PunchTimeline
+/// @brief Each channel (a character) has its own weight vector animated with a WeightAnimator. Every target plays the
+/// punch from the single character demo (ramp up to 1 then back down) triggered at random so the characters don't
+/// move in step. The triggers come from a seeded generator so a fixed time step gives the same weights every run.
+//----------------------------------------------------------------------------------------------------------------------
+class PunchTimeline
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the time a punch takes to go out (and to come back), in seconds
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr float c_punchTime = 0.2f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the mean time between random punches of one target on one channel, in seconds
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr float c_meanPunchInterval = 3.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the random punches are picked this far (in seconds) ahead of when they start so the targets they need can
+    /// be streamed in first
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr float c_triggerLead = 0.25f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start again with every weight at zero
+    /// @param [in] _numChannels the number of characters
+    /// @param [in] _numTargets the number of morph targets (weights per channel)
+    /// @param [in] _seed seed for the random punch triggers so runs are repeatable
+    //----------------------------------------------------------------------------------------------------------------------
+    void create(size_t _numChannels, size_t _numTargets, uint32_t _seed = 1234);
+    size_t numChannels() const { return m_numTargets ? m_weights.size() / m_numTargets : 0; }
+    size_t numTargets() const { return m_numTargets; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a punch of one target on every channel, it adds to any punch already playing
+    /// @param [in] _target the target to punch
+    /// @param [in] _time the time to start the punch
+    //----------------------------------------------------------------------------------------------------------------------
+    void punchAll(size_t _target, double _time);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief trigger new random punches and evaluate all the playing ones
+    /// @param [in] _time the frame time in seconds
+    /// @param [in] _dt the time since the last update
+    /// @returns true if any weight changed
+    //----------------------------------------------------------------------------------------------------------------------
+    bool update(double _time, double _dt);
+    float weight(size_t _channel, size_t _target) const { return m_weights[_channel * m_numTargets + _target]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the numTargets() weights of one channel
+    //----------------------------------------------------------------------------------------------------------------------
+    const float *weights(size_t _channel) const { return &m_weights[_channel * m_numTargets]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief does any channel have a non zero weight on the target
+    //----------------------------------------------------------------------------------------------------------------------
+    bool targetInUse(size_t _target) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the targets of the punches that start within _window seconds of _time
+    //----------------------------------------------------------------------------------------------------------------------
+    void upcomingTargets(double _time, double _window, std::vector<uint32_t> &o_targets) const
+    {
+      m_animator.upcoming(_time, _window, o_targets);
+    }
+
+  private:
+    size_t m_numTargets = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief numChannels() * m_numTargets weights and the time each one's current punch ends
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<float> m_weights;
+    std::vector<double> m_busyUntil;
+    WeightAnimator m_animator;
+    WeightAnimator::CurveID m_punch = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief were any clips playing last update, if so the weights they left need zeroing
+    //----------------------------------------------------------------------------------------------------------------------
+    bool m_wasActive = false;
+    std::mt19937 m_rng;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SCENESTATE_H_
+#define SCENESTATE_H_
+#include <cstddef>
+#include <cstdint>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SceneState.h
+/// @brief tracks what has changed in the scene since the last frame so we only redraw (and only re-upload the
+/// uniforms) when something actually changed, and counts the frames drawn against the requests that were dropped
+//----------------------------------------------------------------------------------------------------------------------
+class SceneState
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the parts of the scene that can change, combine them with |
+    //----------------------------------------------------------------------------------------------------------------------
+    enum Flags : uint32_t
+    {
+      WEIGHTS = 1 << 0,  ///< morph or crowd weights
+      CAMERA = 1 << 1,   ///< view, projection or the mouse transform
+      VIEWPORT = 1 << 2, ///< window size
+      DISPLAY = 1 << 3,  ///< what is drawn, blend / crowd / pre-pass mode and the overlay text
+      ALL = WEIGHTS | CAMERA | VIEWPORT | DISPLAY
+    };
+    void mark(uint32_t _flags) { m_dirty |= _flags; }
+    bool dirty(uint32_t _flags = ALL) const { return (m_dirty & _flags) != 0; }
+    void clear(uint32_t _flags = ALL) { m_dirty &= ~_flags; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief called when something asks for a frame
+    /// @returns true if anything is dirty so the frame is worth drawing, else the request is counted as skipped
+    //----------------------------------------------------------------------------------------------------------------------
+    bool requestFrame()
+    {
+      if (m_dirty != 0)
+        return true;
+      ++m_framesSkipped;
+      return false;
+    }
+    void frameRendered() { ++m_framesRendered; }
+    size_t framesRendered() const { return m_framesRendered; }
+    size_t framesSkipped() const { return m_framesSkipped; }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief everything is dirty to start with so the first frame uploads it all
+    //----------------------------------------------------------------------------------------------------------------------
+    uint32_t m_dirty = ALL;
+    size_t m_framesRendered = 0;
+    size_t m_framesSkipped = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SHADERCACHE_H_
+#define SHADERCACHE_H_
+#include <ngl/Types.h>
+#include <ngl/ShaderLib.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShaderCache.h
+/// @brief builds ngl::ShaderLib programs from the linked binaries of an earlier run so startup doesn't pay for the
+/// compile and link every time.
+/// Each program is stored as [BinaryHeader][glGetProgramBinary data] in <directory>/<program>.bin
+/// @class ShaderCache
+/// @brief The header holds a key hashed from the stage sources, the defines, the feedback varyings and the GL
+/// vendor / renderer / version strings, so editing a shader or updating the driver means a compile. A binary the
+/// driver won't take (they can be rejected for any reason) is compiled from source and stored again.
+//----------------------------------------------------------------------------------------------------------------------
+class ShaderCache
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bump this whenever the file layout changes
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t c_version = 1;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one shader of a program, a stage used by several programs (the shared fragment shader) is only compiled
+    /// once
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Stage
+    {
+      std::string name;
+      ngl::ShaderType type;
+      std::string file;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a program variant, the defines are added after the #version line of every stage. Variants of the same
+    /// sources need their own program name.
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Program
+    {
+      std::string name;
+      std::vector<Stage> stages;
+      std::vector<std::string> defines = {};
+      std::vector<std::string> feedbackVaryings = {};
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, needs a current GL context as the driver strings are part of the key
+    /// @param [in] _directory where the binaries are kept, created when the first one is written
+    //----------------------------------------------------------------------------------------------------------------------
+    explicit ShaderCache(std::string_view _directory);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the program in ngl::ShaderLib from the cached binary, or from source (the binary is then stored)
+    /// @returns false if the sources couldn't be read or the program didn't link
+    //----------------------------------------------------------------------------------------------------------------------
+    bool build(const Program &_program);
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the source of each stage with the defines added
+    //----------------------------------------------------------------------------------------------------------------------
+    static bool readSources(const Program &_program, std::vector<std::string> &o_sources);
+    uint64_t key(const Program &_program, const std::vector<std::string> &_sources) const;
+    std::string fileName(const Program &_program) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the stored binary into _id if its key matches
+    /// @returns true if the program is linked
+    //----------------------------------------------------------------------------------------------------------------------
+    bool loadBinary(GLuint _id, const std::string &_file, uint64_t _key) const;
+    void storeBinary(GLuint _id, const std::string &_file, uint64_t _key) const;
+    bool compile(const Program &_program, const std::vector<std::string> &_sources);
+    std::string m_directory;
+    std::string m_driver;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief some drivers report no binary formats, then everything is compiled and nothing stored
+    //----------------------------------------------------------------------------------------------------------------------
+    bool m_supported = false;
+    std::unordered_set<std::string> m_compiledStages;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+};
+
+#endif
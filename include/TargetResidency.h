@@ -0,0 +1,99 @@
+#ifndef TARGETRESIDENCY_H_
+#define TARGETRESIDENCY_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file TargetResidency.h
+/// @brief decides which morph targets are in the GPU pool, this has no Qt / GL / NGL dependency
+/// @class TargetResidency
+/// @brief The pool is a fixed number of slots each holding one target's deltas, the number comes from the GPU budget.
+/// Each frame the targets that are needed (non zero weight) are requested and the ones about to be needed (clips
+/// that are about to start) are prefetched, update() then gives a slot to any that aren't resident by taking a free
+/// slot or evicting the least recently used target that isn't needed this frame. The caller copies the deltas in and
+/// remaps the target indices the shaders use through slot(). The host copies of the targets that have been streamed
+/// are tracked against a separate budget and the least recently used are handed back to be released.
+//----------------------------------------------------------------------------------------------------------------------
+class TargetResidency
+{
+  public:
+    static constexpr uint32_t c_notResident = 0xffffffff;
+    struct Stats
+    {
+      size_t hits = 0;          ///< requests for a target that was already resident
+      size_t misses = 0;        ///< requests that needed an upload
+      size_t prefetches = 0;    ///< uploads made ahead of a request
+      size_t evictions = 0;     ///< targets dropped from the GPU pool
+      size_t hostReleases = 0;  ///< host copies released to stay in the host budget
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a target to copy into the pool
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Upload
+    {
+      uint32_t target;
+      uint32_t slot;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief size the pool, every target starts out not resident
+    /// @param [in] _numTargets the number of targets
+    /// @param [in] _targetBytes the size of one target's deltas
+    /// @param [in] _gpuBudget the most the pool may use in bytes
+    /// @param [in] _hostBudget the most the streamed host copies may use in bytes
+    /// @param [in] _minSlots the pool is never smaller than this (the most targets that can be needed at once)
+    //----------------------------------------------------------------------------------------------------------------------
+    void create(size_t _numTargets, size_t _targetBytes, size_t _gpuBudget, size_t _hostBudget, size_t _minSlots);
+    size_t numSlots() const { return m_slotTarget.size(); }
+    size_t poolBytes() const { return numSlots() * m_targetBytes; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief mark a target as already in the next free slot (the initial fill) without counting it
+    /// @returns the slot or c_notResident if the pool is full
+    //----------------------------------------------------------------------------------------------------------------------
+    uint32_t preload(size_t _target);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a frame, the requests and prefetches of the last frame are forgotten
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the target is needed this frame, counts a hit or a miss
+    //----------------------------------------------------------------------------------------------------------------------
+    void request(size_t _target);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the target will be needed soon, it is uploaded if there is a slot that isn't needed this frame
+    //----------------------------------------------------------------------------------------------------------------------
+    void prefetch(size_t _target);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief give slots to this frame's misses then prefetches
+    /// @param [out] o_uploads the targets to copy into the pool
+    /// @param [out] o_released the targets whose host copy should be released
+    //----------------------------------------------------------------------------------------------------------------------
+    void update(std::vector<Upload> &o_uploads, std::vector<uint32_t> &o_released);
+    uint32_t slot(size_t _target) const { return m_targetSlot[_target]; }
+    const Stats &stats() const { return m_stats; }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a free slot or the least recently used one not needed this frame, c_notResident if there isn't one
+    //----------------------------------------------------------------------------------------------------------------------
+    uint32_t findSlot() const;
+    void touchHost(uint32_t _target, std::vector<uint32_t> &o_released);
+    size_t m_targetBytes = 0;
+    size_t m_hostLimit = 0;
+    uint64_t m_frame = 0;
+    std::vector<uint32_t> m_targetSlot;
+    std::vector<uint32_t> m_slotTarget;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the frame each target was last needed (or prefetched) and last streamed from the host
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<uint64_t> m_lastUsed;
+    std::vector<uint64_t> m_requested;
+    std::vector<uint64_t> m_hostUsed;
+    std::vector<char> m_onHost;
+    size_t m_hostCount = 0;
+    std::vector<uint32_t> m_misses;
+    std::vector<uint32_t> m_prefetches;
+    Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ThreadPool.h
+/// @brief a small work stealing thread pool for the CPU morph evaluation
+/// @class ThreadPool
+/// @brief run() splits a batch of task indices into contiguous runs, one per worker. Each worker pops from the front of
+/// its own queue (so neighbouring tasks, and their data, stay on one core) and when empty steals from the back of
+/// another worker's queue. The calling thread takes part as worker 0 so a pool of size 1 runs everything inline.
+//----------------------------------------------------------------------------------------------------------------------
+class ThreadPool
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the task function, called with the task index and the worker running it
+    //----------------------------------------------------------------------------------------------------------------------
+    using Task = std::function<void(size_t _task, size_t _worker)>;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor
+    /// @param [in] _numWorkers the number of workers including the calling thread, 0 uses all hardware threads
+    //----------------------------------------------------------------------------------------------------------------------
+    explicit ThreadPool(size_t _numWorkers = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    size_t numWorkers() const { return m_queues.size(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief run _numTasks tasks and wait for them all to finish
+    //----------------------------------------------------------------------------------------------------------------------
+    void run(size_t _numTasks, const Task &_task);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the number of tasks taken from another worker's queue since the pool was created
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t steals() const { return m_steals.load(); }
+
+  private:
+    struct Queue
+    {
+      std::mutex mutex;
+      std::deque<size_t> tasks;
+    };
+    void workerLoop(size_t _worker);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief run tasks from our queue then steal until there is nothing left
+    //----------------------------------------------------------------------------------------------------------------------
+    void drain(size_t _worker);
+    bool pop(size_t _worker, size_t &o_task);
+    bool steal(size_t _worker, size_t &o_task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const Task *m_task = nullptr;
+    size_t m_generation = 0;
+    size_t m_busy = 0;
+    std::atomic<size_t> m_remaining{0};
+    std::atomic<size_t> m_steals{0};
+    bool m_quit = false;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef UNIFORMRING_H_
+#define UNIFORMRING_H_
+#include <ngl/Types.h>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file UniformRing.h
+/// @brief a uniform buffer for constants that are re-written every frame (the transforms of each draw)
+/// @class UniformRing
+/// @brief The buffer is split into c_frames regions, each frame writes its blocks into the next region and binds
+/// them with glBindBufferRange so a draw costs an offset bind rather than a set of uniform calls. A fence is placed
+/// after the frame's draws and waited on before the region is written again, with three regions that only happens if
+/// the GPU falls two frames behind. On GL 4.4 the buffer is persistently mapped (coherent) and the blocks are written
+/// straight into it. Older contexts (macOS stops at 4.1) write to a staging copy and upload each block when it is bound.
+//----------------------------------------------------------------------------------------------------------------------
+class UniformRing
+{
+  public:
+    static constexpr size_t c_frames = 3;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a block allocated for this frame, write data then pass it to bind
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Block
+    {
+      void *data = nullptr;
+      size_t offset = 0;
+      size_t size = 0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the buffer, needs a current context
+    /// @param [in] _frameBytes the space for one frame's blocks
+    //----------------------------------------------------------------------------------------------------------------------
+    void create(size_t _frameBytes);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief move to the next region, waiting for the GPU to finish with it if it hasn't yet
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief space for one block, the offset is aligned for glBindBufferRange
+    /// @returns false if the region is full
+    //----------------------------------------------------------------------------------------------------------------------
+    bool allocate(size_t _size, Block &o_block);
+    void bind(GLuint _binding, const Block &_block);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief fence the region, call after the last draw that uses this frame's blocks
+    //----------------------------------------------------------------------------------------------------------------------
+    void endFrame();
+    bool persistent() const { return m_persistent; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the number of times beginFrame had to wait for the GPU
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t stalls() const { return m_stalls; }
+
+  private:
+    GLuint m_buffer = 0;
+    bool m_persistent = false;
+    unsigned char *m_mapped = nullptr;
+    std::vector<unsigned char> m_staging;
+    std::array<GLsync, c_frames> m_fences = {};
+    size_t m_frameBytes = 0;
+    size_t m_alignment = 256;
+    size_t m_region = 0;
+    size_t m_used = 0;
+    size_t m_stalls = 0;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef WEIGHTANIMATOR_H_
+#define WEIGHTANIMATOR_H_
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file WeightAnimator.h
+/// @brief keyframed morph weight animation
+/// @class WeightAnimator
+/// @brief Curves are piecewise linear keyframes shared by any number of clips. A clip plays one curve on one target
+/// of one channel (a character) from a start time, overlapping clips on the same weight are summed. evaluate() is a
+/// single pass over all the playing clips so hundreds of them cost one loop, and as the frame time only moves
+/// forward each clip keeps the key it is on rather than searching the curve every frame. The animator has no clock
+/// of its own, it is given the time so a fixed time step gives exactly the same weights every run.
+//----------------------------------------------------------------------------------------------------------------------
+class WeightAnimator
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one key, times are in seconds from the start of the clip
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Key
+    {
+      float time;
+      float value;
+    };
+    using CurveID = uint32_t;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add a curve
+    /// @param [in] _keys the keys in increasing time order, there must be at least one
+    /// @returns the id to play it with
+    //----------------------------------------------------------------------------------------------------------------------
+    CurveID addCurve(const std::vector<Key> &_keys);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the keys for a curve that rises from 0 to _peak over _rise seconds then falls back over _fall seconds
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::vector<Key> pulse(float _rise, float _fall, float _peak = 1.0f);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the time of the last key of a curve
+    //----------------------------------------------------------------------------------------------------------------------
+    float curveLength(CurveID _curve) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a clip
+    /// @param [in] _curve the curve to play
+    /// @param [in] _channel the character the clip is on
+    /// @param [in] _target the morph target it drives
+    /// @param [in] _start the time the clip starts
+    /// @param [in] _gain the curve values are scaled by this
+    //----------------------------------------------------------------------------------------------------------------------
+    void play(CurveID _curve, size_t _channel, size_t _target, double _start, float _gain = 1.0f);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief is a clip of _curve on this weight, either waiting to start or not yet finished at the last evaluate
+    //----------------------------------------------------------------------------------------------------------------------
+    bool playing(CurveID _curve, size_t _channel, size_t _target) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the targets of the clips that haven't started yet but will within _window seconds of _time
+    /// @param [out] o_targets the targets, one per clip so there may be repeats
+    //----------------------------------------------------------------------------------------------------------------------
+    void upcoming(double _time, double _window, std::vector<uint32_t> &o_targets) const;
+    size_t numClips() const { return m_clips.size(); }
+    bool active() const { return !m_clips.empty(); }
+    void clear() { m_clips.clear(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add every clip's value at _time into the weights, clips that have finished are removed after adding
+    /// their last key. _time should not go backwards between calls.
+    /// @param [in] _time the frame time
+    /// @param [in,out] io_weights the weights, target t of channel c is io_weights[c * _stride + t]
+    /// @param [in] _stride the number of weights per channel
+    //----------------------------------------------------------------------------------------------------------------------
+    void evaluate(double _time, float *io_weights, size_t _stride);
+
+  private:
+    struct Curve
+    {
+      uint32_t first;
+      uint32_t count;
+    };
+    struct Clip
+    {
+      double start;
+      float gain;
+      CurveID curve;
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief the key before the current time, so sampling is O(1) for a forward moving clock
+      //----------------------------------------------------------------------------------------------------------------------
+      uint32_t cursor;
+      uint32_t channel;
+      uint32_t target;
+    };
+    std::vector<Key> m_keys;
+    std::vector<Curve> m_curves;
+    std::vector<Clip> m_clips;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#version 330 core
+// instanced version of PerFragASDVert.glsl, every instance has its own transform and weights
+layout (location =0) in vec3 baseVert;
+layout (location =1) in vec3 baseNormal;
+
+// must match MorphTargetSet::c_maxActiveTargets
+#define MAX_TARGETS 64
+// the camera, the per instance model matrix is applied first (normalMatrix isn't used as the instances only
+// rotate and translate)
+layout (std140) uniform Transforms
+{
+	mat4 MVP;
+	mat4 MV;
+	mat3 normalMatrix;
+	// the slot of the first instance of this draw, the instances are packed sorted by level of detail
+	int firstInstance;
+};
+// the decode range for every target, delta = texel*scale+bias
+layout (std140) uniform MorphRanges
+{
+	vec4 posScale[MAX_TARGETS];
+	vec4 posBias[MAX_TARGETS];
+	vec4 normalScale[MAX_TARGETS];
+	vec4 normalBias[MAX_TARGETS];
+	// where each target is in the delta pool, -1 if it isn't resident
+	ivec4 targetSlot[MAX_TARGETS/4];
+};
+uniform int numTargets;
+uniform int numVerts;
+// texels per instance, the four model matrix columns then the weights packed four to a texel
+uniform int instanceStride;
+out vec3 position;
+out vec3 normal;
+uniform samplerBuffer TBO;
+uniform samplerBuffer instanceData;
+void main()
+{
+	int base=(firstInstance+gl_InstanceID)*instanceStride;
+	mat4 model=mat4(texelFetch(instanceData,base),texelFetch(instanceData,base+1),
+		texelFetch(instanceData,base+2),texelFetch(instanceData,base+3));
+	vec3 finalP=baseVert;
+	vec3 finalN=baseNormal;
+	// each instance has its own weights so there is no compacted list, zero weights are still skipped
+	for(int t=0; t<numTargets; ++t)
+	{
+		float w=texelFetch(instanceData,base+4+t/4)[t%4];
+		int slot=targetSlot[t/4][t%4];
+		if(w==0.0 || slot<0)
+			continue;
+		int offset=2*(slot*numVerts+gl_VertexID);
+		finalP+=w*(posScale[t].xyz*texelFetch(TBO,offset).xyz+posBias[t].xyz);
+		finalN+=w*(normalScale[t].xyz*texelFetch(TBO,offset+1).xyz+normalBias[t].xyz);
+	}
+	// the instance transforms are rotation and translation only so the upper 3x3 is the normal matrix
+	mat4 modelView=MV*model;
+	normal = normalize(mat3(modelView)*finalN);
+	position = vec3(modelView * vec4(finalP,1.0));
+	gl_Position = MVP*model*vec4(finalP,1.0);
+}
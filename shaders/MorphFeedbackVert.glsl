@@ -0,0 +1,40 @@
+#version 330 core
+// the blend from PerFragASDVert.glsl on its own, run once per vertex as points with transform feedback
+// capturing the result so every later pass can draw the morphed mesh as plain geometry
+layout (location =0) in vec3 baseVert;
+layout (location =1) in vec3 baseNormal;
+
+// must match MorphTargetSet::c_maxActiveTargets
+#define MAX_ACTIVE_TARGETS 64
+struct ActiveTarget
+{
+	vec4 posScale;
+	vec4 normalScale;
+};
+layout (std140) uniform MorphWeights
+{
+	int numActive;
+	int numVerts;
+	vec4 posBias;
+	vec4 normalBias;
+	ActiveTarget active[MAX_ACTIVE_TARGETS];
+};
+uniform samplerBuffer TBO;
+// captured interleaved so the buffer has the same layout as vertData
+out vec3 morphedPosition;
+out vec3 morphedNormal;
+void main()
+{
+	// drawn with glDrawArrays so gl_VertexID is the welded vertex
+	vec3 finalP=baseVert+posBias.xyz;
+	vec3 finalN=baseNormal+normalBias.xyz;
+	for(int i=0; i<numActive; ++i)
+	{
+		int target=int(active[i].posScale.w);
+		int offset=2*(target*numVerts+gl_VertexID);
+		finalP+=active[i].posScale.xyz*texelFetch(TBO,offset).xyz;
+		finalN+=active[i].normalScale.xyz*texelFetch(TBO,offset+1).xyz;
+	}
+	morphedPosition=finalP;
+	morphedNormal=normalize(finalN);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+// draws the output of the morph pre-pass, the blend is already done so this is just the transform
+layout (location =0) in vec3 morphedVert;
+layout (location =1) in vec3 morphedNormal;
+
+// the transforms for this draw, written to the uniform ring every frame (NGLScene::Transforms)
+layout (std140) uniform Transforms
+{
+	mat4 MVP;
+	mat4 MV;
+	mat3 normalMatrix;
+};
+out vec3 position;
+out vec3 normal;
+void main()
+{
+	normal = normalize( normalMatrix * morphedNormal);
+	position = vec3(MV * vec4(morphedVert,1.0));
+	gl_Position = MVP*vec4(morphedVert,1.0);
+}
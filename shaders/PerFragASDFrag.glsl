@@ -12,7 +12,6 @@ struct LightInfo
 	// Specular light intensity
 	vec3 Ls;
 };
-uniform LightInfo light;
 
 struct MaterialInfo
 {
@@ -25,8 +24,12 @@ struct MaterialInfo
 	// Specular shininess factor
 	float shininess;
 };
-
-uniform MaterialInfo material;
+// set once at startup, std140 so every vec3 starts on a vec4
+layout (std140) uniform Lighting
+{
+	LightInfo light;
+	MaterialInfo material;
+};
 
 
 
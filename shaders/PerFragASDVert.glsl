@@ -3,42 +3,54 @@
 layout (location =0) in vec3 baseVert;
 layout (location =1) in vec3 baseNormal;
 
-// transform matrix values
-uniform mat4 MVP;
-uniform mat3 normalMatrix;
-uniform mat4 MV;
-uniform float weight1;
-uniform float weight2;
+// must match MorphTargetSet::c_maxActiveTargets
+#define MAX_ACTIVE_TARGETS 64
+// the transforms for this draw, written to the uniform ring every frame (NGLScene::Transforms)
+layout (std140) uniform Transforms
+{
+	mat4 MVP;
+	mat4 MV;
+	mat3 normalMatrix;
+};
+// one active target, the weight is already folded into the scales, posScale.w is the target's slot in the delta pool
+struct ActiveTarget
+{
+	vec4 posScale;
+	vec4 normalScale;
+};
+// the compacted list of targets with a non zero weight, the TBO may be normalised so each delta is
+// decoded as texel*scale+bias and the bias for all the active targets is summed on the CPU
+layout (std140) uniform MorphWeights
+{
+	int numActive;
+	int numVerts;
+	vec4 posBias;
+	vec4 normalBias;
+	ActiveTarget active[MAX_ACTIVE_TARGETS];
+};
 out vec3 position;
 out vec3 normal;
 uniform samplerBuffer TBO;
 void main()
 {
-	// so the data is passed in a packed array, we have vec4's with
-	// vert1 vert2 normal1 normal2 so we offset vertex Id by 4 and then index in
-	// to get our correct value
-  vec3 poseVert1=texelFetch(TBO,int(4 *gl_VertexID)).xyz;
-  vec3 poseVert2=texelFetch(TBO,int(4*gl_VertexID+1)).xyz;
-  vec3 poseNormal1=texelFetch(TBO,int(4*gl_VertexID+2)).xyz;
-  vec3 poseNormal2=texelFetch(TBO,int(4*gl_VertexID+3)).xyz;
-
-	vec3  finalN=baseNormal+(weight1*poseNormal1)+(weight2*poseNormal2);
+	// so the data is passed in a packed array, each target has a block of numVerts pairs
+	// of position delta / normal delta. The mesh is drawn indexed so gl_VertexID is the
+	// welded vertex not the triangle corner
+	vec3 finalP=baseVert+posBias.xyz;
+	vec3 finalN=baseNormal+normalBias.xyz;
+	// only the active targets are visited so the cost scales with those not the total
+	for(int i=0; i<numActive; ++i)
+	{
+		int target=int(active[i].posScale.w);
+		int offset=2*(target*numVerts+gl_VertexID);
+		finalP+=active[i].posScale.xyz*texelFetch(TBO,offset).xyz;
+		finalN+=active[i].normalScale.xyz*texelFetch(TBO,offset+1).xyz;
+	}
 	// then normalize and mult by normal matrix for shading
 	normal = normalize( normalMatrix * finalN);
 	// now calculate the eye cord position for the frag stage
-	position = vec3(MV * vec4(baseVert,1.0));
-	// now calculated the weighted vertices and add to the base mesh
-	vec3  finalP=baseVert+(weight1*poseVert1)+(weight2*poseVert2);
+	position = vec3(MV * vec4(finalP,1.0));
 	// Convert position to clip coordinates and pass along
 	gl_Position = MVP*vec4(finalP,1.0);
 
 }
-
-
-
-
-
-
-
-
-
@@ -0,0 +1,189 @@
+#include "AnimationBaker.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+AnimationBaker::AnimationBaker(const MorphEngine &_engine, ThreadPool &_pool) : m_engine(_engine), m_pool(_pool)
+{
+}
+
+bool AnimationBaker::bake(const std::string &_file, size_t _numFrames, float _fps, const Timeline &_timeline,
+                          const AnimationCache::Options &_options)
+{
+  m_stats = Stats();
+  auto start = std::chrono::steady_clock::now();
+  auto numVerts = m_engine.numVerts();
+  auto numTargets = m_engine.numTargets();
+  auto floats = numVerts * AnimationCache::c_components;
+  size_t framesPerChunk = std::max<uint32_t>(_options.framesPerChunk, 1);
+  auto numChunks = (_numFrames + framesPerChunk - 1) / framesPerChunk;
+  auto numWorkers = m_pool.numWorkers();
+  if (numVerts == 0 || _numFrames == 0)
+    return false;
+
+#if !defined(_WIN32)
+  auto tmpFile = _file + ".tmp" + std::to_string(getpid());
+#else
+  auto tmpFile = _file + ".tmp";
+#endif
+  std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+  {
+    std::cerr << "Unable to write baked animation " << tmpFile << '\n';
+    return false;
+  }
+  // the header is written again at the end once the offsets are known
+  AnimationCache::Header header = {};
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  // the writer appends blocks in the order they are queued, the first is the reference frame then every chunk
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::condition_variable written;
+  std::deque<std::vector<uint8_t>> queue;
+  size_t queuedBytes = 0;
+  bool finished = false;
+  std::vector<AnimationCache::ChunkRecord> blocks;
+  uint64_t offset = sizeof(header);
+  std::thread writer(
+      [&]
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+          queued.wait(lock, [&] { return finished || !queue.empty(); });
+          if (queue.empty())
+            return;
+          auto block = std::move(queue.front());
+          queue.pop_front();
+          lock.unlock();
+          out.write(reinterpret_cast<const char *>(block.data()), static_cast<std::streamsize>(block.size()));
+          blocks.push_back({offset, block.size()});
+          offset += block.size();
+          lock.lock();
+          queuedBytes -= block.size();
+          written.notify_one();
+        }
+      });
+  auto push = [&](std::vector<uint8_t> &&_block)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    // this is the back pressure, the encoders wait here once the writer is c_maxQueuedBatches behind
+    written.wait(lock, [&] { return queue.size() < c_maxQueuedBatches * numWorkers; });
+    queuedBytes += _block.size();
+    m_stats.peakQueuedBytes = std::max(m_stats.peakQueuedBytes, queuedBytes);
+    queue.push_back(std::move(_block));
+    queued.notify_one();
+  };
+
+  // each worker blends into its own result and keeps the quantised frame before the one it is encoding
+  std::vector<MorphEngine::Result> results;
+  std::vector<std::vector<float>> frames(numWorkers, std::vector<float>(floats));
+  std::vector<std::vector<int32_t>> current(numWorkers, std::vector<int32_t>(floats));
+  std::vector<std::vector<int32_t>> previous(numWorkers, std::vector<int32_t>(floats));
+  for (size_t w = 0; w < numWorkers; ++w)
+    results.push_back(m_engine.createResult());
+  auto framesPerBatch = framesPerChunk * numWorkers;
+  std::vector<float> weights(framesPerBatch * std::max<size_t>(numTargets, 1));
+  std::vector<std::vector<uint8_t>> chunks(numWorkers);
+  std::vector<int32_t> reference(floats);
+
+  for (size_t firstChunk = 0; firstChunk < numChunks; firstChunk += numWorkers)
+  {
+    auto firstFrame = firstChunk * framesPerChunk;
+    auto lastFrame = std::min(_numFrames, firstFrame + framesPerBatch);
+    for (auto f = firstFrame; f < lastFrame; ++f)
+      _timeline(f, &weights[(f - firstFrame) * numTargets]);
+    if (firstChunk == 0)
+    {
+      // the first frame is the reference every chunk starts from
+      m_engine.evaluate(weights.data(), results[0]);
+      results[0].interleave(frames[0].data(), 0, numVerts);
+      AnimationCache::quantise(frames[0].data(), numVerts, _options, reference.data());
+      std::vector<uint8_t> block;
+      AnimationCache::encodeFrame(reference.data(), nullptr, numVerts, block);
+      push(std::move(block));
+    }
+    auto batchChunks = std::min(numWorkers, numChunks - firstChunk);
+    m_pool.run(batchChunks,
+               [&](size_t _task, size_t _worker)
+               {
+                 auto &data = chunks[_task];
+                 data.clear();
+                 auto first = (firstChunk + _task) * framesPerChunk;
+                 auto last = std::min(_numFrames, first + framesPerChunk);
+                 for (auto f = first; f < last; ++f)
+                 {
+                   m_engine.evaluate(&weights[(f - firstFrame) * numTargets], results[_worker]);
+                   results[_worker].interleave(frames[_worker].data(), 0, numVerts);
+                   AnimationCache::quantise(frames[_worker].data(), numVerts, _options, current[_worker].data());
+                   AnimationCache::encodeFrame(current[_worker].data(), f == first ? reference.data() : previous[_worker].data(), numVerts, data);
+                   current[_worker].swap(previous[_worker]);
+                 }
+               });
+    for (size_t c = 0; c < batchChunks; ++c)
+    {
+      // the next batch starts its buffer at this chunk's size so it rarely has to grow
+      std::vector<uint8_t> next;
+      next.reserve(chunks[c].size());
+      push(std::move(chunks[c]));
+      chunks[c] = std::move(next);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+  }
+  queued.notify_one();
+  writer.join();
+
+  std::memcpy(header.magic, AnimationCache::c_magic, sizeof(header.magic));
+  header.version = AnimationCache::c_version;
+  header.numVerts = static_cast<uint32_t>(numVerts);
+  header.numFrames = static_cast<uint32_t>(_numFrames);
+  header.framesPerChunk = static_cast<uint32_t>(framesPerChunk);
+  header.numChunks = static_cast<uint32_t>(numChunks);
+  header.fps = _fps;
+  header.positionStep = _options.positionStep;
+  header.normalStep = _options.normalStep;
+  header.referenceOffset = blocks[0].offset;
+  header.referenceSize = blocks[0].size;
+  header.indexOffset = offset;
+  out.write(reinterpret_cast<const char *>(&blocks[1]), static_cast<std::streamsize>(numChunks * sizeof(AnimationCache::ChunkRecord)));
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.close();
+  std::error_code ec;
+  if (!out)
+  {
+    std::cerr << "Error writing baked animation " << tmpFile << '\n';
+    std::filesystem::remove(tmpFile, ec);
+    return false;
+  }
+  std::filesystem::rename(tmpFile, _file, ec);
+  if (ec)
+  {
+    std::cerr << "Unable to rename baked animation " << ec.message() << '\n';
+    std::filesystem::remove(tmpFile, ec);
+    return false;
+  }
+
+  m_stats.frames = _numFrames;
+  m_stats.rawBytes = _numFrames * floats * sizeof(float);
+  m_stats.fileBytes = static_cast<size_t>(offset + numChunks * sizeof(AnimationCache::ChunkRecord));
+  m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Baked " << _numFrames << " frames of " << numVerts << " vertices to " << _file << ", " << m_stats.rawBytes << " bytes -> "
+            << m_stats.fileBytes << " bytes in " << m_stats.seconds << "s (" << _numFrames / _fps / m_stats.seconds << "x real time)\n";
+  return true;
+}
@@ -0,0 +1,248 @@
+#include "AnimationCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+// quantised values are kept inside this so the deltas between any two of them still fit 32 bits
+constexpr float c_quantisedLimit = 1.0e9f;
+// a varint of a 64 bit value is never longer than this
+constexpr size_t c_maxVarintBytes = 10;
+
+void putVarint(uint64_t _v, std::vector<uint8_t> &io_data)
+{
+  while (_v >= 0x80)
+  {
+    io_data.push_back(static_cast<uint8_t>(_v | 0x80));
+    _v >>= 7;
+  }
+  io_data.push_back(static_cast<uint8_t>(_v));
+}
+
+// is [_offset, _offset + _size) inside a file of _fileSize bytes, written so a corrupt offset or size can't wrap
+bool inFile(uint64_t _offset, uint64_t _size, uint64_t _fileSize)
+{
+  return _size <= _fileSize && _offset <= _fileSize - _size;
+}
+
+const uint8_t *getVarint(const uint8_t *_data, const uint8_t *_end, uint64_t &o_v)
+{
+  o_v = 0;
+  for (size_t i = 0; i < c_maxVarintBytes && _data < _end; ++i)
+  {
+    auto byte = *_data++;
+    o_v |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+    if ((byte & 0x80) == 0)
+      return _data;
+  }
+  return nullptr;
+}
+
+#if defined(_WIN32)
+bool readFile(const std::string &_path, std::vector<uint8_t> &o_data)
+{
+  std::ifstream in(_path, std::ios::binary | std::ios::ate);
+  if (!in.is_open())
+    return false;
+  auto size = static_cast<size_t>(in.tellg());
+  o_data.resize(size);
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(o_data.data()), static_cast<std::streamsize>(size));
+  return static_cast<bool>(in);
+}
+#endif
+} // end anon namespace
+
+AnimationCache::~AnimationCache()
+{
+  close();
+}
+
+void AnimationCache::quantise(const float *_frame, size_t _numVerts, const Options &_options, int32_t *o_quantised)
+{
+  float scale[c_components];
+  for (size_t c = 0; c < c_components; ++c)
+    scale[c] = 1.0f / (c < 3 ? _options.positionStep : _options.normalStep);
+  for (size_t i = 0; i < _numVerts * c_components; ++i)
+  {
+    auto q = std::clamp(_frame[i] * scale[i % c_components], -c_quantisedLimit, c_quantisedLimit);
+    o_quantised[i] = static_cast<int32_t>(std::lround(q));
+  }
+}
+
+void AnimationCache::encodeFrame(const int32_t *_frame, const int32_t *_previous, size_t _numVerts, std::vector<uint8_t> &io_data)
+{
+  // a zero run is the count shifted up with the low bit set, anything else is the zigzagged delta shifted up
+  auto count = _numVerts * c_components;
+  uint64_t zeros = 0;
+  for (size_t i = 0; i < count; ++i)
+  {
+    auto delta = _frame[i] - (_previous != nullptr ? _previous[i] : 0);
+    if (delta == 0)
+    {
+      ++zeros;
+      continue;
+    }
+    if (zeros > 0)
+    {
+      putVarint((zeros << 1) | 1, io_data);
+      zeros = 0;
+    }
+    auto zigzag = static_cast<uint64_t>((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+    putVarint(zigzag << 1, io_data);
+  }
+  if (zeros > 0)
+    putVarint((zeros << 1) | 1, io_data);
+}
+
+const uint8_t *AnimationCache::decodeFrame(const uint8_t *_data, const uint8_t *_end, int32_t *io_frame) const
+{
+  auto count = static_cast<size_t>(m_header.numVerts) * c_components;
+  size_t i = 0;
+  while (i < count)
+  {
+    uint64_t v;
+    _data = getVarint(_data, _end, v);
+    if (_data == nullptr)
+      return nullptr;
+    if (v & 1)
+    {
+      auto zeros = v >> 1;
+      if (zeros > count - i)
+        return nullptr;
+      i += static_cast<size_t>(zeros);
+      continue;
+    }
+    auto zigzag = static_cast<uint32_t>(v >> 1);
+    auto delta = static_cast<int32_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+    // wraps rather than overflows on a corrupt file
+    io_frame[i] = static_cast<int32_t>(static_cast<uint32_t>(io_frame[i]) + static_cast<uint32_t>(delta));
+    ++i;
+  }
+  return _data;
+}
+
+void AnimationCache::close()
+{
+#if !defined(_WIN32)
+  if (m_mapped && m_data != nullptr)
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+  m_fallback.clear();
+  m_data = nullptr;
+  m_size = 0;
+  m_mapped = false;
+  m_header = {};
+  m_chunks.clear();
+  m_reference.clear();
+  m_current.clear();
+  m_currentFrame = ~size_t(0);
+  m_cursor = nullptr;
+}
+
+bool AnimationCache::open(const std::string &_file)
+{
+  close();
+#if !defined(_WIN32)
+  int fd = ::open(_file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  m_size = static_cast<size_t>(st.st_size);
+  void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  ::close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    m_size = 0;
+    return false;
+  }
+  m_data = static_cast<const uint8_t *>(ptr);
+  m_mapped = true;
+#else
+  if (!readFile(_file, m_fallback))
+    return false;
+  m_data = m_fallback.data();
+  m_size = m_fallback.size();
+#endif
+  if (!validate())
+  {
+    std::cerr << "Baked animation " << _file << " is not readable\n";
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool AnimationCache::validate()
+{
+  if (m_size < sizeof(Header))
+    return false;
+  std::memcpy(&m_header, m_data, sizeof(Header));
+  if (std::memcmp(m_header.magic, c_magic, sizeof(c_magic)) != 0 || m_header.version != c_version)
+    return false;
+  // in 64 bits so a frame count near the 32 bit limit can't wrap to a small chunk count
+  if (m_header.numVerts == 0 || m_header.framesPerChunk == 0 ||
+      m_header.numChunks != (static_cast<uint64_t>(m_header.numFrames) + m_header.framesPerChunk - 1) / m_header.framesPerChunk)
+    return false;
+  if (!inFile(m_header.referenceOffset, m_header.referenceSize, m_size) ||
+      !inFile(m_header.indexOffset, static_cast<uint64_t>(m_header.numChunks) * sizeof(ChunkRecord), m_size))
+    return false;
+  m_chunks.resize(m_header.numChunks);
+  if (!m_chunks.empty())
+    std::memcpy(m_chunks.data(), m_data + m_header.indexOffset, m_chunks.size() * sizeof(ChunkRecord));
+  for (auto &chunk : m_chunks)
+  {
+    if (!inFile(chunk.offset, chunk.size, m_size))
+      return false;
+  }
+  m_reference.assign(m_header.numVerts * c_components, 0);
+  auto *reference = m_data + m_header.referenceOffset;
+  return decodeFrame(reference, reference + m_header.referenceSize, m_reference.data()) != nullptr;
+}
+
+bool AnimationCache::frame(size_t _frame, float *o_frame)
+{
+  if (_frame >= m_header.numFrames)
+    return false;
+  auto chunk = _frame / m_header.framesPerChunk;
+  auto first = chunk * m_header.framesPerChunk;
+  auto *end = m_data + m_chunks[chunk].offset + m_chunks[chunk].size;
+  // carry on from the last frame if it is earlier in the same chunk, otherwise start the chunk from the reference
+  if (m_currentFrame == ~size_t(0) || m_currentFrame / m_header.framesPerChunk != chunk || m_currentFrame > _frame)
+  {
+    m_current = m_reference;
+    m_cursor = decodeFrame(m_data + m_chunks[chunk].offset, end, m_current.data());
+    m_currentFrame = first;
+  }
+  while (m_cursor != nullptr && m_currentFrame < _frame)
+  {
+    m_cursor = decodeFrame(m_cursor, end, m_current.data());
+    ++m_currentFrame;
+  }
+  if (m_cursor == nullptr)
+  {
+    m_currentFrame = ~size_t(0);
+    return false;
+  }
+  float step[c_components];
+  for (size_t c = 0; c < c_components; ++c)
+    step[c] = c < 3 ? m_header.positionStep : m_header.normalStep;
+  for (size_t i = 0; i < m_current.size(); ++i)
+    o_frame[i] = m_current[i] * step[i % c_components];
+  return true;
+}
@@ -0,0 +1,136 @@
+// Bakes the blend of a character throwing random punches (the same timeline one crowd member plays) into a chunked
+// AnimationCache file for tools that want per frame geometry, then reads it back to report the error against the
+// engine (failing if any value is more than half a quantisation step out) and how fast frames can be played and sought.
+// usage : MorphBake [--output file] [--seconds s] [--fps n] [--chunk frames] [--step units] [--threads n] [pose files...]
+#include "AnimationBaker.h"
+#include "AnimationCache.h"
+#include "MorphEngine.h"
+#include "MorphTargetSet.h"
+#include "PunchTimeline.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // every this many frames is kept to check against the engine after the bake
+  constexpr size_t c_checkInterval = 97;
+  constexpr size_t c_randomSeeks = 200;
+} // end anonymous namespace
+
+int main(int argc, char **argv)
+{
+  std::string output = "morph_bake.mbak";
+  double seconds = 60.0;
+  float fps = 30.0f;
+  size_t threads = 0;
+  AnimationCache::Options options;
+  std::vector<std::string> poses;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--output" && i + 1 < argc)
+      output = argv[++i];
+    else if (arg == "--seconds" && i + 1 < argc)
+      seconds = std::max(0.0, std::strtod(argv[++i], nullptr));
+    else if (arg == "--fps" && i + 1 < argc)
+      fps = std::max(1.0f, std::strtof(argv[++i], nullptr));
+    else if (arg == "--chunk" && i + 1 < argc)
+      options.framesPerChunk = static_cast<uint32_t>(std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10)));
+    else if (arg == "--step" && i + 1 < argc)
+      options.positionStep = std::max(1e-7f, std::strtof(argv[++i], nullptr));
+    else if (arg == "--threads" && i + 1 < argc)
+      threads = std::strtoul(argv[++i], nullptr, 10);
+    else
+      poses.push_back(arg);
+  }
+  if (poses.empty())
+    poses = MorphTargetSet::defaultPoseFiles();
+
+  MorphTargetSet morph;
+  if (!morph.load(poses, MorphTargetSet::cacheFileName(poses)))
+  {
+    std::cerr << "unable to load the pose files\n";
+    return EXIT_FAILURE;
+  }
+  MorphEngine engine;
+  morph.loadEngine(engine);
+
+  // one crowd member's random punches stepped at the frame rate, a few frames are kept to check the file against
+  auto numTargets = engine.numTargets();
+  PunchTimeline character;
+  character.create(1, numTargets);
+  std::vector<std::pair<size_t, std::vector<float>>> checks;
+  auto timeline = [&](size_t _frame, float *o_weights)
+  {
+    character.update(_frame / static_cast<double>(fps), 1.0 / fps);
+    for (size_t t = 0; t < numTargets; ++t)
+      o_weights[t] = character.weight(0, t);
+    if (_frame % c_checkInterval == 0)
+      checks.push_back({_frame, std::vector<float>(o_weights, o_weights + numTargets)});
+  };
+  auto numFrames = static_cast<size_t>(std::ceil(seconds * fps));
+  ThreadPool pool(threads);
+  AnimationBaker baker(engine, pool);
+  if (!baker.bake(output, numFrames, fps, timeline, options))
+    return EXIT_FAILURE;
+  auto &stats = baker.stats();
+  std::cout << numFrames << " frames (" << numFrames / fps << "s) on " << pool.numWorkers() << " workers in " << stats.seconds << "s, "
+            << numFrames / stats.seconds << " frames/s, compressed " << static_cast<double>(stats.rawBytes) / stats.fileBytes
+            << ":1, at most " << stats.peakQueuedBytes << " bytes waiting to be written\n";
+
+  AnimationCache cache;
+  if (!cache.open(output))
+    return EXIT_FAILURE;
+  std::vector<float> frame(cache.numVerts() * AnimationCache::c_components);
+  std::vector<float> expected(frame.size());
+  auto result = engine.createResult();
+  float positionError = 0.0f;
+  float normalError = 0.0f;
+  size_t outOfStep = 0;
+  for (auto &check : checks)
+  {
+    engine.evaluate(check.second.data(), result);
+    result.interleave(expected.data(), 0, engine.numVerts());
+    if (!cache.frame(check.first, frame.data()))
+      return EXIT_FAILURE;
+    for (size_t i = 0; i < frame.size(); ++i)
+    {
+      auto isPosition = i % AnimationCache::c_components < 3;
+      auto &error = isPosition ? positionError : normalError;
+      auto difference = std::abs(frame[i] - expected[i]);
+      error = std::max(error, difference);
+      // rounding to the nearest step is never more than half a step out, plus the rounding of the floats themselves
+      auto step = isPosition ? options.positionStep : options.normalStep;
+      if (difference > 0.5f * step + 2.0f * std::numeric_limits<float>::epsilon() * std::abs(expected[i]))
+        ++outOfStep;
+    }
+  }
+  std::cout << "Largest error against the engine, position " << positionError << " normal " << normalError << '\n';
+  if (outOfStep > 0)
+  {
+    std::cerr << outOfStep << " values read back are more than half a step from the engine\n";
+    return EXIT_FAILURE;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t f = 0; f < cache.numFrames(); ++f)
+    cache.frame(f, frame.data());
+  std::chrono::duration<double> playback = std::chrono::steady_clock::now() - start;
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<size_t> pick(0, cache.numFrames() - 1);
+  start = std::chrono::steady_clock::now();
+  for (size_t s = 0; s < c_randomSeeks; ++s)
+    cache.frame(pick(rng), frame.data());
+  std::chrono::duration<double> seeks = std::chrono::steady_clock::now() - start;
+  std::cout << "Read back " << cache.numFrames() / playback.count() << " frames/s in order, " << c_randomSeeks / seeks.count()
+            << " random seeks/s\n";
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+// Scaling benchmark for the crowd evaluator, blends the same rig for many characters with random weights on
+// 1..N worker threads and reports characters per second for each.
+// usage : MorphCrowdBenchmark [--characters n] [--repeats n] [--threads n] [pose files...]
+#include "MorphCrowd.h"
+#include "MorphEngine.h"
+#include "MorphTargetSet.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  size_t characters = 1000;
+  size_t repeats = 10;
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::string> poses;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--characters" && i + 1 < argc)
+      characters = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--repeats" && i + 1 < argc)
+      repeats = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--threads" && i + 1 < argc)
+      maxThreads = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    else
+      poses.push_back(arg);
+  }
+  if (poses.empty())
+    poses = MorphTargetSet::defaultPoseFiles();
+
+  MorphTargetSet morph;
+  if (!morph.load(poses, MorphTargetSet::cacheFileName(poses)))
+  {
+    std::cerr << "unable to load the pose files\n";
+    return EXIT_FAILURE;
+  }
+  MorphEngine engine;
+  morph.loadEngine(engine);
+
+  // the same random weights for every run so the thread counts are comparable
+  auto numTargets = engine.numTargets();
+  std::vector<float> weights(characters * numTargets);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  std::generate(weights.begin(), weights.end(), [&] { return dist(rng); });
+
+  std::cout << characters << " characters, " << engine.numVerts() << " vertices, " << numTargets << " targets, "
+            << MorphEngine::kernelName(engine.kernel()) << " kernels\n";
+  std::cout << "threads  chars/sec      ms/batch  speedup  steals\n";
+  std::vector<MorphEngine::Result> results;
+  double single = 0.0;
+  for (size_t threads = 1; threads <= maxThreads; ++threads)
+  {
+    ThreadPool pool(threads);
+    MorphCrowd crowd(engine, pool);
+    // warm up, this also allocates the results
+    crowd.evaluate(weights.data(), characters, numTargets, results);
+    auto steals = pool.steals();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; ++r)
+    {
+      crowd.evaluate(weights.data(), characters, numTargets, results);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double perSecond = characters * repeats / elapsed.count();
+    if (threads == 1)
+      single = perSecond;
+    std::cout << std::setw(7) << threads << std::setw(11) << std::fixed << std::setprecision(0) << perSecond << std::setw(14)
+              << std::setprecision(3) << elapsed.count() * 1000.0 / repeats << std::setw(9) << std::setprecision(2) << perSecond / single
+              << std::setw(8) << (pool.steals() - steals) / repeats << '\n';
+  }
+  return EXIT_SUCCESS;
+}
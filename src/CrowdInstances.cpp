@@ -0,0 +1,52 @@
+#include "CrowdInstances.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+void CrowdInstances::create(size_t _count, size_t _numTargets, ngl::Real _spacing, uint32_t _seed)
+{
+  m_transforms.resize(_count);
+  // the facing has a generator of its own so the punches are the same as a PunchTimeline with this seed
+  m_timeline.create(_count, _numTargets, _seed);
+  std::mt19937 rng(_seed + 1);
+  // a square grid centred on x, rows going away from the camera with the first row at the origin
+  auto columns = static_cast<size_t>(std::ceil(std::sqrt(static_cast<ngl::Real>(_count))));
+  std::uniform_real_distribution<ngl::Real> facing(-30.0f, 30.0f);
+  for (size_t i = 0; i < _count; ++i)
+  {
+    auto column = static_cast<ngl::Real>(i % columns);
+    auto row = static_cast<ngl::Real>(i / columns);
+    auto tx = ngl::Mat4::rotateY(facing(rng));
+    tx.m_m[3][0] = (column - 0.5f * (columns - 1)) * _spacing;
+    tx.m_m[3][2] = -row * _spacing;
+    m_transforms[i] = tx;
+  }
+}
+
+void CrowdInstances::pack(std::vector<GLfloat> &o_data) const
+{
+  std::vector<uint32_t> order(size());
+  for (size_t i = 0; i < size(); ++i)
+  {
+    order[i] = static_cast<uint32_t>(i);
+  }
+  pack(o_data, order);
+}
+
+void CrowdInstances::pack(std::vector<GLfloat> &o_data, const std::vector<uint32_t> &_order) const
+{
+  auto floats = texelsPerInstance() * 4;
+  o_data.assign(_order.size() * floats, 0.0f);
+  for (size_t slot = 0; slot < _order.size(); ++slot)
+  {
+    auto i = _order[slot];
+    auto *dst = &o_data[slot * floats];
+    // ngl::Mat4 is column major so the 16 floats are the four column texels
+    std::copy(m_transforms[i].m_openGL, m_transforms[i].m_openGL + 16, dst);
+    auto *weights = m_timeline.weights(i);
+    if (m_basis)
+      m_basis->fold(weights, dst + 16);
+    else
+      std::copy(weights, weights + numTargets(), dst + 16);
+  }
+}
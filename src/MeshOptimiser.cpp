@@ -0,0 +1,189 @@
+#include "MeshOptimiser.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// the LRU cache the scores model, larger than the real FIFO so the order isn't tuned to one cache size
+constexpr size_t c_scoreCacheSize = 32;
+constexpr float c_cacheDecayPower = 1.5f;
+// the three vertices of the last triangle get a fixed score so the next one doesn't just reuse the same edge
+constexpr float c_lastTriangleScore = 0.75f;
+// vertices with few triangles left are boosted so they get finished rather than left as stragglers
+constexpr float c_valenceBoostScale = 2.0f;
+constexpr float c_valenceBoostPower = 0.5f;
+
+float vertexScore(int _cachePosition, uint32_t _remaining)
+{
+  if (_remaining == 0)
+    return -1.0f;
+  float score = 0.0f;
+  if (_cachePosition >= 0)
+  {
+    if (_cachePosition < 3)
+      score = c_lastTriangleScore;
+    else
+    {
+      auto scale = 1.0f / (c_scoreCacheSize - 3);
+      score = std::pow(1.0f - (_cachePosition - 3) * scale, c_cacheDecayPower);
+    }
+  }
+  return score + c_valenceBoostScale * std::pow(static_cast<float>(_remaining), -c_valenceBoostPower);
+}
+
+// false for a corner that repeats an earlier one, a degenerate triangle is only listed once around each of its vertices
+bool firstUse(const uint32_t *_tri, size_t _k)
+{
+  return _k == 0 || (_tri[_k] != _tri[0] && (_k == 1 || _tri[_k] != _tri[1]));
+}
+} // end anon namespace
+
+void MeshOptimiser::optimiseVertexCache(uint32_t *io_indices, size_t _numIndices, size_t _numVerts)
+{
+  auto numTris = _numIndices / 3;
+  if (numTris == 0)
+    return;
+  // the triangles still to be drawn around each vertex, the used ones are swapped past the end of the range
+  std::vector<uint32_t> triOffsets(_numVerts + 1, 0);
+  for (size_t i = 0; i < numTris * 3; ++i)
+  {
+    if (firstUse(&io_indices[i - i % 3], i % 3))
+      ++triOffsets[io_indices[i] + 1];
+  }
+  for (size_t v = 0; v < _numVerts; ++v)
+    triOffsets[v + 1] += triOffsets[v];
+  std::vector<uint32_t> vertTris(triOffsets[_numVerts]);
+  std::vector<uint32_t> remaining(_numVerts, 0);
+  for (size_t i = 0; i < numTris * 3; ++i)
+  {
+    auto v = io_indices[i];
+    if (firstUse(&io_indices[i - i % 3], i % 3))
+      vertTris[triOffsets[v] + remaining[v]++] = static_cast<uint32_t>(i / 3);
+  }
+  std::vector<int> cachePosition(_numVerts, -1);
+  std::vector<float> score(_numVerts);
+  for (size_t v = 0; v < _numVerts; ++v)
+    score[v] = vertexScore(-1, remaining[v]);
+  std::vector<float> triScore(numTris);
+  for (size_t t = 0; t < numTris; ++t)
+    triScore[t] = score[io_indices[t * 3]] + score[io_indices[t * 3 + 1]] + score[io_indices[t * 3 + 2]];
+  std::vector<char> added(numTris, 0);
+
+  std::vector<uint32_t> out;
+  out.reserve(numTris * 3);
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> newCache;
+  size_t scan = 0;
+  uint32_t best = 0;
+  float bestScore = triScore[0];
+  for (size_t t = 1; t < numTris; ++t)
+  {
+    if (triScore[t] > bestScore)
+    {
+      bestScore = triScore[t];
+      best = static_cast<uint32_t>(t);
+    }
+  }
+  for (size_t drawn = 0; drawn < numTris; ++drawn)
+  {
+    added[best] = 1;
+    auto *tri = &io_indices[best * 3];
+    out.insert(out.end(), tri, tri + 3);
+    newCache.clear();
+    for (size_t k = 0; k < 3; ++k)
+    {
+      if (!firstUse(tri, k))
+        continue;
+      auto v = tri[k];
+      auto *first = &vertTris[triOffsets[v]];
+      auto *last = first + remaining[v];
+      std::iter_swap(std::find(first, last, best), last - 1);
+      --remaining[v];
+      newCache.push_back(v);
+    }
+    // the triangle's vertices go to the front of the cache, whatever falls off the end loses its cache score
+    for (auto v : cache)
+    {
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        newCache.push_back(v);
+    }
+    for (size_t c = 0; c < newCache.size(); ++c)
+    {
+      auto v = newCache[c];
+      cachePosition[v] = c < c_scoreCacheSize ? static_cast<int>(c) : -1;
+      score[v] = vertexScore(cachePosition[v], remaining[v]);
+    }
+    // the next triangle is the best one around a vertex in the cache, their scores are the only ones that changed
+    best = static_cast<uint32_t>(numTris);
+    bestScore = -1.0f;
+    for (auto v : newCache)
+    {
+      for (auto i = triOffsets[v]; i < triOffsets[v] + remaining[v]; ++i)
+      {
+        auto t = vertTris[i];
+        auto *corners = &io_indices[t * 3];
+        triScore[t] = score[corners[0]] + score[corners[1]] + score[corners[2]];
+        if (triScore[t] > bestScore)
+        {
+          bestScore = triScore[t];
+          best = t;
+        }
+      }
+    }
+    newCache.resize(std::min(newCache.size(), c_scoreCacheSize));
+    cache.swap(newCache);
+    if (best == numTris && drawn + 1 < numTris)
+    {
+      // nothing left around the cache, start again from the next triangle not yet drawn
+      while (added[scan])
+        ++scan;
+      best = static_cast<uint32_t>(scan);
+    }
+  }
+  std::copy(out.begin(), out.end(), io_indices);
+}
+
+std::vector<uint32_t> MeshOptimiser::fetchRemap(const uint32_t *_indices, size_t _numIndices, size_t _numVerts)
+{
+  constexpr uint32_t unused = ~uint32_t(0);
+  std::vector<uint32_t> remap(_numVerts, unused);
+  uint32_t next = 0;
+  for (size_t i = 0; i < _numIndices; ++i)
+  {
+    if (remap[_indices[i]] == unused)
+      remap[_indices[i]] = next++;
+  }
+  for (auto &r : remap)
+  {
+    if (r == unused)
+      r = next++;
+  }
+  return remap;
+}
+
+MeshOptimiser::CacheStats MeshOptimiser::simulate(const uint32_t *_indices, size_t _numIndices, size_t _numVerts, size_t _cacheSize)
+{
+  CacheStats stats;
+  if (_numIndices < 3 || _cacheSize == 0)
+    return stats;
+  // a vertex is in the FIFO if it was added within the last _cacheSize misses
+  std::vector<size_t> insertedAt(_numVerts, 0);
+  std::vector<char> used(_numVerts, 0);
+  size_t misses = 0;
+  size_t numUsed = 0;
+  for (size_t i = 0; i < _numIndices; ++i)
+  {
+    auto v = _indices[i];
+    if (!used[v])
+    {
+      used[v] = 1;
+      ++numUsed;
+    }
+    else if (misses - insertedAt[v] <= _cacheSize)
+      continue;
+    insertedAt[v] = misses++;
+  }
+  stats.acmr = static_cast<float>(misses) / (_numIndices / 3);
+  stats.atvr = static_cast<float>(misses) / numUsed;
+  return stats;
+}
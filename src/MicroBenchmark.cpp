@@ -0,0 +1,349 @@
+// Micro benchmarks for the CPU side of the morph pipeline, obj parsing (ngl::Obj and the parallel pose set loader),
+// welding / packing the poses, building the sparse and encoded targets, the CPU blends and the pick BVH. Every case runs over the
+// Bruce poses and synthetic grids up to 1M+ vertices and reports vertices per second plus the heap bytes and
+// allocations per run. No GL context is needed.
+// usage : MorphMicroBenchmark [--sizes n,n,..] [--targets n] [--min-time s] [--filter name] [pose files...]
+#include "MorphBVH.h"
+#include "MorphEngine.h"
+#include "MorphTargetSet.h"
+#include "PoseSetLoader.h"
+#include "ThreadPool.h"
+#include <ngl/Obj.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // every operator new in the process is counted so each case can report what it allocates, the engine's aligned
+  // blocks come from its own allocator so aren't included
+  std::atomic<size_t> s_allocatedBytes{0};
+  std::atomic<size_t> s_allocations{0};
+  // rays cast per run of the bvh rays case
+  constexpr size_t c_benchmarkRays = 4096;
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the poses for one benchmark mesh, poseFiles are what the parse cases read
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Mesh
+  {
+    std::string name;
+    std::vector<std::string> poseFiles;
+    MorphTargetSet::Pose base;
+    std::vector<MorphTargetSet::Corner> corners;
+    std::vector<MorphTargetSet::Pose> targets;
+  };
+
+  struct Measurement
+  {
+    size_t runs = 0;
+    double seconds = 0.0;
+    size_t bytes = 0;
+    size_t allocations = 0;
+    size_t firstBytes = 0;
+  };
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _f once to warm up then repeatedly for at least _minTime seconds, the code being timed logs as it goes
+  /// so cout is silenced while it runs. The warm up allocations are kept as well as the later runs can re-use buffers.
+  //----------------------------------------------------------------------------------------------------------------------
+  Measurement measure(double _minTime, const std::function<void()> &_f)
+  {
+    std::cout.setstate(std::ios::badbit);
+    Measurement m;
+    auto bytes = s_allocatedBytes.load();
+    _f();
+    m.firstBytes = s_allocatedBytes.load() - bytes;
+    bytes = s_allocatedBytes.load();
+    auto allocations = s_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+      _f();
+      ++m.runs;
+      m.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (m.seconds < _minTime);
+    m.bytes = (s_allocatedBytes.load() - bytes) / m.runs;
+    m.allocations = (s_allocations.load() - allocations) / m.runs;
+    std::cout.clear();
+    return m;
+  }
+
+  Mesh loadPoses(const std::vector<std::string> &_poseFiles, ThreadPool &_pool)
+  {
+    Mesh mesh;
+    mesh.name = std::filesystem::path(_poseFiles[0]).stem().string();
+    mesh.poseFiles = _poseFiles;
+    PoseSetLoader loader(_pool);
+    loader.load(_poseFiles);
+    mesh.base = loader.base();
+    mesh.corners = loader.corners();
+    mesh.targets = loader.targets();
+    return mesh;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a flat n x n grid, each target lifts its own band of rows with a bump so only 1 / _numTargets of the
+  /// vertices move in each, roughly how a face rig behaves
+  //----------------------------------------------------------------------------------------------------------------------
+  Mesh makeGrid(size_t _size, size_t _numTargets)
+  {
+    auto n = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(_size))));
+    Mesh mesh;
+    mesh.name = "grid" + std::to_string(n * n);
+    mesh.base.verts.reserve(n * n);
+    for (size_t z = 0; z < n; ++z)
+    {
+      for (size_t x = 0; x < n; ++x)
+      {
+        mesh.base.verts.push_back({static_cast<float>(x), 0.0f, static_cast<float>(z)});
+      }
+    }
+    mesh.base.normals.assign(n * n, {0.0f, 1.0f, 0.0f});
+    mesh.corners.reserve(6 * (n - 1) * (n - 1));
+    auto triangle = [&mesh](uint32_t _a, uint32_t _b, uint32_t _c)
+    {
+      for (auto i : {_a, _b, _c})
+        mesh.corners.push_back({i, i});
+    };
+    for (size_t z = 0; z + 1 < n; ++z)
+    {
+      for (size_t x = 0; x + 1 < n; ++x)
+      {
+        auto i = static_cast<uint32_t>(z * n + x);
+        auto row = static_cast<uint32_t>(n);
+        triangle(i, i + row, i + 1);
+        triangle(i + 1, i + row, i + row + 1);
+      }
+    }
+    for (size_t t = 0; t < _numTargets; ++t)
+    {
+      auto pose = mesh.base;
+      size_t first = t * n / _numTargets;
+      size_t last = (t + 1) * n / _numTargets;
+      for (size_t z = first; z < last; ++z)
+      {
+        float phase = 3.14159265f * (z - first) / std::max<size_t>(last - first, 1);
+        for (size_t x = 0; x < n; ++x)
+        {
+          pose.verts[z * n + x].m_y = std::sin(phase);
+          pose.normals[z * n + x] = ngl::Vec3(0.0f, std::sin(phase), std::cos(phase));
+        }
+      }
+      mesh.targets.push_back(std::move(pose));
+    }
+    return mesh;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write the base of a grid as an obj in the temp directory for the parse cases, it is kept for the next run
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string writeObj(const Mesh &_mesh)
+  {
+    auto path = (std::filesystem::temp_directory_path() / ("MorphMicroBenchmark_" + _mesh.name + ".obj")).string();
+    if (std::filesystem::exists(path))
+      return path;
+    std::ofstream file(path);
+    for (auto &v : _mesh.base.verts)
+      file << "v " << v.m_x << ' ' << v.m_y << ' ' << v.m_z << '\n';
+    for (auto &n : _mesh.base.normals)
+      file << "vn " << n.m_x << ' ' << n.m_y << ' ' << n.m_z << '\n';
+    for (auto &v : _mesh.base.verts)
+      file << "vt " << v.m_x << ' ' << v.m_z << '\n';
+    for (size_t i = 0; i < _mesh.corners.size(); i += 3)
+    {
+      file << 'f';
+      for (size_t j = i; j < i + 3; ++j)
+        file << ' ' << _mesh.corners[j].vert + 1 << '/' << _mesh.corners[j].vert + 1 << '/' << _mesh.corners[j].normal + 1;
+      file << '\n';
+    }
+    return path;
+  }
+
+  void report(const std::string &_case, const Mesh &_mesh, size_t _verts, const Measurement &_m)
+  {
+    double perRun = _m.seconds / _m.runs;
+    std::cout << std::left << std::setw(16) << _case << std::setw(16) << _mesh.name << std::right << std::setw(9) << _verts
+              << std::setw(7) << _m.runs << std::fixed << std::setprecision(3) << std::setw(12) << perRun * 1000.0
+              << std::setprecision(1) << std::setw(10) << _verts / perRun * 1e-6 << std::setprecision(0) << std::setw(12)
+              << _m.bytes / 1024.0 << std::setw(9) << _m.allocations << std::setw(12) << _m.firstBytes / 1024.0 << '\n';
+  }
+} // end anonymous namespace
+
+void *operator new(std::size_t _size)
+{
+  s_allocatedBytes.fetch_add(_size, std::memory_order_relaxed);
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto *p = std::malloc(_size ? _size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *_p) noexcept
+{
+  std::free(_p);
+}
+
+void operator delete(void *_p, std::size_t) noexcept
+{
+  std::free(_p);
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<size_t> sizes{10000, 100000, 1000000};
+  size_t numTargets = 4;
+  double minTime = 0.5;
+  std::string filter;
+  std::vector<std::string> poses;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--sizes" && i + 1 < argc)
+    {
+      sizes.clear();
+      for (char *p = argv[++i]; *p != '\0';)
+      {
+        char *end;
+        auto size = std::strtoul(p, &end, 10);
+        if (end == p)
+          break;
+        if (size > 3)
+          sizes.push_back(size);
+        p = *end == ',' ? end + 1 : end;
+      }
+    }
+    else if (arg == "--targets" && i + 1 < argc)
+      numTargets = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+    else if (arg == "--min-time" && i + 1 < argc)
+      minTime = std::strtod(argv[++i], nullptr);
+    else if (arg == "--filter" && i + 1 < argc)
+      filter = argv[++i];
+    else
+      poses.push_back(arg);
+  }
+  if (poses.empty())
+    poses = MorphTargetSet::defaultPoseFiles();
+
+  ThreadPool pool;
+  std::vector<Mesh> meshes;
+  if (std::filesystem::exists(poses[0]))
+    meshes.push_back(loadPoses(poses, pool));
+  else
+    std::cerr << "Can't find " << poses[0] << ", only the synthetic meshes will be run\n";
+  for (auto size : sizes)
+  {
+    meshes.push_back(makeGrid(size, numTargets));
+    // the parse cases read the base as every pose, the topology matches and it saves writing the targets
+    meshes.back().poseFiles.assign(3, writeObj(meshes.back()));
+  }
+
+  std::cout << "case            mesh                verts   runs     ms/run  Mverts/s    KB/run   allocs    first KB\n";
+  auto run = [&](const std::string &_case, const Mesh &_mesh, size_t _verts, const std::function<void()> &_f)
+  {
+    if (_case.find(filter) != std::string::npos)
+      report(_case, _mesh, _verts, measure(minTime, _f));
+  };
+  for (auto &mesh : meshes)
+  {
+    run("ngl::Obj parse", mesh, mesh.base.verts.size(), [&] { ngl::Obj obj(mesh.poseFiles[0]); });
+    // every pose in parallel, so verts are for the whole set
+    PoseSetLoader loader(pool);
+    run("pose set load", mesh, mesh.base.verts.size() * mesh.poseFiles.size(), [&] { loader.load(mesh.poseFiles); });
+    loader.clear();
+    // the rest of the cases work on the packed mesh, it is set up here so any of them can be run on their own
+    MorphTargetSet set;
+    MorphEngine engine;
+    auto load = [&]
+    {
+      engine = MorphEngine();
+      set.loadEngine(engine);
+    };
+    std::cout.setstate(std::ios::badbit);
+    set.pack(mesh.base, mesh.corners, mesh.targets);
+    set.buildSparse();
+    load();
+    std::cout.clear();
+    auto verts = set.numVerts();
+    run("pack", mesh, verts, [&] { set.pack(mesh.base, mesh.corners, mesh.targets); });
+    run("sparse build", mesh, verts, [&] { set.buildSparse(); });
+    run("encode deltas", mesh, verts, [&] { set.encodeDeltas(MorphTargetSet::DeltaFormat::AUTO); });
+    run("engine load", mesh, verts, load);
+    std::vector<float> weights(set.numTargets(), 0.5f);
+    auto result = engine.createResult();
+    for (auto kernel : {MorphEngine::Kernel::SCALAR, MorphEngine::Kernel::SSE, MorphEngine::Kernel::AVX2})
+    {
+      if (!MorphEngine::kernelSupported(kernel))
+        continue;
+      engine.setKernel(kernel);
+      run(std::string("blend ") + MorphEngine::kernelName(kernel), mesh, verts, [&] { engine.evaluate(weights.data(), result); });
+    }
+    // alternate the weights so every run has something to scatter
+    bool flip = false;
+    run("blend sparse", mesh, verts,
+        [&]
+        {
+          flip ^= true;
+          for (size_t t = 0; t < set.numTargets(); ++t)
+            set.setWeight(t, flip ? 0.5f : 0.25f);
+          size_t first, last;
+          set.updateActive();
+          set.applySparse(first, last);
+        });
+    // a full build against a refit from a blend, the refit is what a pick pays when the weights have changed
+    MorphBVH bvh;
+    auto *base = &set.vertices()[0].p1.m_x;
+    run("bvh build", mesh, verts, [&] { bvh.build(base, base + 1, base + 2, 6, verts, set.indices(), set.numIndices()); });
+    engine.evaluate(weights.data(), result);
+    run("bvh refit", mesh, verts, [&] { bvh.refit(result.component(0), result.component(1), result.component(2), 1); });
+    run("bvh blend refit", mesh, verts,
+        [&]
+        {
+          engine.evaluate(weights.data(), result);
+          bvh.refit(result.component(0), result.component(1), result.component(2), 1);
+        });
+    // rays from all around the bounds aimed at points inside it, the verts column is rays so the rate is Mrays/s
+    float bounds[6];
+    bvh.bounds(bounds);
+    std::vector<float> rays;
+    uint32_t seed = 1;
+    auto random = [&seed]
+    {
+      seed = seed * 1664525u + 1013904223u;
+      return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    for (size_t r = 0; r < c_benchmarkRays; ++r)
+    {
+      float origin[3];
+      for (size_t c = 0; c < 3; ++c)
+      {
+        auto centre = 0.5f * (bounds[c] + bounds[c + 3]);
+        auto extent = bounds[c + 3] - bounds[c];
+        origin[c] = centre + (random() - 0.5f) * 3.0f * extent;
+        rays.push_back(origin[c]);
+      }
+      for (size_t c = 0; c < 3; ++c)
+        rays.push_back(0.5f * (bounds[c] + bounds[c + 3]) + (random() - 0.5f) * 0.8f * (bounds[c + 3] - bounds[c]) - origin[c]);
+    }
+    size_t hits = 0;
+    run("bvh rays", mesh, c_benchmarkRays,
+        [&]
+        {
+          for (size_t r = 0; r < c_benchmarkRays; ++r)
+          {
+            MorphBVH::Hit hit;
+            hits += bvh.intersect(&rays[r * 6], &rays[r * 6 + 3], hit);
+          }
+        });
+  }
+  return EXIT_SUCCESS;
+}
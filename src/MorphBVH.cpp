@@ -0,0 +1,309 @@
+#include "MorphBVH.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+// the centroid range of a node is split into this many bins to evaluate the surface area heuristic
+constexpr size_t c_bins = 16;
+// past this depth the ranges are halved rather than split by area, so no tree is deeper than this + log2(triangles)
+constexpr uint32_t c_maxAreaDepth = 32;
+// the traversal stack holds at most one node per level plus one, enough for the deepest tree a build makes
+constexpr size_t c_stackSize = 64;
+// the slab and triangle distances are each a few roundings out, scaling where the ray leaves a box (or the nearest
+// hit so far) by this keeps a ray that only touches a box, through a vertex on its face say, from being rejected
+constexpr float c_leaveScale = 1.0f + 16.0f * std::numeric_limits<float>::epsilon();
+
+struct Box
+{
+  float low[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+  float high[3] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+  void grow(const float *_p)
+  {
+    for (size_t c = 0; c < 3; ++c)
+    {
+      low[c] = std::min(low[c], _p[c]);
+      high[c] = std::max(high[c], _p[c]);
+    }
+  }
+  void grow(const Box &_b)
+  {
+    for (size_t c = 0; c < 3; ++c)
+    {
+      low[c] = std::min(low[c], _b.low[c]);
+      high[c] = std::max(high[c], _b.high[c]);
+    }
+  }
+  float area() const
+  {
+    float d[3];
+    for (size_t c = 0; c < 3; ++c)
+      d[c] = std::max(high[c] - low[c], 0.0f);
+    return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+  }
+};
+
+// the distance along the ray where it enters the box, or a negative number if it misses before _limit
+float enterBox(const float *_low, const float *_high, const float *_origin, const float *_inverse, float _limit)
+{
+  float enter = 0.0f;
+  float leave = _limit;
+  for (size_t c = 0; c < 3; ++c)
+  {
+    auto t0 = (_low[c] - _origin[c]) * _inverse[c];
+    auto t1 = (_high[c] - _origin[c]) * _inverse[c];
+    enter = std::max(enter, std::min(t0, t1));
+    leave = std::min(leave, std::max(t0, t1));
+  }
+  return enter <= leave * c_leaveScale ? enter : -1.0f;
+}
+} // end anon namespace
+
+void MorphBVH::setPositions(const float *_x, const float *_y, const float *_z, size_t _stride)
+{
+  m_positions.resize(m_numVerts * 3);
+  for (size_t i = 0; i < m_numVerts; ++i)
+  {
+    m_positions[i * 3] = _x[i * _stride];
+    m_positions[i * 3 + 1] = _y[i * _stride];
+    m_positions[i * 3 + 2] = _z[i * _stride];
+  }
+}
+
+void MorphBVH::build(const float *_x, const float *_y, const float *_z, size_t _stride, size_t _numVerts, const uint32_t *_indices,
+                     size_t _numIndices)
+{
+  m_numVerts = _numVerts;
+  m_indices = _indices;
+  setPositions(_x, _y, _z, _stride);
+  auto numTris = _numIndices / 3;
+  m_triangles.resize(numTris);
+  std::iota(m_triangles.begin(), m_triangles.end(), 0);
+  m_nodes.clear();
+  if (numTris == 0)
+    return;
+  m_nodes.reserve(2 * numTris / c_maxLeafTriangles + 1);
+  std::vector<Box> boxes(numTris);
+  std::vector<float> centres(numTris * 3);
+  for (size_t t = 0; t < numTris; ++t)
+  {
+    for (size_t k = 0; k < 3; ++k)
+      boxes[t].grow(&m_positions[m_indices[t * 3 + k] * 3]);
+    for (size_t c = 0; c < 3; ++c)
+      centres[t * 3 + c] = 0.5f * (boxes[t].low[c] + boxes[t].high[c]);
+  }
+
+  auto split = [&](auto &&_self, uint32_t _first, uint32_t _count, uint32_t _depth) -> void
+  {
+    auto index = m_nodes.size();
+    m_nodes.push_back(Node());
+    Box box;
+    Box centreBox;
+    for (auto i = _first; i < _first + _count; ++i)
+    {
+      box.grow(boxes[m_triangles[i]]);
+      centreBox.grow(&centres[m_triangles[i] * 3]);
+    }
+    std::copy(box.low, box.low + 3, m_nodes[index].low);
+    std::copy(box.high, box.high + 3, m_nodes[index].high);
+    if (_count <= c_maxLeafTriangles)
+    {
+      m_nodes[index].first = _first;
+      m_nodes[index].count = _count;
+      return;
+    }
+    // every axis is binned in one pass over the triangles, then the cheapest split plane between the bins on any
+    // axis wins, the cost is area * triangles on each side
+    size_t bestAxis = 3;
+    size_t bestBin = 0;
+    if (_depth < c_maxAreaDepth)
+    {
+      float scale[3];
+      for (size_t axis = 0; axis < 3; ++axis)
+      {
+        auto extent = centreBox.high[axis] - centreBox.low[axis];
+        scale[axis] = extent > 0.0f ? c_bins / extent : 0.0f;
+      }
+      Box binBoxes[3][c_bins];
+      size_t binCounts[3][c_bins] = {};
+      for (auto i = _first; i < _first + _count; ++i)
+      {
+        auto t = m_triangles[i];
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+          auto b = std::min(c_bins - 1, static_cast<size_t>((centres[t * 3 + axis] - centreBox.low[axis]) * scale[axis]));
+          binBoxes[axis][b].grow(boxes[t]);
+          ++binCounts[axis][b];
+        }
+      }
+      float bestCost = std::numeric_limits<float>::max();
+      for (size_t axis = 0; axis < 3; ++axis)
+      {
+        if (scale[axis] == 0.0f)
+          continue;
+        float rightCost[c_bins];
+        Box right;
+        size_t rightCount = 0;
+        for (size_t b = c_bins - 1; b > 0; --b)
+        {
+          right.grow(binBoxes[axis][b]);
+          rightCount += binCounts[axis][b];
+          rightCost[b] = rightCount > 0 ? right.area() * rightCount : 0.0f;
+        }
+        Box left;
+        size_t leftCount = 0;
+        for (size_t b = 0; b + 1 < c_bins; ++b)
+        {
+          left.grow(binBoxes[axis][b]);
+          leftCount += binCounts[axis][b];
+          if (leftCount == 0 || leftCount == _count)
+            continue;
+          auto cost = left.area() * leftCount + rightCost[b + 1];
+          if (cost < bestCost)
+          {
+            bestCost = cost;
+            bestAxis = axis;
+            bestBin = b;
+          }
+        }
+      }
+    }
+    uint32_t leftCount = _count / 2;
+    if (bestAxis < 3)
+    {
+      auto scale = c_bins / (centreBox.high[bestAxis] - centreBox.low[bestAxis]);
+      auto middle = std::partition(&m_triangles[_first], &m_triangles[_first] + _count,
+                                   [&](uint32_t _t)
+                                   {
+                                     auto b = std::min(c_bins - 1, static_cast<size_t>((centres[_t * 3 + bestAxis] - centreBox.low[bestAxis]) * scale));
+                                     return b <= bestBin;
+                                   });
+      leftCount = static_cast<uint32_t>(middle - &m_triangles[_first]);
+    }
+    // every centre in the same place (or too deep), halve the range so the tree still ends
+    if (leftCount == 0 || leftCount == _count)
+      leftCount = _count / 2;
+    m_nodes[index].count = 0;
+    _self(_self, _first, leftCount, _depth + 1);
+    m_nodes[index].first = static_cast<uint32_t>(m_nodes.size());
+    _self(_self, _first + leftCount, _count - leftCount, _depth + 1);
+  };
+  split(split, 0, static_cast<uint32_t>(numTris), 0);
+}
+
+void MorphBVH::leafBounds(Node &io_node) const
+{
+  Box box;
+  for (auto i = io_node.first; i < io_node.first + io_node.count; ++i)
+  {
+    auto *tri = &m_indices[m_triangles[i] * 3];
+    for (size_t k = 0; k < 3; ++k)
+      box.grow(&m_positions[tri[k] * 3]);
+  }
+  std::copy(box.low, box.low + 3, io_node.low);
+  std::copy(box.high, box.high + 3, io_node.high);
+}
+
+void MorphBVH::refit(const float *_x, const float *_y, const float *_z, size_t _stride)
+{
+  setPositions(_x, _y, _z, _stride);
+  // children always come after their parent so going backwards visits them first
+  for (size_t i = m_nodes.size(); i-- > 0;)
+  {
+    auto &node = m_nodes[i];
+    if (node.count > 0)
+    {
+      leafBounds(node);
+      continue;
+    }
+    auto &a = m_nodes[i + 1];
+    auto &b = m_nodes[node.first];
+    for (size_t c = 0; c < 3; ++c)
+    {
+      node.low[c] = std::min(a.low[c], b.low[c]);
+      node.high[c] = std::max(a.high[c], b.high[c]);
+    }
+  }
+}
+
+bool MorphBVH::intersect(const float *_origin, const float *_direction, Hit &o_hit) const
+{
+  if (m_nodes.empty())
+    return false;
+  float inverse[3];
+  for (size_t c = 0; c < 3; ++c)
+    inverse[c] = _direction[c] != 0.0f ? 1.0f / _direction[c] : std::numeric_limits<float>::max();
+  bool found = false;
+  uint32_t stack[c_stackSize];
+  size_t top = 0;
+  stack[top++] = 0;
+  while (top > 0)
+  {
+    auto &node = m_nodes[stack[--top]];
+    if (enterBox(node.low, node.high, _origin, inverse, o_hit.distance) < 0.0f)
+      continue;
+    if (node.count == 0)
+    {
+      // the nearer child goes on top so it is searched first and shortens the ray for the other
+      uint32_t near = static_cast<uint32_t>(&node - m_nodes.data()) + 1;
+      uint32_t far = node.first;
+      auto nearEnter = enterBox(m_nodes[near].low, m_nodes[near].high, _origin, inverse, o_hit.distance);
+      auto farEnter = enterBox(m_nodes[far].low, m_nodes[far].high, _origin, inverse, o_hit.distance);
+      if (farEnter >= 0.0f && (nearEnter < 0.0f || farEnter < nearEnter))
+      {
+        std::swap(near, far);
+        std::swap(nearEnter, farEnter);
+      }
+      if (farEnter >= 0.0f)
+        stack[top++] = far;
+      if (nearEnter >= 0.0f)
+        stack[top++] = near;
+      continue;
+    }
+    for (auto i = node.first; i < node.first + node.count; ++i)
+    {
+      // Moller Trumbore, both sides of the triangle count
+      auto *tri = &m_indices[m_triangles[i] * 3];
+      auto *p0 = &m_positions[tri[0] * 3];
+      auto *p1 = &m_positions[tri[1] * 3];
+      auto *p2 = &m_positions[tri[2] * 3];
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      float p[3] = {_direction[1] * e2[2] - _direction[2] * e2[1], _direction[2] * e2[0] - _direction[0] * e2[2],
+                    _direction[0] * e2[1] - _direction[1] * e2[0]};
+      auto det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+      if (std::abs(det) < 1e-12f)
+        continue;
+      auto inv = 1.0f / det;
+      float s[3] = {_origin[0] - p0[0], _origin[1] - p0[1], _origin[2] - p0[2]};
+      auto u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+      if (u < 0.0f || u > 1.0f)
+        continue;
+      float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+      auto v = (_direction[0] * q[0] + _direction[1] * q[1] + _direction[2] * q[2]) * inv;
+      if (v < 0.0f || u + v > 1.0f)
+        continue;
+      auto t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+      if (t < 0.0f || t >= o_hit.distance)
+        continue;
+      o_hit.distance = t;
+      o_hit.triangle = m_triangles[i];
+      o_hit.u = u;
+      o_hit.v = v;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void MorphBVH::bounds(float *o_bounds) const
+{
+  if (m_nodes.empty())
+  {
+    std::fill(o_bounds, o_bounds + 6, 0.0f);
+    return;
+  }
+  std::copy(m_nodes[0].low, m_nodes[0].low + 3, o_bounds);
+  std::copy(m_nodes[0].high, m_nodes[0].high + 3, o_bounds + 3);
+}
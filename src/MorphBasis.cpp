@@ -0,0 +1,211 @@
+#include "MorphBasis.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+// the most Jacobi sweeps, it converges in well under ten for a Gram matrix
+constexpr size_t c_maxSweeps = 50;
+// components whose variance is this small against the largest are rounding noise, not shapes
+constexpr double c_minEigenRatio = 1e-12;
+} // end anon namespace
+
+void MorphBasis::setVertexCount(size_t _numVerts)
+{
+  m_numVerts = _numVerts;
+  m_targets.clear();
+}
+
+void MorphBasis::addTarget(const float *_deltas)
+{
+  m_targets.push_back(_deltas);
+}
+
+void MorphBasis::build(const Options &_options)
+{
+  m_numShapes = 0;
+  m_shapes.clear();
+  m_coefficients.clear();
+  m_targetError = Error();
+  m_blendError = Error();
+  auto n = m_targets.size();
+  auto floats = m_numVerts * 6;
+  if (n == 0 || floats == 0)
+    return;
+
+  // the Gram matrix of the targets has the same non zero eigenvalues as their covariance and is only n x n
+  std::vector<double> a(n * n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    for (size_t j = 0; j <= i; ++j)
+    {
+      double sum = 0.0;
+      for (size_t e = 0; e < floats; ++e)
+        sum += static_cast<double>(m_targets[i][e]) * m_targets[j][e];
+      a[i * n + j] = sum;
+      a[j * n + i] = sum;
+    }
+  }
+  // cyclic Jacobi, the columns of v end up as the eigenvectors and the diagonal of a as the eigenvalues
+  std::vector<double> v(n * n, 0.0);
+  for (size_t i = 0; i < n; ++i)
+    v[i * n + i] = 1.0;
+  for (size_t sweep = 0; sweep < c_maxSweeps; ++sweep)
+  {
+    double off = 0.0;
+    double diagonal = 0.0;
+    for (size_t p = 0; p < n; ++p)
+    {
+      diagonal += a[p * n + p] * a[p * n + p];
+      for (size_t q = p + 1; q < n; ++q)
+        off += a[p * n + q] * a[p * n + q];
+    }
+    if (off <= 1e-24 * diagonal)
+      break;
+    for (size_t p = 0; p < n; ++p)
+    {
+      for (size_t q = p + 1; q < n; ++q)
+      {
+        auto apq = a[p * n + q];
+        if (apq == 0.0)
+          continue;
+        auto theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+        auto t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        auto c = 1.0 / std::sqrt(t * t + 1.0);
+        auto s = t * c;
+        for (size_t k = 0; k < n; ++k)
+        {
+          auto akp = a[k * n + p];
+          auto akq = a[k * n + q];
+          a[k * n + p] = c * akp - s * akq;
+          a[k * n + q] = s * akp + c * akq;
+        }
+        for (size_t k = 0; k < n; ++k)
+        {
+          auto apk = a[p * n + k];
+          auto aqk = a[q * n + k];
+          a[p * n + k] = c * apk - s * aqk;
+          a[q * n + k] = s * apk + c * aqk;
+        }
+        for (size_t k = 0; k < n; ++k)
+        {
+          auto vkp = v[k * n + p];
+          auto vkq = v[k * n + q];
+          v[k * n + p] = c * vkp - s * vkq;
+          v[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&a, n](size_t _l, size_t _r) { return a[_l * n + _l] > a[_r * n + _r]; });
+  auto largest = a[order[0] * n + order[0]];
+
+  // the residual of every target, each shape is projected out of it in turn (so the float shapes stay orthogonal)
+  // and the shapes stop once every target is within the tolerance
+  std::vector<float> residual(n * floats);
+  for (size_t t = 0; t < n; ++t)
+    std::copy(m_targets[t], m_targets[t] + floats, &residual[t * floats]);
+  auto measure = [&](Error &o_error, const float *_deltas, size_t _count)
+  {
+    double posSum = 0.0;
+    double normalSum = 0.0;
+    for (size_t i = 0; i < _count * m_numVerts; ++i)
+    {
+      auto *d = &_deltas[i * 6];
+      auto pos = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+      auto normal = d[3] * d[3] + d[4] * d[4] + d[5] * d[5];
+      o_error.maxPosition = std::max(o_error.maxPosition, std::sqrt(pos));
+      o_error.maxNormal = std::max(o_error.maxNormal, std::sqrt(normal));
+      posSum += pos;
+      normalSum += normal;
+    }
+    o_error.rmsPosition = static_cast<float>(std::sqrt(posSum / (_count * m_numVerts)));
+    o_error.rmsNormal = static_cast<float>(std::sqrt(normalSum / (_count * m_numVerts)));
+  };
+  std::vector<double> sum(floats);
+  std::vector<float> shape(floats);
+  std::vector<double> projection(n);
+  std::vector<float> columns;
+  for (auto k : order)
+  {
+    if (m_numShapes == _options.maxShapes || a[k * n + k] <= c_minEigenRatio * largest)
+      break;
+    std::fill(sum.begin(), sum.end(), 0.0);
+    for (size_t t = 0; t < n; ++t)
+    {
+      auto u = v[t * n + k];
+      for (size_t e = 0; e < floats; ++e)
+        sum[e] += u * m_targets[t][e];
+    }
+    double length = 0.0;
+    for (auto s : sum)
+      length += s * s;
+    length = std::sqrt(length);
+    if (length == 0.0)
+      break;
+    for (size_t e = 0; e < floats; ++e)
+      shape[e] = static_cast<float>(sum[e] / length);
+    double largestProjection = 0.0;
+    for (size_t t = 0; t < n; ++t)
+    {
+      auto *r = &residual[t * floats];
+      double p = 0.0;
+      for (size_t e = 0; e < floats; ++e)
+        p += static_cast<double>(r[e]) * shape[e];
+      for (size_t e = 0; e < floats; ++e)
+        r[e] -= static_cast<float>(p * shape[e]);
+      projection[t] = p;
+      largestProjection = std::max(largestProjection, std::abs(p));
+    }
+    if (largestProjection == 0.0)
+      continue;
+    for (size_t e = 0; e < floats; ++e)
+      shape[e] = static_cast<float>(shape[e] * largestProjection);
+    m_shapes.insert(m_shapes.end(), shape.begin(), shape.end());
+    for (size_t t = 0; t < n; ++t)
+      columns.push_back(static_cast<float>(projection[t] / largestProjection));
+    ++m_numShapes;
+    m_targetError = Error();
+    measure(m_targetError, residual.data(), n);
+    if (std::max(m_targetError.maxPosition, m_targetError.maxNormal) <= _options.tolerance)
+      break;
+  }
+  // the coefficients were collected a shape at a time, fold wants them a target at a time
+  m_coefficients.resize(n * m_numShapes);
+  for (size_t s = 0; s < m_numShapes; ++s)
+  {
+    for (size_t t = 0; t < n; ++t)
+      m_coefficients[t * m_numShapes + s] = columns[s * n + t];
+  }
+  // the error of the blend is the blend of the residuals
+  std::vector<float> blend(floats, 0.0f);
+  for (size_t t = 0; t < n; ++t)
+  {
+    for (size_t e = 0; e < floats; ++e)
+      blend[e] += residual[t * floats + e];
+  }
+  measure(m_blendError, blend.data(), 1);
+}
+
+void MorphBasis::fold(const float *_weights, float *o_shapeWeights) const
+{
+  std::fill(o_shapeWeights, o_shapeWeights + m_numShapes, 0.0f);
+  for (size_t t = 0; t < m_targets.size(); ++t)
+  {
+    if (_weights[t] == 0.0f)
+      continue;
+    auto *c = &m_coefficients[t * m_numShapes];
+    for (size_t s = 0; s < m_numShapes; ++s)
+      o_shapeWeights[s] += _weights[t] * c[s];
+  }
+}
+
+float MorphBasis::compressionRatio() const
+{
+  auto targets = m_targets.size() * m_numVerts * 6;
+  auto compressed = m_shapes.size() + m_coefficients.size();
+  return compressed > 0 ? static_cast<float>(targets) / compressed : 1.0f;
+}
@@ -0,0 +1,356 @@
+#include "MorphCache.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+// on disk structures, these are all naturally aligned so there is no padding added by the compiler
+constexpr char c_magic[4] = {'M', 'T', 'B', 'O'};
+constexpr size_t c_alignment = 16;
+
+struct FileHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t numSources;
+  uint32_t numSections;
+};
+
+struct SourceRecord
+{
+  uint64_t size;
+  int64_t mtime;
+  uint64_t hash;
+  uint32_t pathLength;
+  uint32_t pad;
+};
+
+struct SectionRecord
+{
+  uint32_t id;
+  uint32_t pad;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t count;
+};
+
+size_t alignUp(size_t _v)
+{
+  return (_v + c_alignment - 1) & ~(c_alignment - 1);
+}
+
+bool readFile(const std::string &_path, std::vector<unsigned char> &o_data)
+{
+  std::ifstream in(_path, std::ios::binary | std::ios::ate);
+  if (!in.is_open())
+    return false;
+  auto size = static_cast<size_t>(in.tellg());
+  o_data.resize(size);
+  in.seekg(0);
+  in.read(reinterpret_cast<char *>(o_data.data()), static_cast<std::streamsize>(size));
+  return static_cast<bool>(in);
+}
+} // end anon namespace
+
+MorphCache::MorphCache(std::string_view _cacheFile, const std::vector<std::string> &_sources) : m_cacheFile(_cacheFile), m_sources(_sources)
+{
+}
+
+MorphCache::~MorphCache()
+{
+  unmap();
+}
+
+uint64_t MorphCache::hash(const void *_data, size_t _size, uint64_t _seed)
+{
+  auto bytes = static_cast<const unsigned char *>(_data);
+  uint64_t h = _seed;
+  for (size_t i = 0; i < _size; ++i)
+  {
+    h ^= bytes[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+MorphCache::SourceInfo MorphCache::sourceInfo(const std::string &_path, bool _hash)
+{
+  SourceInfo info;
+  std::error_code ec;
+  auto size = std::filesystem::file_size(_path, ec);
+  if (ec)
+    return info;
+  auto mtime = std::filesystem::last_write_time(_path, ec);
+  if (ec)
+    return info;
+  info.size = size;
+  info.mtime = static_cast<int64_t>(mtime.time_since_epoch().count());
+  if (_hash)
+  {
+    std::vector<unsigned char> data;
+    if (!readFile(_path, data))
+      return info;
+    info.hash = hash(data.data(), data.size());
+  }
+  info.valid = true;
+  return info;
+}
+
+void MorphCache::unmap()
+{
+#if !defined(_WIN32)
+  if (m_mapped && m_data != nullptr)
+    munmap(const_cast<unsigned char *>(m_data), m_size);
+#endif
+  m_fallback.clear();
+  m_data = nullptr;
+  m_size = 0;
+  m_mapped = false;
+  m_sections.clear();
+}
+
+bool MorphCache::load()
+{
+  unmap();
+#if !defined(_WIN32)
+  int fd = open(m_cacheFile.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+  {
+    close(fd);
+    return false;
+  }
+  m_size = static_cast<size_t>(st.st_size);
+  void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  close(fd);
+  if (ptr == MAP_FAILED)
+  {
+    m_size = 0;
+    return false;
+  }
+  m_data = static_cast<const unsigned char *>(ptr);
+  m_mapped = true;
+#else
+  if (!readFile(m_cacheFile, m_fallback))
+    return false;
+  m_data = m_fallback.data();
+  m_size = m_fallback.size();
+#endif
+  if (!validate())
+  {
+    unmap();
+    return false;
+  }
+  return true;
+}
+
+bool MorphCache::validate()
+{
+  if (m_size < sizeof(FileHeader))
+    return false;
+  FileHeader header;
+  std::memcpy(&header, m_data, sizeof(FileHeader));
+  if (std::memcmp(header.magic, c_magic, sizeof(c_magic)) != 0)
+    return false;
+  if (header.version != c_version)
+  {
+    std::cout << "Morph cache " << m_cacheFile << " is version " << header.version << " expected " << c_version << " rebuilding\n";
+    return false;
+  }
+  if (header.numSources != m_sources.size())
+    return false;
+
+  size_t offset = sizeof(FileHeader);
+  // the sources whose contents matched but not their timestamp
+  std::vector<std::pair<size_t, int64_t>> touched;
+  for (auto &source : m_sources)
+  {
+    if (offset + sizeof(SourceRecord) > m_size)
+      return false;
+    SourceRecord record;
+    std::memcpy(&record, m_data + offset, sizeof(SourceRecord));
+    auto recordOffset = offset;
+    offset += sizeof(SourceRecord);
+    if (offset + record.pathLength > m_size)
+      return false;
+    std::string_view path(reinterpret_cast<const char *>(m_data + offset), record.pathLength);
+    offset += record.pathLength;
+    if (path != source)
+      return false;
+    // cheap check first, if the timestamp matches we trust it, if not the contents may still be the same
+    // (fresh checkout / touch) so fall back to the hash
+    auto info = sourceInfo(source, false);
+    if (!info.valid || info.size != record.size)
+    {
+      std::cout << "Morph cache source " << source << " has changed rebuilding\n";
+      return false;
+    }
+    if (info.mtime != record.mtime)
+    {
+      info = sourceInfo(source, true);
+      if (!info.valid || info.hash != record.hash)
+      {
+        std::cout << "Morph cache source " << source << " has changed rebuilding\n";
+        return false;
+      }
+      touched.push_back({recordOffset, info.mtime});
+    }
+  }
+
+  offset = alignUp(offset);
+  for (uint32_t i = 0; i < header.numSections; ++i)
+  {
+    if (offset + sizeof(SectionRecord) > m_size)
+      return false;
+    SectionRecord record;
+    std::memcpy(&record, m_data + offset, sizeof(SectionRecord));
+    offset += sizeof(SectionRecord);
+    if (record.offset + record.size > m_size || record.offset % c_alignment != 0)
+      return false;
+    Blob blob;
+    blob.data = m_data + record.offset;
+    blob.size = static_cast<size_t>(record.size);
+    blob.count = static_cast<size_t>(record.count);
+    m_sections.push_back({static_cast<Section>(record.id), blob});
+  }
+  // so the next launch can trust the timestamp rather than hash the sources again
+  if (!touched.empty())
+    storeTimestamps(touched);
+  return true;
+}
+
+void MorphCache::storeTimestamps(const std::vector<std::pair<size_t, int64_t>> &_records) const
+{
+  // only the timestamps change, the data already mapped (or read) is still right whichever a reader sees
+  std::fstream file(m_cacheFile, std::ios::in | std::ios::out | std::ios::binary);
+  for (auto &record : _records)
+  {
+    file.seekp(static_cast<std::streamoff>(record.first + offsetof(SourceRecord, mtime)));
+    file.write(reinterpret_cast<const char *>(&record.second), sizeof(record.second));
+  }
+  if (!file)
+    std::cerr << "Unable to update the source timestamps in morph cache " << m_cacheFile << '\n';
+}
+
+MorphCache::Blob MorphCache::section(Section _s) const
+{
+  for (auto &s : m_sections)
+  {
+    if (s.first == _s)
+      return s.second;
+  }
+  return {};
+}
+
+void MorphCache::release(const void *_data, size_t _size) const
+{
+#if !defined(_WIN32)
+  if (!m_mapped)
+    return;
+  // only whole pages inside the range, the ends may be shared with data that is still wanted
+  auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto first = (reinterpret_cast<uintptr_t>(_data) + page - 1) / page * page;
+  auto last = (reinterpret_cast<uintptr_t>(_data) + _size) / page * page;
+  if (last > first)
+    madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+#else
+  (void)_data;
+  (void)_size;
+#endif
+}
+
+void MorphCache::addSection(Section _s, const void *_data, size_t _size, size_t _count)
+{
+  m_pending.push_back({_s, _data, _size, _count});
+}
+
+bool MorphCache::write()
+{
+  // build the header block in memory first so we know where the data starts
+  std::vector<unsigned char> header;
+  auto append = [&header](const void *_d, size_t _s)
+  {
+    auto p = static_cast<const unsigned char *>(_d);
+    header.insert(header.end(), p, p + _s);
+  };
+
+  FileHeader fileHeader;
+  std::memcpy(fileHeader.magic, c_magic, sizeof(c_magic));
+  fileHeader.version = c_version;
+  fileHeader.numSources = static_cast<uint32_t>(m_sources.size());
+  fileHeader.numSections = static_cast<uint32_t>(m_pending.size());
+  append(&fileHeader, sizeof(FileHeader));
+  for (auto &source : m_sources)
+  {
+    auto info = sourceInfo(source, true);
+    if (!info.valid)
+      return false;
+    SourceRecord record{info.size, info.mtime, info.hash, static_cast<uint32_t>(source.size()), 0};
+    append(&record, sizeof(SourceRecord));
+    append(source.data(), source.size());
+  }
+  header.resize(alignUp(header.size()), 0);
+
+  size_t dataOffset = alignUp(header.size() + m_pending.size() * sizeof(SectionRecord));
+  for (auto &p : m_pending)
+  {
+    SectionRecord record{static_cast<uint32_t>(p.id), 0, dataOffset, p.size, p.count};
+    append(&record, sizeof(SectionRecord));
+    dataOffset = alignUp(dataOffset + p.size);
+  }
+  header.resize(alignUp(header.size()), 0);
+
+  // several viewers may be started at once so give each writer its own temp file
+#if !defined(_WIN32)
+  auto tmpFile = m_cacheFile + ".tmp" + std::to_string(getpid());
+#else
+  auto tmpFile = m_cacheFile + ".tmp";
+#endif
+  {
+    std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+      std::cerr << "Unable to write morph cache " << tmpFile << '\n';
+      return false;
+    }
+    out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+    const char padding[c_alignment] = {};
+    size_t written = header.size();
+    for (auto &p : m_pending)
+    {
+      out.write(static_cast<const char *>(p.data), static_cast<std::streamsize>(p.size));
+      written += p.size;
+      out.write(padding, static_cast<std::streamsize>(alignUp(written) - written));
+      written = alignUp(written);
+    }
+    if (!out)
+    {
+      std::cerr << "Error writing morph cache " << tmpFile << '\n';
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpFile, m_cacheFile, ec);
+  if (ec)
+  {
+    std::cerr << "Unable to rename morph cache " << ec.message() << '\n';
+    std::filesystem::remove(tmpFile, ec);
+    return false;
+  }
+  m_pending.clear();
+  return true;
+}
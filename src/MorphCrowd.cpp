@@ -0,0 +1,48 @@
+#include "MorphCrowd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+MorphCrowd::MorphCrowd(const MorphEngine &_engine, ThreadPool &_pool) : m_engine(_engine), m_pool(_pool)
+{
+}
+
+void MorphCrowd::setTileSize(size_t _vertices, size_t _characters)
+{
+  auto pad = MorphEngine::c_padding;
+  m_vertexTile = std::max(pad, (_vertices + pad - 1) / pad * pad);
+  m_characterTile = std::max<size_t>(1, _characters);
+}
+
+void MorphCrowd::evaluate(const float *_weights, size_t _numCharacters, size_t _weightStride, std::vector<MorphEngine::Result> &io_results)
+{
+  while (io_results.size() < _numCharacters)
+  {
+    io_results.push_back(m_engine.createResult());
+  }
+  auto numVerts = m_engine.numVerts();
+  size_t vertexTiles = (numVerts + m_vertexTile - 1) / m_vertexTile;
+  size_t characterTiles = (_numCharacters + m_characterTile - 1) / m_characterTile;
+  // the vertex range is the inner index so each worker starts on whole character tiles, stealing from the back
+  // of another queue then takes the tiles that worker would have reached last
+  m_pool.run(vertexTiles * characterTiles,
+             [&](size_t _task, size_t)
+             {
+               size_t first = (_task % vertexTiles) * m_vertexTile;
+               size_t last = std::min(numVerts, first + m_vertexTile);
+               size_t character = (_task / vertexTiles) * m_characterTile;
+               size_t end = std::min(_numCharacters, character + m_characterTile);
+               for (; character < end; ++character)
+               {
+                 m_engine.evaluate(_weights + character * _weightStride, first, last, io_results[character]);
+               }
+             });
+}
+
+void MorphCrowd::evaluateInterleaved(const float *_weights, size_t _numCharacters, size_t _weightStride, float *o_dst)
+{
+  evaluate(_weights, _numCharacters, _weightStride, m_scratch);
+  auto numVerts = m_engine.numVerts();
+  auto floats = numVerts * MorphEngine::c_components;
+  m_pool.run(_numCharacters, [&](size_t _character, size_t)
+             { m_scratch[_character].interleave(o_dst + _character * floats, 0, numVerts); });
+}
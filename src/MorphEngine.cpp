@@ -0,0 +1,254 @@
+#include "MorphEngine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace
+{
+constexpr size_t c_alignment = 64;
+
+void alignedFree(float *_p)
+{
+  ::operator delete[](_p, std::align_val_t(c_alignment));
+}
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+bool cpuHasAVX2()
+{
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool fma = (info[2] & (1 << 12)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  if (!fma || !osxsave || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+bool cpuHasAVX2()
+{
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#else
+bool cpuHasAVX2()
+{
+  return false;
+}
+#endif
+} // end anon namespace
+
+MorphEngine::MorphEngine()
+{
+  setKernel(Kernel::AUTO);
+}
+
+MorphEngine::AlignedArray MorphEngine::allocate(size_t _count)
+{
+  auto *p = static_cast<float *>(::operator new[](_count * sizeof(float), std::align_val_t(c_alignment)));
+  std::fill(p, p + _count, 0.0f);
+  return AlignedArray(p, alignedFree);
+}
+
+bool MorphEngine::kernelSupported(Kernel _k)
+{
+  switch (_k)
+  {
+  case Kernel::SCALAR:
+  case Kernel::AUTO:
+    return true;
+  case Kernel::SSE:
+#if defined(MORPH_ENGINE_X86)
+    return true;
+#else
+    return false;
+#endif
+  case Kernel::AVX2:
+#if defined(MORPH_ENGINE_X86) && defined(MORPH_ENGINE_AVX2)
+    return cpuHasAVX2();
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+const char *MorphEngine::kernelName(Kernel _k)
+{
+  switch (_k)
+  {
+  case Kernel::SCALAR:
+    return "scalar";
+  case Kernel::SSE:
+    return "SSE";
+  case Kernel::AVX2:
+    return "AVX2";
+  case Kernel::AUTO:
+    return "auto";
+  }
+  return "unknown";
+}
+
+MorphEngine::Kernels MorphEngine::kernels(Kernel _k)
+{
+  switch (_k)
+  {
+  case Kernel::AVX2:
+    return {MorphKernels::axpyAVX2, MorphKernels::normalizeAVX2};
+  case Kernel::SSE:
+    return {MorphKernels::axpySSE, MorphKernels::normalizeSSE};
+  default:
+    return {MorphKernels::axpyScalar, MorphKernels::normalizeScalar};
+  }
+}
+
+MorphEngine::Kernel MorphEngine::setKernel(Kernel _k)
+{
+  if (_k == Kernel::AUTO)
+    _k = Kernel::AVX2;
+  // fall back to the next narrowest
+  if (_k == Kernel::AVX2 && !kernelSupported(Kernel::AVX2))
+    _k = Kernel::SSE;
+  if (_k == Kernel::SSE && !kernelSupported(Kernel::SSE))
+    _k = Kernel::SCALAR;
+  m_kernel = _k;
+  m_kernels = kernels(_k);
+  return m_kernel;
+}
+
+void MorphEngine::setBase(const float *_positions, const float *_normals, size_t _numVerts, size_t _stride)
+{
+  m_numVerts = _numVerts;
+  m_padded = (_numVerts + c_padding - 1) / c_padding * c_padding;
+  m_base = allocate(c_components * m_padded);
+  m_deltas.clear();
+  for (size_t i = 0; i < _numVerts; ++i)
+  {
+    for (size_t c = 0; c < 3; ++c)
+    {
+      m_base[c * m_padded + i] = _positions[i * _stride + c];
+      m_base[(c + 3) * m_padded + i] = _normals[i * _stride + c];
+    }
+  }
+}
+
+size_t MorphEngine::addTarget(const float *_positionDeltas, const float *_normalDeltas, size_t _stride)
+{
+  auto block = allocate(c_components * m_padded);
+  for (size_t i = 0; i < m_numVerts; ++i)
+  {
+    for (size_t c = 0; c < 3; ++c)
+    {
+      block[c * m_padded + i] = _positionDeltas[i * _stride + c];
+      block[(c + 3) * m_padded + i] = _normalDeltas[i * _stride + c];
+    }
+  }
+  m_deltas.push_back(std::move(block));
+  return m_deltas.size() - 1;
+}
+
+MorphEngine::Result MorphEngine::createResult() const
+{
+  Result r;
+  r.m_data = allocate(c_components * m_padded);
+  r.m_numVerts = m_numVerts;
+  r.m_padded = m_padded;
+  return r;
+}
+
+void MorphEngine::evaluate(const float *_weights, Result &o_result) const
+{
+  evaluate(_weights, 0, m_numVerts, o_result);
+}
+
+void MorphEngine::evaluate(const float *_weights, size_t _first, size_t _last, Result &o_result) const
+{
+  // work on whole vectors, the padding at the end is zero so is safe to blend
+  _first = _first / c_padding * c_padding;
+  _last = std::min(m_padded, (_last + c_padding - 1) / c_padding * c_padding);
+  for (size_t tile = _first; tile < _last; tile += c_tileSize)
+  {
+    size_t count = std::min(c_tileSize, _last - tile);
+    for (size_t c = 0; c < c_components; ++c)
+    {
+      std::memcpy(o_result.component(c) + tile, base(c) + tile, count * sizeof(float));
+    }
+    for (size_t t = 0; t < m_deltas.size(); ++t)
+    {
+      float w = _weights[t];
+      if (w == 0.0f)
+        continue;
+      for (size_t c = 0; c < c_components; ++c)
+      {
+        m_kernels.axpy(o_result.component(c) + tile, delta(t, c) + tile, w, count);
+      }
+    }
+    m_kernels.normalize(o_result.component(3) + tile, o_result.component(4) + tile, o_result.component(5) + tile, count);
+  }
+}
+
+void MorphEngine::evaluateReference(const float *_weights, Result &o_result) const
+{
+  for (size_t i = 0; i < m_numVerts; ++i)
+  {
+    float v[c_components];
+    for (size_t c = 0; c < c_components; ++c)
+    {
+      v[c] = base(c)[i];
+      for (size_t t = 0; t < m_deltas.size(); ++t)
+      {
+        v[c] += _weights[t] * delta(t, c)[i];
+      }
+    }
+    float len = std::sqrt(v[3] * v[3] + v[4] * v[4] + v[5] * v[5]);
+    if (len > 0.0f)
+    {
+      v[3] /= len;
+      v[4] /= len;
+      v[5] /= len;
+    }
+    for (size_t c = 0; c < c_components; ++c)
+    {
+      o_result.component(c)[i] = v[c];
+    }
+  }
+}
+
+void MorphEngine::Result::interleave(float *o_dst, size_t _first, size_t _last) const
+{
+  for (size_t i = _first; i < _last; ++i)
+  {
+    for (size_t c = 0; c < c_components; ++c)
+    {
+      *o_dst++ = component(c)[i];
+    }
+  }
+}
+
+void MorphKernels::axpyScalar(float *o_dst, const float *_src, float _w, size_t _count)
+{
+  for (size_t i = 0; i < _count; ++i)
+  {
+    o_dst[i] += _w * _src[i];
+  }
+}
+
+void MorphKernels::normalizeScalar(float *io_x, float *io_y, float *io_z, size_t _count)
+{
+  for (size_t i = 0; i < _count; ++i)
+  {
+    float len = std::sqrt(io_x[i] * io_x[i] + io_y[i] * io_y[i] + io_z[i] * io_z[i]);
+    if (len > 0.0f)
+    {
+      io_x[i] /= len;
+      io_y[i] /= len;
+      io_z[i] /= len;
+    }
+  }
+}
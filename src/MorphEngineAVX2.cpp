@@ -0,0 +1,52 @@
+#include "MorphEngine.h"
+// this file is built with AVX2 / FMA enabled (see CMakeLists.txt) and is only called once
+// MorphEngine has checked the CPU supports it, without the flags it forwards to SSE
+#if defined(MORPH_ENGINE_X86) && defined(MORPH_ENGINE_AVX2)
+#include <immintrin.h>
+
+void MorphKernels::axpyAVX2(float *o_dst, const float *_src, float _w, size_t _count)
+{
+  __m256 w = _mm256_set1_ps(_w);
+  size_t i = 0;
+  for (; i + 8 <= _count; i += 8)
+  {
+    __m256 d = _mm256_load_ps(o_dst + i);
+    __m256 s = _mm256_load_ps(_src + i);
+    _mm256_store_ps(o_dst + i, _mm256_fmadd_ps(w, s, d));
+  }
+  // finish any remainder with the narrower kernel
+  if (i < _count)
+    axpySSE(o_dst + i, _src + i, _w, _count - i);
+}
+
+void MorphKernels::normalizeAVX2(float *io_x, float *io_y, float *io_z, size_t _count)
+{
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one = _mm256_set1_ps(1.0f);
+  size_t i = 0;
+  for (; i + 8 <= _count; i += 8)
+  {
+    __m256 x = _mm256_load_ps(io_x + i);
+    __m256 y = _mm256_load_ps(io_y + i);
+    __m256 z = _mm256_load_ps(io_z + i);
+    __m256 len = _mm256_sqrt_ps(_mm256_fmadd_ps(z, z, _mm256_fmadd_ps(y, y, _mm256_mul_ps(x, x))));
+    // zero length vectors are left alone to match the scalar version
+    __m256 safe = _mm256_blendv_ps(one, len, _mm256_cmp_ps(len, zero, _CMP_GT_OQ));
+    _mm256_store_ps(io_x + i, _mm256_div_ps(x, safe));
+    _mm256_store_ps(io_y + i, _mm256_div_ps(y, safe));
+    _mm256_store_ps(io_z + i, _mm256_div_ps(z, safe));
+  }
+  if (i < _count)
+    normalizeSSE(io_x + i, io_y + i, io_z + i, _count - i);
+}
+#else
+void MorphKernels::axpyAVX2(float *o_dst, const float *_src, float _w, size_t _count)
+{
+  axpySSE(o_dst, _src, _w, _count);
+}
+
+void MorphKernels::normalizeAVX2(float *io_x, float *io_y, float *io_z, size_t _count)
+{
+  normalizeSSE(io_x, io_y, io_z, _count);
+}
+#endif
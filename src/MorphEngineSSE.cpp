@@ -0,0 +1,46 @@
+#include "MorphEngine.h"
+// SSE2 is part of the x86_64 baseline so this needs no extra compiler flags, on other
+// architectures the engine never selects these so just forward to the scalar versions
+#if defined(MORPH_ENGINE_X86)
+#include <emmintrin.h>
+
+void MorphKernels::axpySSE(float *o_dst, const float *_src, float _w, size_t _count)
+{
+  __m128 w = _mm_set1_ps(_w);
+  for (size_t i = 0; i < _count; i += 4)
+  {
+    __m128 d = _mm_load_ps(o_dst + i);
+    __m128 s = _mm_load_ps(_src + i);
+    _mm_store_ps(o_dst + i, _mm_add_ps(d, _mm_mul_ps(w, s)));
+  }
+}
+
+void MorphKernels::normalizeSSE(float *io_x, float *io_y, float *io_z, size_t _count)
+{
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+  for (size_t i = 0; i < _count; i += 4)
+  {
+    __m128 x = _mm_load_ps(io_x + i);
+    __m128 y = _mm_load_ps(io_y + i);
+    __m128 z = _mm_load_ps(io_z + i);
+    __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+    // zero length vectors are left alone to match the scalar version
+    __m128 valid = _mm_cmpgt_ps(len, zero);
+    __m128 safe = _mm_or_ps(_mm_and_ps(valid, len), _mm_andnot_ps(valid, one));
+    _mm_store_ps(io_x + i, _mm_div_ps(x, safe));
+    _mm_store_ps(io_y + i, _mm_div_ps(y, safe));
+    _mm_store_ps(io_z + i, _mm_div_ps(z, safe));
+  }
+}
+#else
+void MorphKernels::axpySSE(float *o_dst, const float *_src, float _w, size_t _count)
+{
+  axpyScalar(o_dst, _src, _w, _count);
+}
+
+void MorphKernels::normalizeSSE(float *io_x, float *io_y, float *io_z, size_t _count)
+{
+  normalizeScalar(io_x, io_y, io_z, _count);
+}
+#endif
@@ -0,0 +1,325 @@
+#include "MorphLOD.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+// below this cosine between a triangle's normal before and after a collapse the collapse is rejected as a flip
+constexpr double c_minNormalDot = 0.2;
+// stop the chain when a level can't get at least this much smaller than the last
+constexpr double c_minReduction = 0.95;
+
+struct Vec
+{
+  double x, y, z;
+};
+
+Vec operator-(const Vec &_a, const Vec &_b)
+{
+  return {_a.x - _b.x, _a.y - _b.y, _a.z - _b.z};
+}
+
+Vec cross(const Vec &_a, const Vec &_b)
+{
+  return {_a.y * _b.z - _a.z * _b.y, _a.z * _b.x - _a.x * _b.z, _a.x * _b.y - _a.y * _b.x};
+}
+
+double dot(const Vec &_a, const Vec &_b)
+{
+  return _a.x * _b.x + _a.y * _b.y + _a.z * _b.z;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// the symmetric 4x4 plane quadric, the sum of squared distances to a set of planes
+//----------------------------------------------------------------------------------------------------------------------
+struct Quadric
+{
+  double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+  double planes = 0;
+  void addPlane(const Vec &_n, double _d)
+  {
+    planes += 1.0;
+    xx += _n.x * _n.x;
+    xy += _n.x * _n.y;
+    xz += _n.x * _n.z;
+    xw += _n.x * _d;
+    yy += _n.y * _n.y;
+    yz += _n.y * _n.z;
+    yw += _n.y * _d;
+    zz += _n.z * _n.z;
+    zw += _n.z * _d;
+    ww += _d * _d;
+  }
+  void add(const Quadric &_q)
+  {
+    planes += _q.planes;
+    xx += _q.xx;
+    xy += _q.xy;
+    xz += _q.xz;
+    xw += _q.xw;
+    yy += _q.yy;
+    yz += _q.yz;
+    yw += _q.yw;
+    zz += _q.zz;
+    zw += _q.zw;
+    ww += _q.ww;
+  }
+  double evaluate(const Vec &_p) const
+  {
+    double e = xx * _p.x * _p.x + yy * _p.y * _p.y + zz * _p.z * _p.z + ww + 2.0 * (xy * _p.x * _p.y + xz * _p.x * _p.z + yz * _p.y * _p.z + xw * _p.x + yw * _p.y + zw * _p.z);
+    // rounding can take it just below zero, the mean over the planes so it is a squared distance whatever the valence
+    return planes > 0.0 ? std::max(e, 0.0) / planes : 0.0;
+  }
+};
+
+size_t countVerts(const std::vector<uint32_t> &_indices, size_t _numVerts)
+{
+  std::vector<char> used(_numVerts, 0);
+  size_t count = 0;
+  for (auto i : _indices)
+  {
+    if (!used[i])
+    {
+      used[i] = 1;
+      ++count;
+    }
+  }
+  return count;
+}
+} // end anon namespace
+
+void MorphLOD::setBase(const float *_positions, size_t _numVerts, size_t _stride, const uint32_t *_indices, size_t _numIndices)
+{
+  m_positions = _positions;
+  m_numVerts = _numVerts;
+  m_stride = _stride;
+  m_indices = _indices;
+  m_numIndices = _numIndices - _numIndices % 3;
+  m_targets.clear();
+}
+
+void MorphLOD::addTarget(const float *_deltas, size_t _stride)
+{
+  m_targets.push_back({_deltas, _stride});
+}
+
+std::vector<MorphLOD::Level> MorphLOD::build(const Options &_options) const
+{
+  std::vector<Level> levels(1);
+  std::vector<uint32_t> indices(m_indices, m_indices + m_numIndices);
+  levels[0].indices = indices;
+  levels[0].numVerts = countVerts(indices, m_numVerts);
+  if (m_numVerts == 0 || indices.empty())
+    return levels;
+
+  auto position = [this](uint32_t _v)
+  {
+    auto *p = m_positions + _v * m_stride;
+    return Vec{p[0], p[1], p[2]};
+  };
+  auto numTargets = m_targets.size();
+  auto delta = [this](size_t _t, uint32_t _v)
+  {
+    auto *d = m_targets[_t].deltas + _v * m_targets[_t].stride;
+    return Vec{d[0], d[1], d[2]};
+  };
+
+  // the plane quadrics of the full mesh, a collapse adds the removed vertex's quadric to the kept one
+  std::vector<Quadric> quadrics(m_numVerts);
+  std::unordered_map<uint64_t, uint32_t> edgeUse;
+  for (size_t i = 0; i < indices.size(); i += 3)
+  {
+    uint32_t tri[3] = {indices[i], indices[i + 1], indices[i + 2]};
+    auto a = position(tri[0]);
+    auto n = cross(position(tri[1]) - a, position(tri[2]) - a);
+    auto length = std::sqrt(dot(n, n));
+    if (length > 0.0)
+    {
+      n = {n.x / length, n.y / length, n.z / length};
+      for (auto v : tri)
+        quadrics[v].addPlane(n, -dot(n, a));
+    }
+    for (size_t e = 0; e < 3; ++e)
+    {
+      auto v0 = std::min(tri[e], tri[(e + 1) % 3]);
+      auto v1 = std::max(tri[e], tri[(e + 1) % 3]);
+      ++edgeUse[static_cast<uint64_t>(v0) << 32 | v1];
+    }
+  }
+  // a vertex on a border or non manifold edge stays where it is so holes don't open up
+  std::vector<char> locked(m_numVerts, 0);
+  for (auto &e : edgeUse)
+  {
+    if (e.second != 2)
+    {
+      locked[e.first >> 32] = 1;
+      locked[e.first & 0xffffffff] = 1;
+    }
+  }
+  // for the target error each vertex keeps the number of original vertices it stands for, the sum of their deltas
+  // per target and the sum of all their squared deltas, so the error of them all taking another delta is closed form
+  std::vector<double> represented(m_numVerts, 1.0);
+  std::vector<Vec> deltaSums(m_numVerts * numTargets);
+  std::vector<double> deltaSquares(m_numVerts, 0.0);
+  for (uint32_t v = 0; v < m_numVerts; ++v)
+  {
+    for (size_t t = 0; t < numTargets; ++t)
+    {
+      auto d = delta(t, v);
+      deltaSums[v * numTargets + t] = d;
+      deltaSquares[v] += dot(d, d);
+    }
+  }
+  auto cost = [&](uint32_t _from, uint32_t _to)
+  {
+    double targetError = deltaSquares[_from];
+    for (size_t t = 0; t < numTargets; ++t)
+    {
+      auto d = delta(t, _to);
+      targetError += represented[_from] * dot(d, d) - 2.0 * dot(d, deltaSums[_from * numTargets + t]);
+    }
+    return quadrics[_from].evaluate(position(_to)) + _options.deltaWeight * std::max(targetError, 0.0) / represented[_from];
+  };
+
+  struct Collapse
+  {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+  };
+  std::vector<uint32_t> triOffsets(m_numVerts + 1);
+  std::vector<uint32_t> vertTris;
+  std::vector<uint64_t> edges;
+  std::vector<Collapse> collapses;
+  std::vector<char> touched(m_numVerts);
+  double maxCost = 0.0;
+  // one pass collapses the cheapest edges whose neighbourhoods don't overlap, returns the number of collapses
+  auto pass = [&](size_t _targetTriangles)
+  {
+    auto numTris = indices.size() / 3;
+    std::fill(triOffsets.begin(), triOffsets.end(), 0);
+    for (auto i : indices)
+      ++triOffsets[i + 1];
+    for (size_t v = 0; v < m_numVerts; ++v)
+      triOffsets[v + 1] += triOffsets[v];
+    vertTris.resize(indices.size());
+    {
+      auto fill = triOffsets;
+      for (size_t i = 0; i < indices.size(); ++i)
+        vertTris[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+    edges.clear();
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      for (size_t e = 0; e < 3; ++e)
+      {
+        auto v0 = std::min(indices[i + e], indices[i + (e + 1) % 3]);
+        auto v1 = std::max(indices[i + e], indices[i + (e + 1) % 3]);
+        edges.push_back(static_cast<uint64_t>(v0) << 32 | v1);
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    collapses.clear();
+    for (auto e : edges)
+    {
+      auto v0 = static_cast<uint32_t>(e >> 32);
+      auto v1 = static_cast<uint32_t>(e & 0xffffffff);
+      // the cheaper direction that is allowed
+      auto c01 = locked[v0] ? -1.0 : cost(v0, v1);
+      auto c10 = locked[v1] ? -1.0 : cost(v1, v0);
+      if (c01 >= 0.0 && (c10 < 0.0 || c01 <= c10))
+        collapses.push_back({v0, v1, c01});
+      else if (c10 >= 0.0)
+        collapses.push_back({v1, v0, c10});
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse &_a, const Collapse &_b) { return _a.cost < _b.cost; });
+
+    std::fill(touched.begin(), touched.end(), 0);
+    size_t done = 0;
+    for (auto &c : collapses)
+    {
+      if (numTris <= _targetTriangles)
+        break;
+      if (touched[c.from] || touched[c.to])
+        continue;
+      // the triangles that keep going must not flip or fold over
+      bool flips = false;
+      size_t removed = 0;
+      auto to = position(c.to);
+      for (auto t = triOffsets[c.from]; t < triOffsets[c.from + 1] && !flips; ++t)
+      {
+        auto *tri = &indices[vertTris[t] * 3];
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+        {
+          ++removed;
+          continue;
+        }
+        Vec p[3] = {position(tri[0]), position(tri[1]), position(tri[2])};
+        auto before = cross(p[1] - p[0], p[2] - p[0]);
+        for (size_t k = 0; k < 3; ++k)
+        {
+          if (tri[k] == c.from)
+            p[k] = to;
+        }
+        auto after = cross(p[1] - p[0], p[2] - p[0]);
+        auto lengths = std::sqrt(dot(before, before) * dot(after, after));
+        flips = lengths == 0.0 || dot(before, after) < c_minNormalDot * lengths;
+      }
+      if (flips)
+        continue;
+      for (auto t = triOffsets[c.from]; t < triOffsets[c.from + 1]; ++t)
+      {
+        auto *tri = &indices[vertTris[t] * 3];
+        for (size_t k = 0; k < 3; ++k)
+        {
+          touched[tri[k]] = 1;
+          if (tri[k] == c.from)
+            tri[k] = c.to;
+        }
+      }
+      quadrics[c.to].add(quadrics[c.from]);
+      represented[c.to] += represented[c.from];
+      deltaSquares[c.to] += deltaSquares[c.from];
+      for (size_t t = 0; t < numTargets; ++t)
+      {
+        auto &sum = deltaSums[c.to * numTargets + t];
+        auto &add = deltaSums[c.from * numTargets + t];
+        sum = {sum.x + add.x, sum.y + add.y, sum.z + add.z};
+      }
+      maxCost = std::max(maxCost, c.cost);
+      numTris -= removed;
+      ++done;
+    }
+    // drop the triangles that lost a corner
+    size_t out = 0;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+      if (indices[i] == indices[i + 1] || indices[i + 1] == indices[i + 2] || indices[i] == indices[i + 2])
+        continue;
+      std::copy(&indices[i], &indices[i] + 3, &indices[out]);
+      out += 3;
+    }
+    indices.resize(out);
+    return done;
+  };
+
+  while (levels.size() < _options.maxLevels)
+  {
+    auto triangles = indices.size() / 3;
+    auto target = std::max(_options.minTriangles, static_cast<size_t>(triangles * _options.ratio));
+    if (target >= triangles)
+      break;
+    while (indices.size() / 3 > target && pass(target) > 0)
+      ;
+    if (indices.size() / 3 > triangles * c_minReduction)
+      break;
+    Level level;
+    level.indices = indices;
+    level.error = static_cast<float>(std::sqrt(maxCost));
+    level.numVerts = countVerts(indices, m_numVerts);
+    levels.push_back(std::move(level));
+  }
+  return levels;
+}
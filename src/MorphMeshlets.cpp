@@ -0,0 +1,291 @@
+#include "MorphMeshlets.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+// a cone this wide (or wider) faces every way so the meshlet is never back face culled
+constexpr float c_halfPi = 1.57079632679f;
+
+struct Vec
+{
+  float x, y, z;
+};
+
+Vec operator-(const Vec &_a, const Vec &_b)
+{
+  return {_a.x - _b.x, _a.y - _b.y, _a.z - _b.z};
+}
+
+Vec operator+(const Vec &_a, const Vec &_b)
+{
+  return {_a.x + _b.x, _a.y + _b.y, _a.z + _b.z};
+}
+
+Vec cross(const Vec &_a, const Vec &_b)
+{
+  return {_a.y * _b.z - _a.z * _b.y, _a.z * _b.x - _a.x * _b.z, _a.x * _b.y - _a.y * _b.x};
+}
+
+float dot(const Vec &_a, const Vec &_b)
+{
+  return _a.x * _b.x + _a.y * _b.y + _a.z * _b.z;
+}
+
+float length(const Vec &_a)
+{
+  return std::sqrt(dot(_a, _a));
+}
+
+Vec normalised(const Vec &_a)
+{
+  auto l = length(_a);
+  return l > 0.0f ? Vec{_a.x / l, _a.y / l, _a.z / l} : Vec{0.0f, 0.0f, 0.0f};
+}
+
+float angleBetween(const Vec &_a, const Vec &_b)
+{
+  return std::acos(std::clamp(dot(_a, _b), -1.0f, 1.0f));
+}
+} // end anon namespace
+
+void MorphMeshlets::setBase(const float *_positions, size_t _numVerts, size_t _stride, const uint32_t *_indices, size_t _numIndices)
+{
+  m_positions = _positions;
+  m_numVerts = _numVerts;
+  m_stride = _stride;
+  m_indices = _indices;
+  m_numIndices = _numIndices - _numIndices % 3;
+  m_targets.clear();
+}
+
+void MorphMeshlets::addTarget(const float *_deltas, size_t _stride)
+{
+  m_targets.push_back({_deltas, _stride});
+}
+
+void MorphMeshlets::build(const Options &_options)
+{
+  m_outIndices.clear();
+  m_meshlets.clear();
+  m_targetBounds.clear();
+  auto numTris = m_numIndices / 3;
+  if (numTris == 0)
+    return;
+  auto position = [this](uint32_t _v)
+  {
+    auto *p = m_positions + _v * m_stride;
+    return Vec{p[0], p[1], p[2]};
+  };
+  auto delta = [this](size_t _t, uint32_t _v)
+  {
+    auto *d = m_targets[_t].deltas + _v * m_targets[_t].stride;
+    return Vec{d[0], d[1], d[2]};
+  };
+  auto faceNormal = [this](size_t _tri, auto &&_p)
+  {
+    auto a = _p(m_indices[_tri * 3]);
+    return normalised(cross(_p(m_indices[_tri * 3 + 1]) - a, _p(m_indices[_tri * 3 + 2]) - a));
+  };
+
+  // the triangles around each vertex, to find the neighbours of a growing meshlet
+  std::vector<uint32_t> triOffsets(m_numVerts + 1, 0);
+  for (size_t i = 0; i < m_numIndices; ++i)
+    ++triOffsets[m_indices[i] + 1];
+  for (size_t v = 0; v < m_numVerts; ++v)
+    triOffsets[v + 1] += triOffsets[v];
+  std::vector<uint32_t> vertTris(m_numIndices);
+  {
+    auto fill = triOffsets;
+    for (size_t i = 0; i < m_numIndices; ++i)
+      vertTris[fill[m_indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+  std::vector<Vec> normals(numTris);
+  for (size_t t = 0; t < numTris; ++t)
+    normals[t] = faceNormal(t, position);
+
+  // grow each meshlet from the first unused triangle, always adding the neighbour that brings in the fewest new
+  // vertices and then the one facing closest to the meshlet's average normal, so meshlets are compact and flat.
+  // Triangles facing too far from the average are left for another meshlet so the normal cones stay narrow.
+  std::vector<char> used(numTris, 0);
+  std::vector<uint32_t> vertexMark(m_numVerts, 0);
+  uint32_t mark = 0;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> tris;
+  std::vector<uint32_t> verts;
+  size_t seed = 0;
+  while (true)
+  {
+    while (seed < numTris && used[seed])
+      ++seed;
+    if (seed == numTris)
+      break;
+    ++mark;
+    tris.clear();
+    verts.clear();
+    candidates.clear();
+    Vec normalSum{0.0f, 0.0f, 0.0f};
+    auto add = [&](uint32_t _tri)
+    {
+      used[_tri] = 1;
+      tris.push_back(_tri);
+      normalSum = normalSum + normals[_tri];
+      for (size_t k = 0; k < 3; ++k)
+      {
+        auto v = m_indices[_tri * 3 + k];
+        if (vertexMark[v] == mark)
+          continue;
+        vertexMark[v] = mark;
+        verts.push_back(v);
+        for (auto t = triOffsets[v]; t < triOffsets[v + 1]; ++t)
+        {
+          if (!used[vertTris[t]])
+            candidates.push_back(vertTris[t]);
+        }
+      }
+    };
+    add(static_cast<uint32_t>(seed));
+    while (tris.size() < _options.maxTriangles)
+    {
+      auto axis = normalised(normalSum);
+      size_t best = candidates.size();
+      int bestNew = 4;
+      float bestDot = -2.0f;
+      for (size_t c = 0; c < candidates.size(); ++c)
+      {
+        auto tri = candidates[c];
+        if (used[tri])
+          continue;
+        int fresh = 0;
+        for (size_t k = 0; k < 3; ++k)
+          fresh += vertexMark[m_indices[tri * 3 + k]] != mark;
+        auto facing = dot(axis, normals[tri]);
+        if (facing < _options.minFacing)
+          continue;
+        if (fresh < bestNew || (fresh == bestNew && facing > bestDot))
+        {
+          best = c;
+          bestNew = fresh;
+          bestDot = facing;
+        }
+      }
+      if (best == candidates.size() || verts.size() + bestNew > _options.maxVertices)
+        break;
+      auto tri = candidates[best];
+      candidates[best] = candidates.back();
+      candidates.pop_back();
+      add(tri);
+      // the list collects used triangles as the meshlet grows, drop them now and then
+      if (candidates.size() > 4 * _options.maxTriangles)
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&used](uint32_t _t) { return used[_t] != 0; }), candidates.end());
+    }
+
+    Meshlet meshlet;
+    meshlet.firstIndex = static_cast<uint32_t>(m_outIndices.size());
+    meshlet.numIndices = static_cast<uint32_t>(tris.size() * 3);
+    for (auto t : tris)
+      m_outIndices.insert(m_outIndices.end(), m_indices + t * 3, m_indices + t * 3 + 3);
+    // the sphere is centred on the box of the vertices
+    Vec low = position(verts[0]);
+    Vec high = low;
+    for (auto v : verts)
+    {
+      auto p = position(v);
+      low = {std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z)};
+      high = {std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z)};
+    }
+    Vec centre{0.5f * (low.x + high.x), 0.5f * (low.y + high.y), 0.5f * (low.z + high.z)};
+    for (auto v : verts)
+      meshlet.radius = std::max(meshlet.radius, length(position(v) - centre));
+    auto axis = normalised(normalSum);
+    meshlet.minHeight = std::numeric_limits<float>::max();
+    for (auto t : tris)
+    {
+      meshlet.coneAngle = std::max(meshlet.coneAngle, angleBetween(axis, normals[t]));
+      // twice the area over the longest edge
+      auto a = position(m_indices[t * 3]);
+      auto b = position(m_indices[t * 3 + 1]);
+      auto c = position(m_indices[t * 3 + 2]);
+      auto longest = std::max({length(b - a), length(c - b), length(a - c)});
+      meshlet.minHeight = std::min(meshlet.minHeight, longest > 0.0f ? length(cross(b - a, c - a)) / longest : 0.0f);
+    }
+    // a meshlet folded over on itself has no useful axis
+    if (length(axis) == 0.0f)
+      meshlet.coneAngle = c_halfPi;
+    meshlet.centre[0] = centre.x;
+    meshlet.centre[1] = centre.y;
+    meshlet.centre[2] = centre.z;
+    meshlet.coneAxis[0] = axis.x;
+    meshlet.coneAxis[1] = axis.y;
+    meshlet.coneAxis[2] = axis.z;
+    m_meshlets.push_back(meshlet);
+
+    for (size_t t = 0; t < m_targets.size(); ++t)
+    {
+      TargetBound bound;
+      for (auto v : verts)
+        bound.maxDelta = std::max(bound.maxDelta, length(delta(t, v)));
+      m_targetBounds.push_back(bound);
+    }
+  }
+}
+
+void MorphMeshlets::cull(const float *_mvp, const float *_eye, const float *_weights, std::vector<uint32_t> &o_visible) const
+{
+  o_visible.clear();
+  // the six clip planes are row 3 plus / minus rows 0-2, _mvp is column major so row r is _mvp[c*4+r]
+  float planes[6][4];
+  for (size_t p = 0; p < 6; ++p)
+  {
+    auto row = p / 2;
+    float sign = p % 2 == 0 ? 1.0f : -1.0f;
+    for (size_t c = 0; c < 4; ++c)
+      planes[p][c] = _mvp[c * 4 + 3] + sign * _mvp[c * 4 + row];
+    auto l = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+    if (l > 0.0f)
+    {
+      for (size_t c = 0; c < 4; ++c)
+        planes[p][c] /= l;
+    }
+  }
+  Vec eye{_eye[0], _eye[1], _eye[2]};
+  auto numTargets = m_targets.size();
+  for (size_t m = 0; m < m_meshlets.size(); ++m)
+  {
+    auto &meshlet = m_meshlets[m];
+    // grow the base bounds by how far the active targets can move the meshlet
+    auto *bounds = &m_targetBounds[m * numTargets];
+    float moved = 0.0f;
+    for (size_t t = 0; t < numTargets; ++t)
+      moved += std::abs(_weights[t]) * bounds[t].maxDelta;
+    auto radius = meshlet.radius + moved;
+    auto coneAngle = meshlet.coneAngle;
+    if (moved > 0.0f)
+    {
+      // holding one corner still the other two move at most 2 * moved, which changes the cross product of the edges
+      // e1 x e2 by at most 2 * moved * (|e1| + |e2|) + 4 * moved^2. Against |e1 x e2| (an edge times its height,
+      // at least minHeight^2) that is at most (1 + 2 * moved / minHeight)^2 - 1, the sine of the largest tilt
+      auto ratio = meshlet.minHeight > 0.0f ? 2.0f * moved / meshlet.minHeight : 1.0f;
+      auto tilt = (1.0f + ratio) * (1.0f + ratio) - 1.0f;
+      coneAngle = tilt < 1.0f ? coneAngle + std::asin(tilt) : c_halfPi;
+    }
+    Vec centre{meshlet.centre[0], meshlet.centre[1], meshlet.centre[2]};
+    bool inside = true;
+    for (size_t p = 0; p < 6 && inside; ++p)
+      inside = planes[p][0] * centre.x + planes[p][1] * centre.y + planes[p][2] * centre.z + planes[p][3] >= -radius;
+    if (!inside)
+      continue;
+    // every triangle faces away if the directions to all points of the sphere are within 90 degrees of all the
+    // normals, sin(coneAngle) + radius / distance is a safe bound for the sine of the sum of the two half angles
+    if (coneAngle < c_halfPi)
+    {
+      auto toCentre = centre - eye;
+      auto distance = length(toCentre);
+      Vec axis{meshlet.coneAxis[0], meshlet.coneAxis[1], meshlet.coneAxis[2]};
+      if (distance > radius && dot(toCentre, axis) >= (std::sin(coneAngle) * distance + radius))
+        continue;
+    }
+    o_visible.push_back(static_cast<uint32_t>(m));
+  }
+}
@@ -0,0 +1,691 @@
+#include "MorphTargetSet.h"
+#include "MorphCache.h"
+#include "MeshOptimiser.h"
+#include "MorphEngine.h"
+#include "PoseSetLoader.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+// this is written to the cache as is so make sure the compiler hasn't padded it
+static_assert(sizeof(vertData) == 6 * sizeof(GLfloat), "vertData must be tightly packed");
+static_assert(sizeof(MorphTargetSet::ActiveTarget) == 8 * sizeof(GLfloat), "ActiveTarget must match the std140 struct");
+
+MorphTargetSet::MorphTargetSet() = default;
+MorphTargetSet::~MorphTargetSet() = default;
+
+bool MorphTargetSet::load(const std::vector<std::string> &_poseFiles, std::string_view _cacheFile)
+{
+  PROFILE_ZONE("MorphTargetSet::load");
+  m_loadProgress = 0.0f;
+  if (_poseFiles.size() < 2)
+  {
+    std::cerr << "Need a base pose and at least one target\n";
+    return false;
+  }
+  m_cache = std::make_unique<MorphCache>(_cacheFile, _poseFiles);
+  if (m_cache->load())
+  {
+    auto verts = m_cache->section(MorphCache::Section::VERTDATA);
+    auto targets = m_cache->section(MorphCache::Section::TARGETS);
+    auto indices = m_cache->section(MorphCache::Section::INDICES);
+    size_t numTargets = _poseFiles.size() - 1;
+    if (verts.count != 0 && verts.size == verts.count * sizeof(vertData) && indices.count != 0 &&
+        targets.count == verts.count * numTargets * 2)
+    {
+      // the data is used directly from the mapped file so no obj parsing at all
+      std::cout << "Loaded morph mesh from cache " << _cacheFile << " (no obj parse)\n";
+      m_verts = static_cast<const vertData *>(verts.data);
+      m_deltas = static_cast<const ngl::Vec3 *>(targets.data);
+      m_indices = static_cast<const GLuint *>(indices.data);
+      m_numVerts = verts.count;
+      m_numIndices = indices.count;
+      m_weights.assign(numTargets, 0.0f);
+      m_weightsDirty = true;
+      m_loadProgress = 1.0f;
+      return true;
+    }
+  }
+  std::cout << "Building morph mesh from obj files\n";
+  if (!build(_poseFiles))
+    return false;
+
+  // store the packed data so the next run can skip the build
+  m_cache = std::make_unique<MorphCache>(_cacheFile, _poseFiles);
+  m_cache->addSection(MorphCache::Section::VERTDATA, m_ownVerts.data(), m_ownVerts.size() * sizeof(vertData), m_ownVerts.size());
+  m_cache->addSection(MorphCache::Section::TARGETS, m_ownDeltas.data(), m_ownDeltas.size() * sizeof(ngl::Vec3), m_ownDeltas.size());
+  m_cache->addSection(MorphCache::Section::INDICES, m_ownIndices.data(), m_ownIndices.size() * sizeof(GLuint), m_ownIndices.size());
+  if (!m_cache->write())
+  {
+    std::cerr << "Unable to write morph cache " << _cacheFile << '\n';
+  }
+  m_cache.reset();
+  return true;
+}
+
+const std::vector<std::string> &MorphTargetSet::defaultPoseFiles()
+{
+  static const std::vector<std::string> poseFiles{"models/BrucePose1.obj", "models/BrucePose2.obj", "models/BrucePose3.obj"};
+  return poseFiles;
+}
+
+std::string MorphTargetSet::cacheFileName(const std::vector<std::string> &_poseFiles)
+{
+  auto name = _poseFiles[0];
+  auto dot = name.find_last_of('.');
+  if (dot != std::string::npos && name.find_first_of("/\\", dot) == std::string::npos)
+    name.erase(dot);
+  return name + ".mtbo";
+}
+
+void MorphTargetSet::loadEngine(MorphEngine &o_engine) const
+{
+  // the vertData / delta pairs are interleaved so both halves are 6 floats apart
+  o_engine.setBase(&m_verts[0].p1.m_x, &m_verts[0].n1.m_x, m_numVerts, 6);
+  for (size_t t = 0; t < numTargets(); ++t)
+  {
+    auto *deltas = m_deltas + t * m_numVerts * 2;
+    o_engine.addTarget(&deltas[0].m_x, &deltas[1].m_x, 6);
+  }
+}
+
+bool MorphTargetSet::build(const std::vector<std::string> &_poseFiles)
+{
+  PROFILE_ZONE("obj load");
+  // the files (and big files in chunks) are parsed in parallel straight into the arrays pack uses
+  ThreadPool pool;
+  PoseSetLoader loader(pool);
+  loader.setProgress([this](float _done) { m_loadProgress.store(_done, std::memory_order_relaxed); });
+  if (!loader.load(_poseFiles))
+    return false;
+  pack(loader.base(), loader.corners(), loader.targets());
+  return true;
+}
+
+void MorphTargetSet::pack(const Pose &_base, const std::vector<Corner> &_corners, const std::vector<Pose> &_targets)
+{
+  PROFILE_ZONE("MorphTargetSet::pack");
+  // each face corner is a (position, normal) index pair, as the face list is shared by all the poses the same
+  // pair always refers to the same data in every pose so we can weld on the pair and only store each vertex once.
+  // The welded vertices that use a position are chained from head so a lookup only checks the normals that position
+  // is used with, normally one to four.
+  constexpr GLuint none = ~GLuint(0);
+  std::vector<Corner> corners;
+  std::vector<GLuint> head(_base.verts.size(), none);
+  std::vector<GLuint> next;
+  corners.reserve(_base.verts.size());
+  next.reserve(_base.verts.size());
+  m_ownIndices.resize(_corners.size());
+  for (size_t i = 0; i < _corners.size(); ++i)
+  {
+    auto &c = _corners[i];
+    auto found = head[c.vert];
+    while (found != none && corners[found].normal != c.normal)
+      found = next[found];
+    if (found == none)
+    {
+      found = static_cast<GLuint>(corners.size());
+      corners.push_back(c);
+      next.push_back(head[c.vert]);
+      head[c.vert] = found;
+    }
+    m_ownIndices[i] = found;
+  }
+  size_t numVerts = corners.size();
+  // reorder the triangles for the post-transform cache and number the vertices in the order they are first used,
+  // the VBO and every target's deltas are packed in that order so the vertex and texelFetch reads walk through memory
+  auto before = MeshOptimiser::simulate(m_ownIndices.data(), m_ownIndices.size(), numVerts);
+  MeshOptimiser::optimiseVertexCache(m_ownIndices.data(), m_ownIndices.size(), numVerts);
+  auto remap = MeshOptimiser::fetchRemap(m_ownIndices.data(), m_ownIndices.size(), numVerts);
+  std::vector<Corner> ordered(numVerts);
+  for (size_t i = 0; i < numVerts; ++i)
+    ordered[remap[i]] = corners[i];
+  corners.swap(ordered);
+  for (auto &i : m_ownIndices)
+    i = remap[i];
+  auto after = MeshOptimiser::simulate(m_ownIndices.data(), m_ownIndices.size(), numVerts);
+  std::cout << "Vertex cache (FIFO " << MeshOptimiser::c_defaultCacheSize << ") ACMR " << before.acmr << " -> " << after.acmr << " ATVR "
+            << before.atvr << " -> " << after.atvr << '\n';
+  m_ownVerts.resize(numVerts);
+  for (size_t i = 0; i < numVerts; ++i)
+  {
+    m_ownVerts[i].p1 = _base.verts[corners[i].vert];
+    m_ownVerts[i].n1 = _base.normals[corners[i].normal];
+  }
+
+  size_t numTargets = _targets.size();
+  m_ownDeltas.assign(numVerts * numTargets * 2, ngl::Vec3(0.0f, 0.0f, 0.0f));
+  for (size_t t = 0; t < numTargets; ++t)
+  {
+    auto &pose = _targets[t];
+    if (pose.verts.size() != _base.verts.size() || pose.normals.size() != _base.normals.size())
+      continue;
+    // the blend meshes are just the differences so we subtract the base mesh
+    // from the current one (could do this on GPU but this saves processing time)
+    auto *out = &m_ownDeltas[t * numVerts * 2];
+    for (size_t i = 0; i < numVerts; ++i)
+    {
+      out[2 * i] = pose.verts[corners[i].vert] - m_ownVerts[i].p1;
+      out[2 * i + 1] = pose.normals[corners[i].normal] - m_ownVerts[i].n1;
+    }
+  }
+
+  // report how much the welding saved over one vertex (and its deltas) per face corner
+  size_t perVertex = sizeof(vertData) + numTargets * 2 * sizeof(ngl::Vec3);
+  size_t soupBytes = m_ownIndices.size() * perVertex;
+  size_t weldedBytes = numVerts * perVertex + m_ownIndices.size() * sizeof(GLuint);
+  std::cout << "Morph mesh welded " << m_ownIndices.size() << " corners to " << numVerts << " vertices with " << numTargets
+            << " targets, " << soupBytes << " bytes -> " << weldedBytes << " bytes (VBO " << numVerts * sizeof(vertData) << " TBO "
+            << m_ownDeltas.size() * sizeof(ngl::Vec3) << " index " << m_ownIndices.size() * sizeof(GLuint) << ")\n";
+
+  m_verts = m_ownVerts.data();
+  m_deltas = m_ownDeltas.data();
+  m_indices = m_ownIndices.data();
+  m_numVerts = numVerts;
+  m_numIndices = m_ownIndices.size();
+  m_weights.assign(numTargets, 0.0f);
+  m_weightsDirty = true;
+}
+
+void MorphTargetSet::setWeight(size_t _target, ngl::Real _w)
+{
+  // clamp to 0.0 -> 1.0 range
+  _w = std::min(1.0f, std::max(0.0f, _w));
+  if (_target < m_weights.size() && m_weights[_target] != _w)
+  {
+    m_weights[_target] = _w;
+    m_weightsDirty = true;
+  }
+}
+
+bool MorphTargetSet::updateActive()
+{
+  if (!m_weightsDirty)
+    return false;
+  m_weightsDirty = false;
+  m_active.clear();
+  // the shader blends shapes, a shape's weight can be negative or above one when the targets are folded in
+  if (m_useBasis)
+  {
+    m_shapeWeights.resize(m_basis.numShapes());
+    m_basis.fold(m_weights.data(), m_shapeWeights.data());
+  }
+  auto &weights = m_useBasis ? m_shapeWeights : m_weights;
+  for (size_t i = 0; i < weights.size(); ++i)
+  {
+    if (weights[i] != 0.0f)
+    {
+      ActiveTarget a;
+      a.index = static_cast<GLfloat>(i);
+      a.weight = weights[i];
+      m_active.push_back(a);
+    }
+  }
+  if (m_active.size() > c_maxActiveTargets)
+  {
+    // keep the targets that contribute the most
+    std::partial_sort(m_active.begin(), m_active.begin() + c_maxActiveTargets, m_active.end(),
+                      [](const ActiveTarget &_a, const ActiveTarget &_b)
+                      { return std::abs(_a.weight) > std::abs(_b.weight); });
+    m_active.resize(c_maxActiveTargets);
+    std::cerr << "More than " << c_maxActiveTargets << " active targets, dropping the smallest weights\n";
+  }
+  // fold the weight into the decode range, w*(q*scale+bias) = q*(w*scale) + w*bias and the bias part is the
+  // same for every vertex so it can be summed here once
+  m_activePosBias.set(0.0f, 0.0f, 0.0f);
+  m_activeNormalBias.set(0.0f, 0.0f, 0.0f);
+  for (auto &a : m_active)
+  {
+    DeltaRange range;
+    if (!m_ranges.empty())
+      range = m_ranges[static_cast<size_t>(a.index)];
+    auto posScale = a.weight * range.posScale;
+    auto normalScale = a.weight * range.normalScale;
+    std::memcpy(a.posScale, posScale.m_openGL, sizeof(a.posScale));
+    std::memcpy(a.normalScale, normalScale.m_openGL, sizeof(a.normalScale));
+    m_activePosBias += a.weight * range.posBias;
+    m_activeNormalBias += a.weight * range.normalBias;
+  }
+  return true;
+}
+
+void MorphTargetSet::buildSparse(ngl::Real _threshold)
+{
+  PROFILE_ZONE("MorphTargetSet::buildSparse");
+  auto moved = [_threshold](const ngl::Vec3 &_d)
+  { return std::abs(_d.m_x) > _threshold || std::abs(_d.m_y) > _threshold || std::abs(_d.m_z) > _threshold; };
+
+  m_sparse.assign(numTargets(), SparseTarget());
+  size_t sparseBytes = 0;
+  for (size_t t = 0; t < numTargets(); ++t)
+  {
+    auto &sparse = m_sparse[t];
+    auto *dense = &m_deltas[t * m_numVerts * 2];
+    for (size_t i = 0; i < m_numVerts; ++i)
+    {
+      if (moved(dense[2 * i]) || moved(dense[2 * i + 1]))
+      {
+        sparse.indices.push_back(static_cast<GLuint>(i));
+        sparse.deltas.push_back(dense[2 * i]);
+        sparse.deltas.push_back(dense[2 * i + 1]);
+      }
+    }
+    sparse.indices.shrink_to_fit();
+    sparse.deltas.shrink_to_fit();
+    auto bytes = sparse.indices.size() * sizeof(GLuint) + sparse.deltas.size() * sizeof(ngl::Vec3);
+    sparseBytes += bytes;
+    std::cout << "Target " << t << " moves " << sparse.indices.size() << " of " << m_numVerts << " vertices ("
+              << 100.0 * sparse.indices.size() / std::max<size_t>(m_numVerts, 1) << "%) sparse " << bytes << " bytes dense "
+              << m_numVerts * 2 * sizeof(ngl::Vec3) << " bytes\n";
+  }
+  std::cout << "Sparse targets " << sparseBytes << " bytes dense " << deltaBytes() << " bytes\n";
+
+  m_morphed.assign(m_verts, m_verts + m_numVerts);
+  m_touched.clear();
+  m_touchedFlag.assign(m_numVerts, 0);
+}
+
+void MorphTargetSet::buildLODs(const MorphLOD::Options &_options)
+{
+  PROFILE_ZONE("MorphTargetSet::buildLODs");
+  // vertData and the position / normal delta pairs are both six floats per vertex
+  constexpr size_t stride = sizeof(vertData) / sizeof(ngl::Real);
+  MorphLOD lod;
+  lod.setBase(&m_verts[0].p1.m_x, m_numVerts, stride, m_indices, m_numIndices);
+  for (size_t t = 0; t < numTargets(); ++t)
+  {
+    lod.addTarget(&m_deltas[t * m_numVerts * 2].m_x, stride);
+  }
+  auto levels = lod.build(_options);
+  m_lodIndices.clear();
+  m_lods.clear();
+  for (auto &level : levels)
+  {
+    // the collapses leave the triangles in the full mesh's order with holes in it, so each level is reordered again
+    if (!m_lods.empty())
+      MeshOptimiser::optimiseVertexCache(level.indices.data(), level.indices.size(), m_numVerts);
+    m_lods.push_back({m_lodIndices.size(), level.indices.size(), level.error, level.numVerts});
+    m_lodIndices.insert(m_lodIndices.end(), level.indices.begin(), level.indices.end());
+    auto cache = MeshOptimiser::simulate(level.indices.data(), level.indices.size(), m_numVerts);
+    std::cout << "LOD " << m_lods.size() - 1 << " " << level.indices.size() / 3 << " triangles " << level.numVerts
+              << " vertices error " << level.error << " ACMR " << cache.acmr << " ATVR " << cache.atvr << '\n';
+  }
+
+  // centred on the base pose box, the radius grows by each vertex's largest possible displacement
+  ngl::Vec3 low(std::numeric_limits<ngl::Real>::max(), std::numeric_limits<ngl::Real>::max(), std::numeric_limits<ngl::Real>::max());
+  ngl::Vec3 high = -low;
+  for (size_t i = 0; i < m_numVerts; ++i)
+  {
+    auto &p = m_verts[i].p1;
+    low.set(std::min(low.m_x, p.m_x), std::min(low.m_y, p.m_y), std::min(low.m_z, p.m_z));
+    high.set(std::max(high.m_x, p.m_x), std::max(high.m_y, p.m_y), std::max(high.m_z, p.m_z));
+  }
+  m_boundsCentre = m_numVerts > 0 ? (low + high) * 0.5f : ngl::Vec3();
+  m_boundsRadius = 0.0f;
+  for (size_t i = 0; i < m_numVerts; ++i)
+  {
+    auto r = (m_verts[i].p1 - m_boundsCentre).length();
+    for (size_t t = 0; t < numTargets(); ++t)
+    {
+      r += m_deltas[2 * (t * m_numVerts + i)].length();
+    }
+    m_boundsRadius = std::max(m_boundsRadius, r);
+  }
+}
+
+void MorphTargetSet::buildMeshlets(const MorphMeshlets::Options &_options)
+{
+  PROFILE_ZONE("MorphTargetSet::buildMeshlets");
+  constexpr size_t stride = sizeof(vertData) / sizeof(ngl::Real);
+  m_meshlets.setBase(&m_verts[0].p1.m_x, m_numVerts, stride, m_indices, m_numIndices);
+  for (size_t t = 0; t < numTargets(); ++t)
+  {
+    m_meshlets.addTarget(&m_deltas[t * m_numVerts * 2].m_x, stride);
+  }
+  m_meshlets.build(_options);
+  // level 0 is the first range of lodIndices and has the same triangles in meshlet order
+  auto &indices = m_meshlets.indices();
+  if (m_lodIndices.size() < indices.size())
+    m_lodIndices.resize(indices.size());
+  std::copy(indices.begin(), indices.end(), m_lodIndices.begin());
+  // the meshlets are grown for culling, not for the cache, so the triangles inside each are put back in cache order.
+  // Each is numbered 0..k-1 first so the optimiser only sets up the meshlet's own vertices, not the whole mesh's.
+  constexpr GLuint unused = ~GLuint(0);
+  std::vector<GLuint> local(m_numVerts, unused);
+  std::vector<GLuint> global;
+  std::vector<uint32_t> meshletIndices;
+  for (auto &meshlet : m_meshlets.meshlets())
+  {
+    auto *tris = &m_lodIndices[meshlet.firstIndex];
+    global.clear();
+    meshletIndices.resize(meshlet.numIndices);
+    for (size_t i = 0; i < meshlet.numIndices; ++i)
+    {
+      if (local[tris[i]] == unused)
+      {
+        local[tris[i]] = static_cast<GLuint>(global.size());
+        global.push_back(tris[i]);
+      }
+      meshletIndices[i] = local[tris[i]];
+    }
+    MeshOptimiser::optimiseVertexCache(meshletIndices.data(), meshletIndices.size(), global.size());
+    for (size_t i = 0; i < meshlet.numIndices; ++i)
+      tris[i] = global[meshletIndices[i]];
+    for (auto v : global)
+      local[v] = unused;
+  }
+  auto cache = MeshOptimiser::simulate(m_lodIndices.data(), indices.size(), m_numVerts);
+  auto count = std::max<size_t>(m_meshlets.meshlets().size(), 1);
+  std::cout << "Meshlets " << m_meshlets.meshlets().size() << " averaging " << indices.size() / 3.0 / count << " triangles, ACMR "
+            << cache.acmr << " ATVR " << cache.atvr << '\n';
+}
+
+bool MorphTargetSet::buildBasis(const MorphBasis::Options &_options)
+{
+  PROFILE_ZONE("MorphTargetSet::buildBasis");
+  m_basis.setVertexCount(m_numVerts);
+  for (size_t t = 0; t < numTargets(); ++t)
+  {
+    m_basis.addTarget(&m_deltas[t * m_numVerts * 2].m_x);
+  }
+  // a blend can use every shape so they all have to fit in the active list
+  auto options = _options;
+  options.maxShapes = std::min(options.maxShapes, c_maxActiveTargets);
+  m_basis.build(options);
+  auto &target = m_basis.targetError();
+  auto &blend = m_basis.blendError();
+  std::cout << "Basis " << m_basis.numShapes() << " shapes for " << numTargets() << " targets, compression "
+            << m_basis.compressionRatio() << ":1\n";
+  std::cout << "Basis single target position error max " << target.maxPosition << " rms " << target.rmsPosition << " normal error max "
+            << target.maxNormal << " rms " << target.rmsNormal << '\n';
+  std::cout << "Basis all targets blend position error max " << blend.maxPosition << " rms " << blend.rmsPosition
+            << " normal error max " << blend.maxNormal << " rms " << blend.rmsNormal << '\n';
+  m_useBasis = m_basis.numShapes() > 0 && m_basis.numShapes() < numTargets();
+  if (!m_useBasis)
+    std::cout << "Basis is no smaller than the targets, using the targets\n";
+  m_weightsDirty = true;
+  return m_useBasis;
+}
+
+const ngl::Vec3 *MorphTargetSet::shapeDeltas() const
+{
+  // the shapes are laid out like the targets, a position then a normal delta per vertex
+  return m_useBasis ? reinterpret_cast<const ngl::Vec3 *>(m_basis.shapes().data()) : m_deltas;
+}
+
+void MorphTargetSet::applySparse(size_t &o_first, size_t &o_last)
+{
+  o_first = m_numVerts;
+  o_last = 0;
+  auto extend = [&o_first, &o_last](size_t _i)
+  {
+    o_first = std::min(o_first, _i);
+    o_last = std::max(o_last, _i + 1);
+  };
+  // put back anything the last blend moved, this is all we need to clear as the rest is still the base pose
+  for (auto i : m_touched)
+  {
+    m_morphed[i] = m_verts[i];
+    m_touchedFlag[i] = 0;
+    extend(i);
+  }
+  m_touched.clear();
+
+  for (size_t t = 0; t < m_sparse.size(); ++t)
+  {
+    auto w = m_weights[t];
+    if (w == 0.0f)
+      continue;
+    auto &sparse = m_sparse[t];
+    for (size_t i = 0; i < sparse.indices.size(); ++i)
+    {
+      auto v = sparse.indices[i];
+      m_morphed[v].p1 += w * sparse.deltas[2 * i];
+      m_morphed[v].n1 += w * sparse.deltas[2 * i + 1];
+      if (!m_touchedFlag[v])
+      {
+        m_touchedFlag[v] = 1;
+        m_touched.push_back(v);
+      }
+    }
+  }
+  // only the moved normals need renormalising, the base ones already are
+  for (auto i : m_touched)
+  {
+    m_morphed[i].n1.normalize();
+    extend(i);
+  }
+  if (o_first > o_last)
+    o_first = o_last = 0;
+}
+
+void MorphTargetSet::resetSparse()
+{
+  for (auto i : m_touched)
+  {
+    m_morphed[i] = m_verts[i];
+    m_touchedFlag[i] = 0;
+  }
+  m_touched.clear();
+}
+
+// IEEE half conversion, round to nearest even, values out of range go to inf
+static uint16_t floatToHalf(float _f)
+{
+  uint32_t x;
+  std::memcpy(&x, &_f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000u;
+  uint32_t absx = x & 0x7fffffffu;
+  if (absx >= 0x47800000u)
+    return static_cast<uint16_t>(sign | (absx > 0x7f800000u ? 0x7e00u : 0x7c00u));
+  if (absx < 0x38800000u)
+  {
+    // denormal, shift the mantissa (with the implicit 1) into place and round
+    if (absx < 0x33000000u)
+      return static_cast<uint16_t>(sign);
+    uint32_t e = absx >> 23;
+    uint32_t m = (absx & 0x7fffffu) | 0x800000u;
+    uint32_t shift = 126 - e;
+    uint32_t half = m >> shift;
+    uint32_t rem = m & ((1u << shift) - 1);
+    uint32_t mid = 1u << (shift - 1);
+    if (rem > mid || (rem == mid && (half & 1)))
+      ++half;
+    return static_cast<uint16_t>(sign | half);
+  }
+  uint32_t half = ((absx - 0x38000000u) >> 13);
+  uint32_t rem = absx & 0x1fffu;
+  if (rem > 0x1000u || (rem == 0x1000u && (half & 1)))
+    ++half;
+  return static_cast<uint16_t>(sign | half);
+}
+
+static float halfToFloat(uint16_t _h)
+{
+  uint32_t sign = (_h & 0x8000u) << 16;
+  uint32_t e = (_h >> 10) & 0x1fu;
+  uint32_t m = _h & 0x3ffu;
+  uint32_t x;
+  if (e == 0)
+  {
+    float f = std::ldexp(static_cast<float>(m), -24);
+    return sign ? -f : f;
+  }
+  else if (e == 31)
+    x = sign | 0x7f800000u | (m << 13);
+  else
+    x = sign | ((e + 112) << 23) | (m << 13);
+  float f;
+  std::memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+GLenum MorphTargetSet::glFormat(DeltaFormat _format)
+{
+  switch (_format)
+  {
+  case DeltaFormat::RGBA16F:
+    return GL_RGBA16F;
+  case DeltaFormat::RGBA16:
+    return GL_RGBA16;
+  case DeltaFormat::RGBA8:
+    return GL_RGBA8;
+  default:
+    return GL_RGB32F;
+  }
+}
+
+size_t MorphTargetSet::bytesPerDelta(DeltaFormat _format)
+{
+  switch (_format)
+  {
+  case DeltaFormat::RGBA16F:
+  case DeltaFormat::RGBA16:
+    return 4 * sizeof(uint16_t);
+  case DeltaFormat::RGBA8:
+    return 4 * sizeof(uint8_t);
+  default:
+    return sizeof(ngl::Vec3);
+  }
+}
+
+const void *MorphTargetSet::encodedDeltas() const
+{
+  // the float format is the original data so there is no need to copy it
+  return m_format == DeltaFormat::RGB32F ? static_cast<const void *>(shapeDeltas()) : m_encoded.data();
+}
+
+size_t MorphTargetSet::encodedBytes() const
+{
+  return m_numVerts * numShapes() * 2 * bytesPerDelta(m_format);
+}
+
+void MorphTargetSet::releaseTarget(size_t _target) const
+{
+  if (m_cache && m_format == DeltaFormat::RGB32F && !m_useBasis)
+    m_cache->release(encodedTarget(_target), encodedTargetBytes());
+}
+
+void MorphTargetSet::encode(DeltaFormat _format, std::vector<unsigned char> &o_data, std::vector<DeltaRange> &o_ranges, ngl::Real &o_posError,
+                            ngl::Real &o_normalError) const
+{
+  o_posError = 0.0f;
+  o_normalError = 0.0f;
+  o_ranges.assign(numShapes(), DeltaRange());
+  o_data.clear();
+  if (_format == DeltaFormat::RGB32F)
+    return;
+  auto numDeltas = m_numVerts * numShapes() * 2;
+  auto *deltas = shapeDeltas();
+  o_data.resize(numDeltas * bytesPerDelta(_format));
+  auto *out16 = reinterpret_cast<uint16_t *>(o_data.data());
+  auto *out8 = o_data.data();
+
+  for (size_t t = 0; t < numShapes(); ++t)
+  {
+    auto *dense = &deltas[t * m_numVerts * 2];
+    auto &range = o_ranges[t];
+    if (_format != DeltaFormat::RGBA16F)
+    {
+      // find the bounds of the position and normal deltas separately as they have very different ranges
+      for (size_t k = 0; k < 2; ++k)
+      {
+        ngl::Vec3 minV = dense[k];
+        ngl::Vec3 maxV = dense[k];
+        for (size_t i = 0; i < m_numVerts; ++i)
+        {
+          auto &d = dense[2 * i + k];
+          for (int c = 0; c < 3; ++c)
+          {
+            minV.m_openGL[c] = std::min(minV.m_openGL[c], d.m_openGL[c]);
+            maxV.m_openGL[c] = std::max(maxV.m_openGL[c], d.m_openGL[c]);
+          }
+        }
+        auto &scale = k == 0 ? range.posScale : range.normalScale;
+        auto &bias = k == 0 ? range.posBias : range.normalBias;
+        scale = maxV - minV;
+        bias = minV;
+      }
+    }
+    auto maxQ = _format == DeltaFormat::RGBA16 ? 65535.0f : 255.0f;
+    for (size_t i = 0; i < m_numVerts * 2; ++i)
+    {
+      auto &d = dense[i];
+      auto &scale = (i & 1) == 0 ? range.posScale : range.normalScale;
+      auto &bias = (i & 1) == 0 ? range.posBias : range.normalBias;
+      auto &error = (i & 1) == 0 ? o_posError : o_normalError;
+      auto outIndex = (t * m_numVerts * 2 + i) * 4;
+      for (int c = 0; c < 4; ++c)
+      {
+        float decoded = 0.0f;
+        float value = c < 3 ? d.m_openGL[c] : 0.0f;
+        if (_format == DeltaFormat::RGBA16F)
+        {
+          auto h = floatToHalf(value);
+          out16[outIndex + c] = h;
+          decoded = halfToFloat(h);
+        }
+        else
+        {
+          float s = c < 3 ? scale.m_openGL[c] : 0.0f;
+          float b = c < 3 ? bias.m_openGL[c] : 0.0f;
+          float n = s > 0.0f ? (value - b) / s : 0.0f;
+          auto q = static_cast<uint32_t>(std::lround(std::min(1.0f, std::max(0.0f, n)) * maxQ));
+          if (_format == DeltaFormat::RGBA16)
+            out16[outIndex + c] = static_cast<uint16_t>(q);
+          else
+            out8[outIndex + c] = static_cast<uint8_t>(q);
+          decoded = static_cast<float>(q) / maxQ * s + b;
+        }
+        if (c < 3)
+          error = std::max(error, std::abs(decoded - value));
+      }
+    }
+  }
+}
+
+MorphTargetSet::DeltaFormat MorphTargetSet::encodeDeltas(DeltaFormat _format, ngl::Real _tolerance)
+{
+  PROFILE_ZONE("MorphTargetSet::encodeDeltas");
+  auto name = [](DeltaFormat _f)
+  {
+    switch (_f)
+    {
+    case DeltaFormat::RGBA16F:
+      return "RGBA16F";
+    case DeltaFormat::RGBA16:
+      return "RGBA16";
+    case DeltaFormat::RGBA8:
+      return "RGBA8";
+    default:
+      return "RGB32F";
+    }
+  };
+  // smallest first, the float format is exact so always meets the tolerance
+  std::vector<DeltaFormat> candidates{DeltaFormat::RGBA8, DeltaFormat::RGBA16, DeltaFormat::RGBA16F, DeltaFormat::RGB32F};
+  if (_format != DeltaFormat::AUTO)
+    candidates = {_format};
+  for (auto f : candidates)
+  {
+    std::vector<unsigned char> data;
+    std::vector<DeltaRange> ranges;
+    ngl::Real posError, normalError;
+    encode(f, data, ranges, posError, normalError);
+    auto bytes = m_numVerts * numShapes() * 2 * bytesPerDelta(f);
+    std::cout << "Delta format " << name(f) << " " << bytes << " bytes max position error " << posError << " max normal error "
+              << normalError << '\n';
+    if (_format == DeltaFormat::AUTO && std::max(posError, normalError) > _tolerance)
+      continue;
+    m_format = f;
+    m_encoded = std::move(data);
+    m_ranges = std::move(ranges);
+    m_weightsDirty = true;
+    break;
+  }
+  std::cout << "Using delta format " << name(m_format) << '\n';
+  return m_format;
+}
@@ -1,171 +1,798 @@
 #include <QMouseEvent>
 #include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
 
 #include "NGLScene.h"
+#include "Profiler.h"
 #include <ngl/Transformation.h>
 #include <ngl/NGLInit.h>
 #include <ngl/VAOPrimitives.h>
 #include <ngl/ShaderLib.h>
+#include <ngl/SimpleIndexVAO.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
-NGLScene::NGLScene()
+#include <limits>
+
+// uniform buffer binding point for the MorphWeights block
+constexpr GLuint c_morphWeightBinding = 0;
+// largest delta error (in model units) allowed when picking the TBO format automatically
+constexpr ngl::Real c_deltaTolerance = 1e-3f;
+// size of the std140 header before the active array, numActive / numVerts padded to a vec4 then the two bias vec4s
+constexpr size_t c_morphHeaderSize = 12 * sizeof(GLfloat);
+// uniform buffer binding point for the MorphRanges block used by the crowd shader
+constexpr GLuint c_morphRangeBinding = 1;
+// distance between crowd members, Bruce is about 10 units across with his arms out
+constexpr ngl::Real c_crowdSpacing = 12.0f;
+// animation tick in ms, this only decides how often the weights are evaluated, how far they move comes from the clock
+constexpr int c_animationTick = 16;
+// where T writes the profile when no --trace file was given
+constexpr const char *c_defaultTraceFile = "morph_trace.json";
+// the most of the deltas uploaded in one frame while loading, so no frame waits on one huge copy
+constexpr size_t c_uploadSliceBytes = 8 << 20;
+// uniform buffer binding points for the Transforms block (written to the ring every frame) and the Lighting block
+constexpr GLuint c_transformBinding = 2;
+constexpr GLuint c_lightingBinding = 3;
+// space in the uniform ring for one frame, a Transforms block rounds up to 256 bytes so this is a few hundred draws
+constexpr size_t c_uniformRingBytes = 64 << 10;
+// how far ahead (in seconds) a clip's target is prefetched into the delta pool
+constexpr double c_prefetchWindow = 0.5;
+// the crowd's target slot table follows the four range arrays in the MorphRanges block
+constexpr size_t c_rangeSlotOffset = 4 * MorphTargetSet::c_maxActiveTargets * 4 * sizeof(GLfloat);
+// a level of detail is used while its error is smaller than this many pixels on screen, the error is the worst
+// collapse in the level (most of the surface moved far less) so this can be a few pixels
+constexpr ngl::Real c_lodPixelError = 4.0f;
+
+NGLScene::NGLScene(const std::vector<std::string> &_poseFiles) : m_poseFiles(_poseFiles)
 {
   setTitle("Morph Mesh Demo");
-  m_weight1 = 0.0f;
-  m_weight2 = 0.0f;
-  m_animation = true;
-  m_punchLeft = false;
-  m_punchRight = false;
-  m_timerLeft = new QTimer();
-  m_timerRight = new QTimer();
-  connect(m_timerLeft, SIGNAL(timeout()), this, SLOT(updateLeft()));
-  connect(m_timerRight, SIGNAL(timeout()), this, SLOT(updateRight()));
-}
-void NGLScene::punchLeft()
-{
-  if (m_punchLeft != true)
+  if (m_poseFiles.empty())
   {
-    m_weight1 = 0.0f;
-    m_timerLeft->start(4);
-    m_punchLeft = true;
+    m_poseFiles = MorphTargetSet::defaultPoseFiles();
   }
+  m_animation = true;
+  m_timerAnimation = new QTimer(this);
+  connect(m_timerAnimation, SIGNAL(timeout()), this, SLOT(tick()));
+  // both punches are the same clip on different targets
+  m_punchCurve = m_animator.addCurve(WeightAnimator::pulse(PunchTimeline::c_punchTime, PunchTimeline::c_punchTime));
 }
-
-void NGLScene::punchRight()
+void NGLScene::punch(size_t _target)
 {
-  if (m_punchRight != true)
-  {
-    m_weight2 = 0.0f;
-    m_timerRight->start(4);
-    m_punchRight = true;
-  }
+  if (!ready())
+    return;
+  if (m_crowdMode)
+    m_crowd.punchAll(_target, m_clock.now());
+  else if (_target < m_morph.numTargets())
+    m_animator.play(m_punchCurve, 0, _target, m_clock.now());
+  startAnimation();
 }
 
-// a simple structure to hold our vertex data
-struct vertData
-{
-  ngl::Vec3 p1;
-  ngl::Vec3 n1;
-};
-void NGLScene::createMorphMesh()
+void NGLScene::uploadMorphMesh()
 {
-  // texture buffers have to be vec4 unless using GL 4.x so mac is out for now
-  // just use Vec4 and waste data see http://www.opengl.org/wiki/Buffer_Texture
-  std::vector<ngl::Vec3> targets;
-  // base pose is mesh 1 stored in m_meshes[0]
-  // get the obj data so we can process it locally
-  std::vector<ngl::Vec3> verts1 = m_meshes[0]->getVertexList();
-  // should really check to see if the poses match if we were doing this properly
-  std::vector<ngl::Vec3> verts2 = m_meshes[1]->getVertexList();
-  std::vector<ngl::Vec3> verts3 = m_meshes[2]->getVertexList();
-
-  // faces will be the same for each mesh so only need one
-  std::vector<ngl::Face> faces = m_meshes[0]->getFaceList();
-  // now get the normals
-  std::vector<ngl::Vec3> normals1 = m_meshes[0]->getNormalList();
-  std::vector<ngl::Vec3> normals2 = m_meshes[1]->getNormalList();
-  std::vector<ngl::Vec3> normals3 = m_meshes[2]->getNormalList();
-
-  // now we are going to process and pack the mesh into an ngl::VertexArrayObject
-  std::vector<vertData> vboMesh;
-  vertData d;
-  auto nFaces = faces.size();
-  // unsigned int nNorm=normals1.size();
-  // unsigned int nTex=tex.size();
-  //  loop for each of the faces
-  for (size_t i = 0; i < nFaces; ++i)
-  {
-    // now for each triangle in the face (remember we ensured tri above)
-    for (size_t j = 0; j < 3; ++j)
-    {
-      // pack in the vertex data first
-
-      d.p1 = verts1[faces[i].m_vert[j]];
-      // the blend meshes are just the differences so we subtract the base mesh
-      // from the current one (could do this on GPU but this saves processing time)
-      ngl::Vec3 c;
-      c = verts2[faces[i].m_vert[j]] - d.p1;
-      targets.push_back(c);
-      c = verts3[faces[i].m_vert[j]] - d.p1;
-      targets.push_back(c);
-
-      // now do the normals
-      d.n1 = normals1[faces[i].m_norm[j]];
-      // again we only need the differences so subtract base mesh value from pose values
-      c = normals2[faces[i].m_norm[j]] - d.n1;
-      targets.push_back(c);
-      c = normals3[faces[i].m_norm[j]] - d.n1;
-      targets.push_back(c);
-
-      // finally add it to our mesh VAO structure
-      vboMesh.push_back(d);
-    }
-  }
-
+  PROFILE_ZONE("uploadMorphMesh");
   // generate and bind our matrix buffer this is going to be fed to the feedback shader to
   // generate our model position data for later, if we Direction::UPdate how many instances we use
   // this will need to be re-generated (done in the draw routine)
 
-  GLuint morphTarget;
-  glGenBuffers(1, &morphTarget);
+  glGenBuffers(1, &m_deltaBuffer);
 
-  glBindBuffer(GL_TEXTURE_BUFFER, morphTarget);
+  glBindBuffer(GL_TEXTURE_BUFFER, m_deltaBuffer);
   // ngl::NGLCheckGLError("bind texture",__LINE__);
-  glBufferData(GL_TEXTURE_BUFFER, targets.size() * sizeof(ngl::Vec3), &targets[0].m_x, GL_STATIC_DRAW);
+  // the pool holds as many targets as the budget allows, every target that can be active at once always fits
+  m_residency.create(m_morph.numShapes(), m_morph.encodedTargetBytes(), m_gpuTargetBudget, m_hostTargetBudget,
+                     std::min(m_morph.numShapes(), MorphTargetSet::c_maxActiveTargets));
+  std::cout << "Target pool " << m_residency.numSlots() << " of " << m_morph.numShapes() << " shapes ("
+            << m_residency.poolBytes() << " of " << m_morph.encodedBytes() << " bytes)\n";
+  // only allocated here, the first targets are copied in a slice a frame by uploadDeltaSlice
+  glBufferData(GL_TEXTURE_BUFFER, m_residency.poolBytes(), nullptr, GL_DYNAMIC_DRAW);
+  m_deltaBytesUploaded = 0;
 
   glGenTextures(1, &m_tboID);
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_BUFFER, m_tboID);
 
-  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, morphTarget);
+  // the normalised formats are decoded with the per target range in the MorphWeights block
+  glTexBuffer(GL_TEXTURE_BUFFER, MorphTargetSet::glFormat(m_morph.deltaFormat()), m_deltaBuffer);
 
-  // first we grab an instance of our VOA class as a TRIANGLE_STRIP
-  m_vaoMesh = ngl::VAOFactory::createVAO("simpleVAO", GL_TRIANGLES);
+  // first we grab an instance of our VOA class, the mesh is welded so we draw indexed triangles
+  m_vaoMesh = ngl::VAOFactory::createVAO(ngl::simpleIndexVAO, GL_TRIANGLES);
+  // the VBO is re-written by the sparse CPU blend so needs to be dynamic
   // next we bind it so it's active for setting data
   m_vaoMesh->bind();
-  auto meshSize = vboMesh.size();
   // now we have our data add it to the VAO, we need to tell the VAO the following
   // how much (in bytes) data we are copying
   // a pointer to the first element of data (in this case the address of the first element of the
   // std::vector
-  m_vaoMesh->setData(ngl::AbstractVAO::VertexData(meshSize * sizeof(vertData), vboMesh[0].p1.m_x));
+  // the element buffer holds every level of detail, level 0 (the full mesh) first
+  auto &lodIndices = m_morph.lodIndices();
+  m_vaoMesh->setData(ngl::SimpleIndexVAO::VertexData(m_morph.numVerts() * sizeof(vertData), m_morph.vertices()[0].p1.m_x,
+                                                     static_cast<unsigned int>(lodIndices.size()), lodIndices.data(), GL_UNSIGNED_INT, GL_DYNAMIC_DRAW));
 
   // so data is Vert / Normal for each mesh
   m_vaoMesh->setVertexAttributePointer(0, 3, GL_FLOAT, sizeof(vertData), 0);
   m_vaoMesh->setVertexAttributePointer(1, 3, GL_FLOAT, sizeof(vertData), 3);
   // now we have set the vertex attributes we tell the VAO class how many indices to draw when
-  // glDrawArrays is called, in this case we use buffSize (but if we wished less of the sphere to be drawn we could
-  // specify less (in steps of 3))
-  m_vaoMesh->setNumIndices(meshSize);
+  // glDrawElements is called, gl_VertexID in the shader is then the welded vertex index into the TBO. Every level
+  // only indexes the original vertices so gl_VertexID is the same at every level.
+  m_vaoMesh->setNumIndices(m_morph.numIndices());
   // finally we have finished for now so time to unbind the VAO
   m_vaoMesh->unbind();
+
+  // the pre-pass output, the same layout and indices as m_vaoMesh starting at the base pose, the vertex buffer is
+  // written by transform feedback
+  m_vaoMorphed = ngl::VAOFactory::createVAO(ngl::simpleIndexVAO, GL_TRIANGLES);
+  m_vaoMorphed->bind();
+  m_vaoMorphed->setData(ngl::SimpleIndexVAO::VertexData(m_morph.numVerts() * sizeof(vertData), m_morph.vertices()[0].p1.m_x,
+                                                        static_cast<unsigned int>(lodIndices.size()), lodIndices.data(), GL_UNSIGNED_INT, GL_DYNAMIC_COPY));
+  m_vaoMorphed->setVertexAttributePointer(0, 3, GL_FLOAT, sizeof(vertData), 0);
+  m_vaoMorphed->setVertexAttributePointer(1, 3, GL_FLOAT, sizeof(vertData), 3);
+  m_vaoMorphed->setNumIndices(m_morph.numIndices());
+  m_vaoMorphed->unbind();
+
+  // the visible meshlet ranges are streamed into the indirect buffer each frame when there is one
+  GLint major = 0;
+  GLint minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  m_multiDrawIndirect = major > 4 || (major == 4 && minor >= 3);
+  if (m_multiDrawIndirect)
+    glGenBuffers(1, &m_indirectBuffer);
+
+  // the active target list goes in a uniform buffer, it is sized for the max so it never needs re-allocating
+  // it starts with no active targets so the base pose can be drawn while the deltas are still going up
+  std::vector<GLubyte> block(c_morphHeaderSize + MorphTargetSet::c_maxActiveTargets * sizeof(MorphTargetSet::ActiveTarget), 0);
+  GLint counts[4] = {0, static_cast<GLint>(m_morph.numVerts()), 0, 0};
+  std::copy(reinterpret_cast<const GLubyte *>(counts), reinterpret_cast<const GLubyte *>(counts) + sizeof(counts), block.begin());
+  glGenBuffers(1, &m_weightUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_weightUBO);
+  glBufferData(GL_UNIFORM_BUFFER, block.size(), block.data(), GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, c_morphWeightBinding, m_weightUBO);
+}
+
+bool NGLScene::uploadDeltaSlice(size_t _bytes)
+{
+  PROFILE_ZONE("uploadDeltaSlice");
+  // the targets are stored one after the other so the start of the data is the first numSlots targets
+  auto total = m_residency.poolBytes();
+  auto size = std::min(_bytes, total - m_deltaBytesUploaded);
+  if (size > 0)
+  {
+    glBindBuffer(GL_TEXTURE_BUFFER, m_deltaBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(m_deltaBytesUploaded), static_cast<GLsizeiptr>(size),
+                    static_cast<const unsigned char *>(m_morph.encodedDeltas()) + m_deltaBytesUploaded);
+    m_deltaBytesUploaded += size;
+  }
+  return m_deltaBytesUploaded == total;
+}
+
+void NGLScene::loadPoses()
+{
+  PROFILE_ZONE("loadPoses");
+  // load the poses, either from the cache or by parsing the obj files
+  if (!m_morph.load(m_poseFiles, MorphTargetSet::cacheFileName(m_poseFiles)))
+  {
+    std::cerr << "Unable to load the morph targets\n";
+    m_loadStage = LoadStage::FAILED;
+    return;
+  }
+  m_loadStage = LoadStage::PROCESSING;
+  m_morph.buildSparse();
+  if (m_basisTolerance > 0.0f)
+  {
+    MorphBasis::Options options;
+    options.tolerance = m_basisTolerance;
+    m_morph.buildBasis(options);
+  }
+  m_morph.encodeDeltas(m_deltaFormat, c_deltaTolerance);
+  m_morph.buildLODs();
+  m_morph.buildMeshlets();
+  createEngine();
+  // the pick tree is split once on the base pose, picks refit it to whatever weights they test
+  auto *base = &m_morph.vertices()[0].p1.m_x;
+  m_bvh.build(base, base + 1, base + 2, 6, m_morph.numVerts(), m_morph.indices(), m_morph.numIndices());
+  m_bvhWeights.assign(m_morph.numTargets(), 0.0f);
+  m_pickResult = m_engine.createResult();
+  // the stage is stored last so the render thread sees all of the above once it reads UPLOADING
+  m_loadStage = LoadStage::UPLOADING;
+}
+
+void NGLScene::continueLoading(size_t _sliceBytes, bool _wait)
+{
+  if (_wait && m_loadThread.joinable())
+    m_loadThread.join();
+  auto stage = m_loadStage.load();
+  if (stage != LoadStage::UPLOADING && stage != LoadStage::FAILED)
+    return;
+  if (m_loadThread.joinable())
+  {
+    // the worker is done with m_morph so it is only used from this thread from now on
+    m_loadThread.join();
+    if (stage == LoadStage::FAILED)
+    {
+      QGuiApplication::exit(EXIT_FAILURE);
+      return;
+    }
+    uploadMorphMesh();
+  }
+  if (stage == LoadStage::FAILED || !uploadDeltaSlice(_sliceBytes))
+    return;
+
+  // the targets are resident, set up everything that depends on them
+  for (size_t t = 0; t < m_residency.numSlots(); ++t)
+  {
+    m_residency.preload(t);
+  }
+  m_keyWeights.assign(m_morph.numTargets(), 0.0f);
+  createCrowd();
+  m_loadStage = LoadStage::READY;
+  m_state.mark(SceneState::ALL);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_loadStart;
+  std::cout << "Morph targets resident after " << elapsed.count() << " ms\n";
 }
 
-void NGLScene::changeWeight(Weights _w, Direction _d)
+bool NGLScene::finishLoading()
 {
+  continueLoading(std::numeric_limits<size_t>::max(), true);
+  return ready();
+}
 
-  switch (_w)
+void NGLScene::uploadWeights()
+{
+  PROFILE_ZONE("uploadWeights");
+  if (!m_morph.updateActive() && !m_morphModeChanged && !m_activeSlotsDirty)
+    return;
+  m_prePassDirty = true;
+  // std140 block is int numActive, int numVerts, (pad to 16) vec4 posBias, vec4 normalBias then ActiveTarget active[]
+  auto &active = m_morph.activeTargets();
+  GLint counts[4] = {static_cast<GLint>(active.size()), static_cast<GLint>(m_morph.numVerts()), 0, 0};
+  auto &posBias = m_morph.activePosBias();
+  auto &normalBias = m_morph.activeNormalBias();
+  GLfloat bias[8] = {posBias.m_x, posBias.m_y, posBias.m_z, 0.0f, normalBias.m_x, normalBias.m_y, normalBias.m_z, 0.0f};
+  if (m_blendMode != BlendMode::GPU)
   {
-  case Weights::POSE1:
-    if (_d == Direction::UP)
-      m_weight1 += 0.1f;
+    // the blend is done on the CPU and written into the VBO so the shader has nothing left to add
+    counts[0] = 0;
+    std::fill(std::begin(bias), std::end(bias), 0.0f);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vaoMesh->getBufferID(0));
+    if (m_blendMode == BlendMode::CPU_SPARSE)
+    {
+      // scatter the sparse targets so only the changed range is uploaded
+      size_t first, last;
+      m_morph.applySparse(first, last);
+      if (last > first)
+      {
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(vertData), (last - first) * sizeof(vertData), &m_morph.morphedVertices()[first]);
+      }
+    }
     else
-      m_weight1 -= 0.1f;
-    break;
+    {
+      m_engine.evaluate(m_morph.weights().data(), m_engineResult);
+      m_engineResult.interleave(m_engineVerts.data(), 0, m_engine.numVerts());
+      glBufferSubData(GL_ARRAY_BUFFER, 0, m_engineVerts.size() * sizeof(GLfloat), m_engineVerts.data());
+    }
+  }
+  else if (m_morphModeChanged)
+  {
+    // going back to the GPU blend so the VBO has to be the base pose again
+    glBindBuffer(GL_ARRAY_BUFFER, m_vaoMesh->getBufferID(0));
+    glBufferSubData(GL_ARRAY_BUFFER, 0, m_morph.numVerts() * sizeof(vertData), m_morph.vertices());
+  }
+  m_morphModeChanged = false;
+  glBindBuffer(GL_UNIFORM_BUFFER, m_weightUBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(counts), counts);
+  glBufferSubData(GL_UNIFORM_BUFFER, sizeof(counts), sizeof(bias), bias);
+  if (!active.empty() && m_blendMode == BlendMode::GPU)
+  {
+    // the shader reads the pool so the index is the target's slot, one that couldn't be given a slot (only if
+    // more targets have a weight than can be active) is left out by zeroing its scales
+    m_activeSlots.assign(active.begin(), active.end());
+    for (auto &a : m_activeSlots)
+    {
+      auto slot = m_residency.slot(static_cast<size_t>(a.index));
+      if (slot == TargetResidency::c_notResident)
+      {
+        std::fill(std::begin(a.posScale), std::end(a.posScale), 0.0f);
+        std::fill(std::begin(a.normalScale), std::end(a.normalScale), 0.0f);
+        slot = 0;
+      }
+      a.index = static_cast<GLfloat>(slot);
+    }
+    glBufferSubData(GL_UNIFORM_BUFFER, c_morphHeaderSize, m_activeSlots.size() * sizeof(MorphTargetSet::ActiveTarget), m_activeSlots.data());
+  }
+  m_activeSlotsDirty = false;
+}
+
+void NGLScene::updateResidency()
+{
+  PROFILE_ZONE("updateResidency");
+  // every basis shape fits in the pool (there are never more than can be active) and was preloaded, and each target
+  // uses all of them, so a compressed set never streams
+  if (m_morph.hasBasis())
+    return;
+  m_residency.beginFrame();
+  auto numTargets = m_morph.numTargets();
+  if (m_crowdMode)
+  {
+    for (size_t t = 0; t < numTargets; ++t)
+    {
+      if (m_crowd.targetInUse(t))
+        m_residency.request(t);
+    }
+    m_crowd.upcomingTargets(m_clock.time(), c_prefetchWindow, m_upcomingTargets);
+  }
+  else
+  {
+    // only the compacted list the shader blends needs slots, a weight dropped from it (more non zero than can be
+    // active) would take one for nothing. It is rebuilt here, before uploadWeights, so that has to upload it.
+    if (m_morph.updateActive())
+      m_activeSlotsDirty = true;
+    // the CPU blends have their own copy of the deltas so only the GPU blend needs them in the pool
+    if (m_blendMode == BlendMode::GPU)
+    {
+      for (auto &a : m_morph.activeTargets())
+        m_residency.request(static_cast<size_t>(a.index));
+    }
+    m_animator.upcoming(m_clock.time(), c_prefetchWindow, m_upcomingTargets);
+  }
+  for (auto t : m_upcomingTargets)
+  {
+    m_residency.prefetch(t);
+  }
+  m_residency.update(m_residencyUploads, m_residencyReleased);
+  if (!m_residencyUploads.empty())
+  {
+    PROFILE_ZONE("streamTargets");
+    auto bytes = m_morph.encodedTargetBytes();
+    glBindBuffer(GL_TEXTURE_BUFFER, m_deltaBuffer);
+    for (auto &upload : m_residencyUploads)
+    {
+      glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(upload.slot * bytes), static_cast<GLsizeiptr>(bytes), m_morph.encodedTarget(upload.target));
+    }
+    m_activeSlotsDirty = true;
+    m_crowdSlotsDirty = true;
+  }
+  for (auto t : m_residencyReleased)
+  {
+    m_morph.releaseTarget(t);
+  }
+}
 
-  case Weights::POSE2:
-    if (_d == Direction::UP)
-      m_weight2 += 0.1f;
+void NGLScene::uploadCrowdSlots()
+{
+  // -1 for a target that isn't in the pool, the shader skips it
+  std::vector<GLint> targetSlots(MorphTargetSet::c_maxActiveTargets, -1);
+  for (size_t t = 0; t < m_morph.numShapes() && t < targetSlots.size(); ++t)
+  {
+    auto slot = m_residency.slot(t);
+    if (slot != TargetResidency::c_notResident)
+      targetSlots[t] = static_cast<GLint>(slot);
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, m_rangeUBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, c_rangeSlotOffset, targetSlots.size() * sizeof(GLint), targetSlots.data());
+  m_crowdSlotsDirty = false;
+}
+
+void NGLScene::createCrowd()
+{
+  // the crowd shader decodes every shape with its own range so they all have to fit in the MorphRanges block
+  if (m_morph.numShapes() > MorphTargetSet::c_maxActiveTargets)
+  {
+    std::cerr << "Crowd mode needs at most " << MorphTargetSet::c_maxActiveTargets << " targets, drawing a single character\n";
+    m_crowdSize = 1;
+    m_crowdMode = false;
+  }
+  // the instances animate the targets, with a basis their weights are folded into shape weights as they are packed
+  m_crowd.create(std::max<size_t>(1, m_crowdSize), m_morph.numTargets(), c_crowdSpacing);
+  m_crowd.setBasis(m_morph.hasBasis() ? &m_morph.basis() : nullptr);
+  ngl::ShaderLib::use("MorphCrowd");
+  ngl::ShaderLib::setUniform("numTargets", static_cast<int>(m_morph.numShapes()));
+  ngl::ShaderLib::setUniform("numVerts", static_cast<int>(m_morph.numVerts()));
+  ngl::ShaderLib::setUniform("instanceStride", static_cast<int>(m_crowd.texelsPerInstance()));
+
+  // std140 block of four vec4 arrays, posScale posBias normalScale normalBias, the float formats are scale 1 bias 0,
+  // then the slot of each target in the pool four to an ivec4 (written by uploadCrowdSlots)
+  constexpr size_t maxTargets = MorphTargetSet::c_maxActiveTargets;
+  std::vector<GLfloat> ranges(4 * maxTargets * 4 + maxTargets, 0.0f);
+  auto &deltaRanges = m_morph.deltaRanges();
+  for (size_t t = 0; t < m_morph.numShapes() && t < maxTargets; ++t)
+  {
+    MorphTargetSet::DeltaRange range;
+    if (t < deltaRanges.size())
+      range = deltaRanges[t];
+    const ngl::Vec3 *fields[] = {&range.posScale, &range.posBias, &range.normalScale, &range.normalBias};
+    for (size_t f = 0; f < 4; ++f)
+    {
+      std::copy(fields[f]->m_openGL, fields[f]->m_openGL + 3, &ranges[(f * maxTargets + t) * 4]);
+    }
+  }
+  glGenBuffers(1, &m_rangeUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_rangeUBO);
+  glBufferData(GL_UNIFORM_BUFFER, ranges.size() * sizeof(GLfloat), ranges.data(), GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, c_morphRangeBinding, m_rangeUBO);
+  uploadCrowdSlots();
+
+  // the transforms and weights are re-packed when the animation changes them so the buffer is streamed
+  glGenBuffers(1, &m_instanceBuffer);
+  glBindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+  m_crowd.pack(m_instanceData);
+  glBufferData(GL_TEXTURE_BUFFER, m_instanceData.size() * sizeof(GLfloat), m_instanceData.data(), GL_STREAM_DRAW);
+  glGenTextures(1, &m_instanceTBO);
+  glBindTexture(GL_TEXTURE_BUFFER, m_instanceTBO);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_instanceBuffer);
+  m_crowdDirty = false;
+  m_crowdLODDirty = true;
+
+  // pull the camera back and up so the whole grid is in view
+  auto columns = std::ceil(std::sqrt(static_cast<ngl::Real>(m_crowd.size())));
+  auto extent = columns * c_crowdSpacing;
+  m_crowdView = ngl::lookAt(ngl::Vec3(0.0f, 10.0f + 0.6f * extent, 40.0f + extent), ngl::Vec3(0.0f, 10.0f, -0.4f * extent), ngl::Vec3(0.0f, 1.0f, 0.0f));
+  if (m_crowdMode)
+    startAnimation();
+}
+
+void NGLScene::toggleCrowd()
+{
+  if (m_crowdSize < 2 || !ready())
+    return;
+  m_crowdMode ^= true;
+  // the crowd uses the GPU blend over the base pose in the VBO, uploadWeights puts it back if a CPU mode changed it
+  if (m_crowdMode && m_blendMode != BlendMode::GPU)
+  {
+    if (m_blendMode == BlendMode::CPU_SPARSE)
+      m_morph.resetSparse();
+    m_blendMode = BlendMode::GPU;
+    m_morphModeChanged = true;
+  }
+  if (m_crowdMode)
+    startAnimation();
+}
+
+size_t NGLScene::selectLOD(const ngl::Mat4 &_MV) const
+{
+  auto &lods = m_morph.lods();
+  if (!m_lod || lods.size() < 2)
+    return 0;
+  // the distance to the near side of the bounds, ngl::Mat4 is column major so the view z row is m_m[c][2]
+  auto &c = m_morph.boundsCentre();
+  auto depth = -(_MV.m_m[0][2] * c.m_x + _MV.m_m[1][2] * c.m_y + _MV.m_m[2][2] * c.m_z + _MV.m_m[3][2]) - m_morph.boundsRadius();
+  if (depth <= 0.0f)
+    return 0;
+  // m_project[1][1] is 1/tan(fov/2) so this is how many pixels one model unit covers at that depth
+  auto pixelsPerUnit = m_project.m_m[1][1] * 0.5f * m_win.height / depth;
+  size_t level = 0;
+  while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit < c_lodPixelError)
+    ++level;
+  return level;
+}
+
+void NGLScene::selectCrowdLODs()
+{
+  PROFILE_ZONE("selectCrowdLODs");
+  std::vector<uint32_t> levels(m_crowd.size());
+  m_lodCounts.assign(m_morph.lods().size(), 0);
+  for (size_t i = 0; i < m_crowd.size(); ++i)
+  {
+    levels[i] = static_cast<uint32_t>(selectLOD(m_crowdMV * m_crowd.transform(i)));
+    ++m_lodCounts[levels[i]];
+  }
+  // counting sort, the instances of each level end up together in instance order
+  std::vector<size_t> next(m_lodCounts.size(), 0);
+  for (size_t l = 1; l < next.size(); ++l)
+  {
+    next[l] = next[l - 1] + m_lodCounts[l - 1];
+  }
+  std::vector<uint32_t> order(m_crowd.size());
+  for (size_t i = 0; i < m_crowd.size(); ++i)
+  {
+    order[next[levels[i]]++] = static_cast<uint32_t>(i);
+  }
+  if (order != m_lodOrder)
+  {
+    m_lodOrder.swap(order);
+    m_crowdDirty = true;
+  }
+  m_crowdLODDirty = false;
+}
+
+void NGLScene::drawLOD(size_t _level, size_t _instances)
+{
+  auto &lod = m_morph.lods()[_level];
+  auto offset = reinterpret_cast<const void *>(lod.firstIndex * sizeof(GLuint));
+  glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(lod.numIndices), GL_UNSIGNED_INT, offset, static_cast<GLsizei>(_instances));
+}
+
+void NGLScene::toggleLOD()
+{
+  m_lod ^= true;
+  m_state.mark(SceneState::CAMERA);
+}
+
+void NGLScene::drawMesh()
+{
+  auto &meshlets = m_morph.meshlets();
+  if (!m_meshletCulling || m_lodLevel != 0 || meshlets.meshlets().empty())
+  {
+    drawLOD(m_lodLevel);
+    return;
+  }
+  {
+    PROFILE_ZONE("cullMeshlets");
+    // the camera in model space, MV is only rotation and translation so the inverse rotation is the transpose
+    GLfloat eye[3];
+    for (size_t c = 0; c < 3; ++c)
+    {
+      eye[c] = -(m_MV.m_m[c][0] * m_MV.m_m[3][0] + m_MV.m_m[c][1] * m_MV.m_m[3][1] + m_MV.m_m[c][2] * m_MV.m_m[3][2]);
+    }
+    meshlets.cull(m_transforms.MVP, eye, m_morph.weights().data(), m_visibleMeshlets);
+  }
+  // neighbouring meshlets are next to each other in the index buffer so a run of visible ones is one draw
+  m_drawCommands.clear();
+  m_meshletTriangles = 0;
+  for (auto m : m_visibleMeshlets)
+  {
+    auto &meshlet = meshlets.meshlets()[m];
+    m_meshletTriangles += meshlet.numIndices / 3;
+    if (!m_drawCommands.empty() && m_drawCommands.back().firstIndex + m_drawCommands.back().count == meshlet.firstIndex)
+      m_drawCommands.back().count += meshlet.numIndices;
     else
-      m_weight2 -= 0.1f;
+      m_drawCommands.push_back({meshlet.numIndices, 1, meshlet.firstIndex, 0, 0});
+  }
+  if (m_drawCommands.empty())
+    return;
+  auto draws = static_cast<GLsizei>(m_drawCommands.size());
+  if (m_multiDrawIndirect)
+  {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    // orphaned like the instance buffer so this frame's write doesn't wait on last frame's draw
+    auto bytes = static_cast<GLsizeiptr>(m_drawCommands.size() * sizeof(DrawElementsCommand));
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, m_drawCommands.data(), GL_STREAM_DRAW);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, draws, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+  else
+  {
+    m_drawCounts.clear();
+    m_drawOffsets.clear();
+    for (auto &command : m_drawCommands)
+    {
+      m_drawCounts.push_back(static_cast<GLsizei>(command.count));
+      m_drawOffsets.push_back(reinterpret_cast<const void *>(command.firstIndex * sizeof(GLuint)));
+    }
+    glMultiDrawElements(GL_TRIANGLES, m_drawCounts.data(), GL_UNSIGNED_INT, m_drawOffsets.data(), draws);
+  }
+}
+
+void NGLScene::toggleMeshletCulling()
+{
+  m_meshletCulling ^= true;
+  m_state.mark(SceneState::DISPLAY);
+}
+
+void NGLScene::drawCrowd()
+{
+  ngl::ShaderLib::use("MorphCrowd");
+  if (m_crowdLODDirty)
+    selectCrowdLODs();
+  if (m_crowdSlotsDirty)
+    uploadCrowdSlots();
+  if (m_crowdDirty)
+  {
+    m_crowd.pack(m_instanceData, m_lodOrder);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_instanceBuffer);
+    // orphan the old storage so we don't wait on the previous frame still reading it
+    glBufferData(GL_TEXTURE_BUFFER, m_instanceData.size() * sizeof(GLfloat), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, m_instanceData.size() * sizeof(GLfloat), m_instanceData.data());
+    m_crowdDirty = false;
+  }
+  m_vaoMesh->bind();
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, m_instanceTBO);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_BUFFER, m_tboID);
+  // each level gets its own Transforms block so the shader knows which slot its first instance is in
+  auto transforms = m_crowdTransforms;
+  transforms.firstInstance = 0;
+  for (size_t level = 0; level < m_lodCounts.size(); ++level)
+  {
+    if (m_lodCounts[level] == 0)
+      continue;
+    bindTransforms(transforms);
+    drawLOD(level, m_lodCounts[level]);
+    transforms.firstInstance += static_cast<GLint>(m_lodCounts[level]);
+  }
+  m_vaoMesh->unbind();
+}
+
+void NGLScene::morphPrePass()
+{
+  if (!m_prePassDirty)
+  {
+    ++m_prePassSkips;
+    return;
+  }
+  PROFILE_ZONE("morphPrePass");
+  PROFILE_GPU_ZONE("morphPrePass");
+  // one point per welded vertex, nothing is rasterised we only want the captured varyings
+  ngl::ShaderLib::use("MorphFeedback");
+  glEnable(GL_RASTERIZER_DISCARD);
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_vaoMorphed->getBufferID(0));
+  m_vaoMesh->bind();
+  glBindTexture(GL_TEXTURE_BUFFER, m_tboID);
+  glBeginTransformFeedback(GL_POINTS);
+  glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(m_morph.numVerts()));
+  glEndTransformFeedback();
+  m_vaoMesh->unbind();
+  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+  glDisable(GL_RASTERIZER_DISCARD);
+  m_prePassDirty = false;
+  ++m_prePassRuns;
+}
+
+void NGLScene::togglePrePass()
+{
+  m_prePass ^= true;
+  // the captured mesh may be from weights that have changed since
+  m_prePassDirty = true;
+}
+
+void NGLScene::cycleBlendMode()
+{
+  // the crowd is always blended on the GPU
+  if (m_crowdMode)
+    return;
+  if (m_blendMode == BlendMode::CPU_SPARSE)
+  {
+    // clear out what the sparse blend left in the morphed buffer so the next switch starts from the base
+    m_morph.resetSparse();
+  }
+  switch (m_blendMode)
+  {
+  case BlendMode::GPU:
+    m_blendMode = BlendMode::CPU_SPARSE;
+    break;
+  case BlendMode::CPU_SPARSE:
+    m_blendMode = BlendMode::CPU_SIMD;
+    break;
+  case BlendMode::CPU_SIMD:
+    m_blendMode = BlendMode::GPU;
     break;
   }
-  // clamp to 0.0 -> 1.0 range
-  m_weight1 = std::min(1.0f, std::max(0.0f, m_weight1));
-  m_weight2 = std::min(1.0f, std::max(0.0f, m_weight2));
+  m_morphModeChanged = true;
+}
+
+void NGLScene::createEngine()
+{
+  m_morph.loadEngine(m_engine);
+  m_engineResult = m_engine.createResult();
+  m_engineVerts.resize(m_morph.numVerts() * MorphEngine::c_components);
+  std::cout << "CPU morph engine using " << MorphEngine::kernelName(m_engine.kernel()) << " kernels\n";
+}
+
+// take an eye space ray from the camera into the model space of _MV, which is only ever rotations and translations so
+// the inverse is the transposed rotation and the direction keeps its length
+static void eyeToModel(const ngl::Mat4 &_MV, const float *_eyeDir, float *o_origin, float *o_dir)
+{
+  for (size_t c = 0; c < 3; ++c)
+  {
+    o_origin[c] = -(_MV.m_m[c][0] * _MV.m_m[3][0] + _MV.m_m[c][1] * _MV.m_m[3][1] + _MV.m_m[c][2] * _MV.m_m[3][2]);
+    o_dir[c] = _MV.m_m[c][0] * _eyeDir[0] + _MV.m_m[c][1] * _eyeDir[1] + _MV.m_m[c][2] * _eyeDir[2];
+  }
+}
+
+// how far along the ray it enters the sphere, negative if it misses
+static float enterSphere(const float *_origin, const float *_dir, const ngl::Vec3 &_centre, float _radius)
+{
+  float oc[3] = {_origin[0] - _centre.m_x, _origin[1] - _centre.m_y, _origin[2] - _centre.m_z};
+  auto a = _dir[0] * _dir[0] + _dir[1] * _dir[1] + _dir[2] * _dir[2];
+  auto b = oc[0] * _dir[0] + oc[1] * _dir[1] + oc[2] * _dir[2];
+  auto c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - _radius * _radius;
+  if (c <= 0.0f)
+    return 0.0f;
+  auto discriminant = b * b - a * c;
+  if (b > 0.0f || discriminant < 0.0f)
+    return -1.0f;
+  return (-b - std::sqrt(discriminant)) / a;
+}
+
+void NGLScene::refitBVH(const std::vector<ngl::Real> &_weights)
+{
+  if (_weights == m_bvhWeights)
+    return;
+  PROFILE_ZONE("refitBVH");
+  m_engine.evaluate(_weights.data(), m_pickResult);
+  m_bvh.refit(m_pickResult.component(0), m_pickResult.component(1), m_pickResult.component(2), 1);
+  m_bvhWeights = _weights;
+  ++m_pickRefits;
+}
+
+void NGLScene::pick(float _x, float _y)
+{
+  if (!ready() || m_bvh.numNodes() == 0)
+    return;
+  PROFILE_ZONE("pick");
+  auto start = std::chrono::steady_clock::now();
+  // the ray through the pixel in eye space, m_project[0][0] and [1][1] are the x and y scales of the projection
+  float eyeDir[3] = {(2.0f * _x / width() - 1.0f) / m_project.m_m[0][0], (1.0f - 2.0f * _y / height()) / m_project.m_m[1][1], -1.0f};
+  float origin[3];
+  float dir[3];
+  MorphBVH::Hit hit;
+  m_picked = false;
+  if (m_crowdMode)
+  {
+    // the instances whose bounds the ray enters nearest first, every transform is rigid so distances along the ray
+    // are the same for all of them and the search stops once the hit is nearer than the next instance's bounds
+    std::vector<std::pair<float, size_t>> candidates;
+    for (size_t i = 0; i < m_crowd.size(); ++i)
+    {
+      eyeToModel(m_crowdMV * m_crowd.transform(i), eyeDir, origin, dir);
+      auto enter = enterSphere(origin, dir, m_morph.boundsCentre(), m_morph.boundsRadius());
+      if (enter >= 0.0f)
+        candidates.push_back({enter, i});
+    }
+    std::sort(candidates.begin(), candidates.end());
+    std::vector<ngl::Real> weights(m_crowd.numTargets());
+    for (auto &candidate : candidates)
+    {
+      if (candidate.first >= hit.distance)
+        break;
+      for (size_t t = 0; t < weights.size(); ++t)
+        weights[t] = m_crowd.weight(candidate.second, t);
+      refitBVH(weights);
+      eyeToModel(m_crowdMV * m_crowd.transform(candidate.second), eyeDir, origin, dir);
+      if (m_bvh.intersect(origin, dir, hit))
+      {
+        m_picked = true;
+        m_pickInstance = candidate.second;
+        m_pickPoint = ngl::Vec3(origin[0] + dir[0] * hit.distance, origin[1] + dir[1] * hit.distance, origin[2] + dir[2] * hit.distance);
+      }
+    }
+  }
+  else
+  {
+    refitBVH(m_morph.weights());
+    eyeToModel(m_MV, eyeDir, origin, dir);
+    m_picked = m_bvh.intersect(origin, dir, hit);
+    m_pickInstance = 0;
+    m_pickPoint = ngl::Vec3(origin[0] + dir[0] * hit.distance, origin[1] + dir[1] * hit.distance, origin[2] + dir[2] * hit.distance);
+  }
+  m_pickTriangle = hit.triangle;
+  m_pickMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (m_picked)
+    std::cout << "Picked instance " << m_pickInstance << " triangle " << m_pickTriangle << " at " << m_pickPoint.m_x << ' ' << m_pickPoint.m_y << ' '
+              << m_pickPoint.m_z << " in " << m_pickMs << "ms\n";
+  // the pick line of the overlay has changed even if nothing else has
+  m_state.mark(SceneState::DISPLAY);
+  requestFrame();
+}
+
+void NGLScene::changeWeight(size_t _target, Direction _d)
+{
+  if (_target >= m_morph.numTargets())
+    return;
+  auto w = m_keyWeights[_target];
+  setKeyWeight(_target, _d == Direction::UP ? w + 0.1f : w - 0.1f);
+}
+
+void NGLScene::setKeyWeight(size_t _target, ngl::Real _w)
+{
+  if (_target >= m_keyWeights.size())
+    return;
+  // the keys set the weight the clips are added to, it is kept in the 0.0 -> 1.0 range
+  m_keyWeights[_target] = std::clamp(_w, 0.0f, 1.0f);
+  // at either end of the range nothing changes so applyWeights marks nothing and there is nothing to draw
+  applyWeights(m_clock.time());
 }
 
 NGLScene::~NGLScene()
 {
+  // the parse can't be stopped part way so closing while loading waits for it
+  if (m_loadThread.joinable())
+    m_loadThread.join();
+  std::cout << "Frames drawn " << m_state.framesRendered() << " skipped " << m_state.framesSkipped() << '\n';
+  if (!m_traceFile.empty())
+    Profiler::instance().writeChromeTrace(m_traceFile);
   std::cout << "Shutting down NGL, removing VAO's and Shaders\n";
 }
 
@@ -174,6 +801,9 @@ void NGLScene::resizeGL(int _w, int _h)
   m_project = ngl::perspective(45.0f, static_cast<float>(_w) / _h, 0.05f, 350.0f);
   m_win.width = static_cast<int>(_w * devicePixelRatio());
   m_win.height = static_cast<int>(_h * devicePixelRatio());
+  if (m_text)
+    m_text->setScreenSize(_w, _h);
+  m_state.mark(SceneState::VIEWPORT | SceneState::CAMERA);
 }
 
 void NGLScene::initializeGL()
@@ -194,75 +824,19 @@ void NGLScene::initializeGL()
   ngl::Vec3 to(0, 10, 0);
   ngl::Vec3 up(0, 1, 0);
 
-  // first we create a mesh from an obj passing in the obj file and texture
-  std::unique_ptr<ngl::Obj> mesh1(new ngl::Obj("models/BrucePose1.obj"));
-  m_meshes.push_back(std::move(mesh1));
-
-  std::unique_ptr<ngl::Obj> mesh2(new ngl::Obj("models/BrucePose2.obj"));
-  m_meshes.push_back(std::move(mesh2));
-
-  std::unique_ptr<ngl::Obj> mesh3(new ngl::Obj("models/BrucePose3.obj"));
-  m_meshes.push_back(std::move(mesh3));
-  createMorphMesh();
+  // the poses are loaded and packed on a worker so the window is up straight away, paintGL uploads them once it is
+  // done and the tick keeps the progress drawing until then
+  m_loadStart = std::chrono::steady_clock::now();
+  m_loadThread = std::thread(&NGLScene::loadPoses, this);
+  m_timerAnimation->start(c_animationTick);
 
   m_view = ngl::lookAt(from, to, up);
   // set the shape using FOV 45 Aspect Ratio based on Width and Height
   // The final two are near and far clipping planes of 0.5 and 10
   m_project = ngl::perspective(45, (float)720.0 / 576.0, 0.05, 350);
-  // we are creating a shader called PerFragADS
-  ngl::ShaderLib::createShaderProgram("PerFragADS");
-  // now we are going to create empty shaders for Frag and Vert
-  ngl::ShaderLib::attachShader("PerFragADSVertex", ngl::ShaderType::VERTEX);
-  ngl::ShaderLib::attachShader("PerFragADSFragment", ngl::ShaderType::FRAGMENT);
-  // attach the source
-  ngl::ShaderLib::loadShaderSource("PerFragADSVertex", "shaders/PerFragASDVert.glsl");
-  ngl::ShaderLib::loadShaderSource("PerFragADSFragment", "shaders/PerFragASDFrag.glsl");
-  // compile the shaders
-  ngl::ShaderLib::compileShader("PerFragADSVertex");
-  ngl::ShaderLib::compileShader("PerFragADSFragment");
-  // add them to the program
-  ngl::ShaderLib::attachShaderToProgram("PerFragADS", "PerFragADSVertex");
-  ngl::ShaderLib::attachShaderToProgram("PerFragADS", "PerFragADSFragment");
-
-  // now we have associated this data we can link the shader
-  ngl::ShaderLib::linkProgramObject("PerFragADS");
-  // and make it active ready to load values
-  ngl::ShaderLib::use("PerFragADS");
-  // now we need to set the material and light values
-  /*
-   *struct MaterialInfo
-   {
-        // Ambient reflectivity
-        vec3 Ka;
-        // Diffuse reflectivity
-        vec3 Kd;
-        // Specular reflectivity
-        vec3 Ks;
-        // Specular shininess factor
-        float shininess;
-  };*/
-  ngl::ShaderLib::setUniform("material.Ka", 0.1f, 0.1f, 0.1f);
-  // red diffuse
-  ngl::ShaderLib::setUniform("material.Kd", 0.8f, 0.8f, 0.8f);
-  // white spec
-  ngl::ShaderLib::setUniform("material.Ks", 1.0f, 1.0f, 1.0f);
-  ngl::ShaderLib::setUniform("material.shininess", 1000.0f);
-  // now for  the lights values (all set to white)
-  /*struct LightInfo
-  {
-  // Light position in eye coords.
-  vec4 position;
-  // Ambient light intensity
-  vec3 La;
-  // Diffuse light intensity
-  vec3 Ld;
-  // Specular light intensity
-  vec3 Ls;
-  };*/
-  ngl::ShaderLib::setUniform("light.position", ngl::Vec3(2, 20, 2));
-  ngl::ShaderLib::setUniform("light.La", 0.1f, 0.1f, 0.1f);
-  ngl::ShaderLib::setUniform("light.Ld", 1.0f, 1.0f, 1.0f);
-  ngl::ShaderLib::setUniform("light.Ls", 0.9f, 0.9f, 0.9f);
+  createShaders();
+  m_uniformRing.create(c_uniformRingBytes);
+  std::cout << "Per frame constants in a " << (m_uniformRing.persistent() ? "persistently mapped" : "staged") << " uniform ring\n";
 
   glEnable(GL_DEPTH_TEST); // for removal of hidden surfaces
 
@@ -272,28 +846,102 @@ void NGLScene::initializeGL()
   m_text->setScreenSize(width(), height());
 }
 
-void NGLScene::loadMatricesToShader()
+std::vector<ShaderCache::Program> NGLScene::shaderPrograms()
 {
-  ngl::ShaderLib::use("PerFragADS");
-  ngl::Mat4 MV;
-  ngl::Mat4 MVP;
-  ngl::Mat3 normalMatrix;
-  MV = m_view * m_mouseGlobalTX;
-  MVP = m_project * MV;
-  normalMatrix = MV;
-  normalMatrix.inverse().transpose();
-  ngl::ShaderLib::setUniform("MVP", MVP);
-  ngl::ShaderLib::setUniform("MV", MV);
-  ngl::ShaderLib::setUniform("normalMatrix", normalMatrix);
-  ngl::ShaderLib::setUniform("weight1", m_weight1);
-  ngl::ShaderLib::setUniform("weight2", m_weight2);
+  // all the lit programs share the fragment shader
+  ShaderCache::Stage fragment{"PerFragADSFragment", ngl::ShaderType::FRAGMENT, "shaders/PerFragASDFrag.glsl"};
+  return {{"PerFragADS", {{"PerFragADSVertex", ngl::ShaderType::VERTEX, "shaders/PerFragASDVert.glsl"}, fragment}},
+          // the crowd shader is the same blend and lighting but with the transform and weights per instance
+          {"MorphCrowd", {{"MorphCrowdVertex", ngl::ShaderType::VERTEX, "shaders/MorphCrowdVert.glsl"}, fragment}},
+          // the pre-pass program is vertex only, the blended vertex is captured with transform feedback
+          {"MorphFeedback", {{"MorphFeedbackVertex", ngl::ShaderType::VERTEX, "shaders/MorphFeedbackVert.glsl"}}, {}, {"morphedPosition", "morphedNormal"}},
+          // and the program that draws the captured mesh, lit the same as the others
+          {"MorphedGeometry", {{"MorphedGeometryVertex", ngl::ShaderType::VERTEX, "shaders/MorphedVert.glsl"}, fragment}}};
 }
 
-void NGLScene::paintGL()
+std::string NGLScene::shaderCacheDirectory()
 {
-  // clear the screen and depth buffer
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glViewport(0, 0, m_win.width, m_win.height);
+  return QCoreApplication::applicationDirPath().toStdString() + "/shadercache";
+}
+
+int NGLScene::warmShaderCache(const QSurfaceFormat &_format)
+{
+  QOffscreenSurface surface;
+  surface.setFormat(_format);
+  surface.create();
+  QOpenGLContext context;
+  context.setFormat(_format);
+  if (!surface.isValid() || !context.create() || !context.makeCurrent(&surface))
+  {
+    std::cerr << "Unable to create an offscreen OpenGL " << _format.majorVersion() << "." << _format.minorVersion() << " context\n";
+    return EXIT_FAILURE;
+  }
+  ngl::NGLInit::initialize();
+  ShaderCache cache(shaderCacheDirectory());
+  bool ok = true;
+  for (auto &program : shaderPrograms())
+    ok = cache.build(program) && ok;
+  std::cout << "Shader cache " << shaderCacheDirectory() << " has " << cache.hits() << " programs up to date, built " << cache.misses() << '\n';
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void NGLScene::createShaders()
+{
+  PROFILE_ZONE("shader compile");
+  // binaries from an earlier run are used when the sources, defines and driver all match, the rest are compiled
+  ShaderCache cache(shaderCacheDirectory());
+  for (auto &program : shaderPrograms())
+  {
+    if (!cache.build(program))
+    {
+      std::cerr << "Unable to build shader program " << program.name << '\n';
+      exit(EXIT_FAILURE);
+    }
+  }
+  std::cout << "Shader programs " << cache.hits() << " from the binary cache, " << cache.misses() << " compiled\n";
+  // block bindings and uniforms aren't part of a binary so are always set here
+  auto crowdProgram = ngl::ShaderLib::getProgramID("MorphCrowd");
+  glUniformBlockBinding(crowdProgram, glGetUniformBlockIndex(crowdProgram, "MorphRanges"), c_morphRangeBinding);
+  ngl::ShaderLib::use("MorphCrowd");
+  ngl::ShaderLib::setUniform("TBO", 0);
+  ngl::ShaderLib::setUniform("instanceData", 1);
+  // the morph weights come from the uniform buffer
+  for (auto name : {"PerFragADS", "MorphFeedback"})
+  {
+    auto program = ngl::ShaderLib::getProgramID(name);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "MorphWeights"), c_morphWeightBinding);
+  }
+  // the drawing programs all read the transforms from the ring and share the lighting block
+  for (auto name : {"MorphCrowd", "MorphedGeometry", "PerFragADS"})
+  {
+    auto program = ngl::ShaderLib::getProgramID(name);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Transforms"), c_transformBinding);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Lighting"), c_lightingBinding);
+  }
+  // std140 LightInfo then MaterialInfo, every vec3 starts on a vec4 and shininess fills the gap after Ks
+  struct Lighting
+  {
+    GLfloat position[4];
+    GLfloat La[4];
+    GLfloat Ld[4];
+    GLfloat Ls[4];
+    GLfloat Ka[4];
+    GLfloat Kd[4];
+    GLfloat Ks[3];
+    GLfloat shininess;
+  };
+  // the light is white and in eye coords, grey diffuse and white spec
+  Lighting lighting = {{2.0f, 20.0f, 2.0f, 0.0f}, {0.1f, 0.1f, 0.1f, 0.0f}, {1.0f, 1.0f, 1.0f, 0.0f}, {0.9f, 0.9f, 0.9f, 0.0f},
+                       {0.1f, 0.1f, 0.1f, 0.0f}, {0.8f, 0.8f, 0.8f, 0.0f}, {1.0f, 1.0f, 1.0f}, 1000.0f};
+  glGenBuffers(1, &m_lightingUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_lightingUBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(Lighting), &lighting, GL_STATIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, c_lightingBinding, m_lightingUBO);
+}
+
+void NGLScene::updateTransforms()
+{
+  PROFILE_ZONE("updateTransforms");
   // Rotation based on the mouse position for our global transform
   auto rotX = ngl::Mat4::rotateX(m_win.spinXFace);
   auto rotY = ngl::Mat4::rotateY(m_win.spinYFace);
@@ -304,25 +952,207 @@ void NGLScene::paintGL()
   m_mouseGlobalTX.m_m[3][1] = m_modelPos.m_y;
   m_mouseGlobalTX.m_m[3][2] = m_modelPos.m_z;
 
-  loadMatricesToShader();
-  // draw the mesh
-  m_vaoMesh->bind();
-  glBindTexture(GL_TEXTURE_BUFFER, m_tboID);
-  m_vaoMesh->draw();
-  m_vaoMesh->unbind();
+  auto fill = [this](const ngl::Mat4 &_view, Transforms &o_transforms, ngl::Mat4 &o_MV)
+  {
+    ngl::Mat4 MV = _view * m_mouseGlobalTX;
+    o_MV = MV;
+    ngl::Mat4 MVP = m_project * MV;
+    ngl::Mat3 normalMatrix = MV;
+    normalMatrix.inverse().transpose();
+    std::copy(MVP.m_openGL, MVP.m_openGL + 16, o_transforms.MVP);
+    std::copy(MV.m_openGL, MV.m_openGL + 16, o_transforms.MV);
+    for (size_t c = 0; c < 3; ++c)
+    {
+      std::copy(normalMatrix.m_openGL + c * 3, normalMatrix.m_openGL + c * 3 + 3, o_transforms.normalMatrix + c * 4);
+      o_transforms.normalMatrix[c * 4 + 3] = 0.0f;
+    }
+    o_transforms.firstInstance = 0;
+  };
+  // the single character and pre-pass programs take the same matrices, the crowd has its own camera
+  fill(m_view, m_transforms, m_MV);
+  fill(m_crowdView, m_crowdTransforms, m_crowdMV);
+  // the level of detail only changes with the camera (or the window size, which also marks the camera)
+  if (ready())
+    m_lodLevel = selectLOD(m_MV);
+  m_crowdLODDirty = true;
+}
+
+void NGLScene::bindTransforms(const Transforms &_transforms)
+{
+  UniformRing::Block block;
+  if (!m_uniformRing.allocate(sizeof(Transforms), block))
+  {
+    std::cerr << "Uniform ring full, raise c_uniformRingBytes\n";
+    return;
+  }
+  std::memcpy(block.data, &_transforms, sizeof(Transforms));
+  m_uniformRing.bind(c_transformBinding, block);
+}
+
+void NGLScene::paintGL()
+{
+  // collects the GPU zones from earlier frames so comes before any of this frame's zones
+  PROFILE_FRAME();
+  PROFILE_ZONE("paintGL");
+  m_state.frameRendered();
+  // clear the screen and depth buffer
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // the deltas go up a slice a frame, when the last one is resident this sets up the crowd and marks everything dirty
+  if (!ready())
+    continueLoading(c_uploadSliceBytes, false);
+  if (m_state.dirty(SceneState::VIEWPORT))
+    glViewport(0, 0, m_win.width, m_win.height);
+  // the matrices are only worked out again when the camera has moved but are written to the ring every frame
+  if (m_state.dirty(SceneState::CAMERA))
+    updateTransforms();
+  m_uniformRing.beginFrame();
+  bindTransforms(m_crowdMode && ready() ? m_crowdTransforms : m_transforms);
+  if (!ready())
+  {
+    // the base pose (there are no active targets yet) once the mesh is up, with the progress over it
+    if (m_vaoMesh)
+    {
+      ngl::ShaderLib::use("PerFragADS");
+      m_vaoMesh->bind();
+      m_vaoMesh->draw();
+      m_vaoMesh->unbind();
+    }
+    m_uniformRing.endFrame();
+    m_state.clear();
+    drawLoadingText();
+    return;
+  }
+
+  // the targets the weights need go into the pool, then the weights as both the single character draw and the
+  // pre-pass read them
+  updateResidency();
+  uploadWeights();
+  {
+    PROFILE_ZONE("draw");
+    PROFILE_GPU_ZONE("draw");
+    if (m_crowdMode)
+    {
+      drawCrowd();
+    }
+    else if (m_prePass && m_blendMode == BlendMode::GPU)
+    {
+      // the CPU blend modes already write the morphed mesh into the VBO so the pre-pass only replaces the GPU one
+      morphPrePass();
+      ngl::ShaderLib::use("MorphedGeometry");
+      m_vaoMorphed->bind();
+      drawMesh();
+      m_vaoMorphed->unbind();
+    }
+    else
+    {
+      ngl::ShaderLib::use("PerFragADS");
+      // draw the mesh
+      m_vaoMesh->bind();
+      glBindTexture(GL_TEXTURE_BUFFER, m_tboID);
+      drawMesh();
+      m_vaoMesh->unbind();
+    }
+  }
+  m_uniformRing.endFrame();
+  // everything that changed has now been uploaded
+  m_state.clear();
+  // the text is the last thing drawn so these zones run to the end of the frame
+  PROFILE_ZONE("text");
+  PROFILE_GPU_ZONE("text");
   m_text->setColour(1.0f, 1.0f, 1.0f);
-  m_text->renderText(10, 700, fmt::format("Q-W change Pose one weight {:0.2f}", m_weight1));
-  m_text->renderText(10, 680, fmt::format("A-S change Pose two weight {:0.2f}", m_weight2));
+  m_text->renderText(10, 20, fmt::format("frames drawn {} skipped {}", m_state.framesRendered(), m_state.framesSkipped()));
+  if (m_crowdMode)
+  {
+    m_text->renderText(10, 700, fmt::format("Crowd of {}, C single character", m_crowd.size()));
+    m_text->renderText(10, 680, "Z trigger Left Punch X trigger Right on everyone, Space pause");
+    std::string counts;
+    for (size_t l = 0; l < m_lodCounts.size(); ++l)
+    {
+      counts += fmt::format(" {}:{}", l, m_lodCounts[l]);
+    }
+    m_text->renderText(10, 660, fmt::format("L level of detail {}, instances per level{}", m_lod ? "on" : "off", counts));
+    drawResidencyText(640);
+    drawPickText(620);
+    return;
+  }
+  if (m_morph.numTargets() > 0)
+    m_text->renderText(10, 700, fmt::format("Q-W change Pose one weight {:0.2f}", m_morph.weight(0)));
+  if (m_morph.numTargets() > 1)
+    m_text->renderText(10, 680, fmt::format("A-S change Pose two weight {:0.2f}", m_morph.weight(1)));
   m_text->renderText(10, 660, "Z trigger Left Punch X trigger Right");
+  static constexpr const char *modeNames[] = {"GPU TBO", "CPU sparse", "CPU SIMD"};
+  m_text->renderText(10, 640, fmt::format("{} of {} {} active, M cycle blend ({})", m_morph.activeTargets().size(),
+                                          m_morph.numShapes(), m_morph.hasBasis() ? "basis shapes" : "targets",
+                                          modeNames[static_cast<int>(m_blendMode)]));
+  m_text->renderText(10, 620, fmt::format("P morph pre-pass {} (run {} skipped {})", m_prePass ? "on" : "off", m_prePassRuns, m_prePassSkips));
+  auto &lod = m_morph.lods()[m_lodLevel];
+  m_text->renderText(10, 600, fmt::format("L level of detail {} (level {} {} triangles)", m_lod ? "on" : "off", m_lodLevel, lod.numIndices / 3));
+  if (m_meshletCulling && m_lodLevel == 0)
+    m_text->renderText(10, 580, fmt::format("K meshlet culling on ({} of {} meshlets, {} triangles in {} draws)", m_visibleMeshlets.size(),
+                                            m_morph.meshlets().meshlets().size(), m_meshletTriangles, m_drawCommands.size()));
+  else
+    m_text->renderText(10, 580, fmt::format("K meshlet culling {}", m_meshletCulling ? "on (LOD 0 only)" : "off"));
+  drawResidencyText(560);
+  if (m_crowdSize > 1)
+    m_text->renderText(10, 540, fmt::format("C show the crowd of {}", m_crowdSize));
+  drawPickText(520);
+}
+
+void NGLScene::drawPickText(int _y)
+{
+  if (!m_picked)
+  {
+    m_text->renderText(10, _y, fmt::format("Click to pick, nothing hit ({} refits)", m_pickRefits));
+    return;
+  }
+  m_text->renderText(10, _y, fmt::format("Picked {}triangle {} at [{:0.2f},{:0.2f},{:0.2f}] in {:0.3f}ms ({} refits)",
+                                         m_crowdMode ? fmt::format("instance {} ", m_pickInstance) : std::string(), m_pickTriangle,
+                                         m_pickPoint.m_x, m_pickPoint.m_y, m_pickPoint.m_z, m_pickMs, m_pickRefits));
+}
+
+void NGLScene::drawResidencyText(int _y)
+{
+  auto &stats = m_residency.stats();
+  m_text->renderText(10, _y, fmt::format("Target pool {} of {} slots, hits {} misses {} prefetched {} evicted {} released {}",
+                                         m_residency.numSlots(), m_morph.numShapes(), stats.hits, stats.misses, stats.prefetches,
+                                         stats.evictions, stats.hostReleases));
+}
+
+void NGLScene::drawLoadingText()
+{
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_loadStart;
+  m_text->setColour(1.0f, 1.0f, 1.0f);
+  switch (m_loadStage.load())
+  {
+  case LoadStage::LOADING:
+    m_text->renderText(10, 20, fmt::format("Loading {} poses {:0.0f}% ({:0.1f}s)", m_poseFiles.size(), 100.0f * m_morph.loadProgress(), elapsed.count()));
+    break;
+  case LoadStage::PROCESSING:
+    m_text->renderText(10, 20, fmt::format("Encoding {} morph targets ({:0.1f}s)", m_poseFiles.size() - 1, elapsed.count()));
+    break;
+  case LoadStage::UPLOADING:
+    m_text->renderText(10, 20, fmt::format("Uploading morph targets {:0.0f}% ({:0.1f}s), showing the base pose",
+                                           100.0 * m_deltaBytesUploaded / std::max<size_t>(1, m_residency.poolBytes()), elapsed.count()));
+    break;
+  case LoadStage::FAILED:
+    m_text->renderText(10, 20, "Unable to load the morph targets");
+    break;
+  case LoadStage::READY:
+    break;
+  }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
 
 void NGLScene::keyPressEvent(QKeyEvent *_event)
 {
+  // until the targets are resident only the window keys do anything
+  auto key = _event->key();
+  if (!ready() && key != Qt::Key_Escape && key != Qt::Key_F && key != Qt::Key_N)
+    return;
   // this method is called every time the main window recives a key event.
   // we then switch on the key value and set the camera in the GLWindow
-  switch (_event->key())
+  switch (key)
   {
   // escape key to quite
   case Qt::Key_Escape:
@@ -337,78 +1167,120 @@ void NGLScene::keyPressEvent(QKeyEvent *_event)
     showNormal();
     break;
   case Qt::Key_Q:
-    changeWeight(Weights::POSE1, Direction::DOWN);
+    changeWeight(0, Direction::DOWN);
     break;
   case Qt::Key_W:
-    changeWeight(Weights::POSE1, Direction::UP);
+    changeWeight(0, Direction::UP);
     break;
 
   case Qt::Key_A:
-    changeWeight(Weights::POSE2, Direction::DOWN);
+    changeWeight(1, Direction::DOWN);
     break;
   case Qt::Key_S:
-    changeWeight(Weights::POSE2, Direction::UP);
+    changeWeight(1, Direction::UP);
     break;
   case Qt::Key_Space:
     toggleAnimation();
     break;
   case Qt::Key_Z:
-    punchLeft();
+    punch(0);
     break;
   case Qt::Key_X:
-    punchRight();
+    punch(1);
+    break;
+  case Qt::Key_M:
+    cycleBlendMode();
+    m_state.mark(SceneState::DISPLAY);
+    break;
+  case Qt::Key_C:
+    toggleCrowd();
+    m_state.mark(SceneState::DISPLAY);
+    break;
+  case Qt::Key_P:
+    togglePrePass();
+    m_state.mark(SceneState::DISPLAY);
+    break;
+  case Qt::Key_L:
+    toggleLOD();
+    break;
+  case Qt::Key_K:
+    toggleMeshletCulling();
+    break;
+  case Qt::Key_T:
+    Profiler::instance().writeChromeTrace(m_traceFile.empty() ? std::string_view(c_defaultTraceFile) : m_traceFile);
     break;
 
   default:
     break;
   }
-  // finally update the GLWindow and re-draw
-  update();
+  // finally re-draw if the key changed anything
+  requestFrame();
 }
 
-void NGLScene::updateLeft()
+void NGLScene::tick()
 {
-  static Direction left = Direction::UP;
-  if (left == Direction::UP)
+  if (!ready())
   {
-    m_weight1 += 0.2;
-    if (m_weight1 > 1.1)
-      left = Direction::DOWN;
+    // keep frames coming while loading, paintGL does the upload and draws the progress
+    if (m_loadStage == LoadStage::FAILED)
+      m_timerAnimation->stop();
+    m_state.mark(SceneState::DISPLAY);
+    requestFrame();
+    return;
   }
-  else if (left == Direction::DOWN)
-  {
-    m_weight1 -= 0.2;
-    if (m_weight1 <= 0.0)
-    {
-      m_weight1 = 0.0;
-
-      m_timerLeft->stop();
-      left = Direction::UP;
-      m_punchLeft = false;
-    }
-  }
-  update();
+  advanceAnimation();
+  // go idle once the clips have finished, the crowd always has something playing
+  if (!m_animator.active() && !m_crowdMode)
+    m_timerAnimation->stop();
+  requestFrame();
 }
 
-void NGLScene::updateRight()
+void NGLScene::advanceAnimation()
 {
-  static Direction right = Direction::UP;
-  if (right == Direction::UP)
+  if (!ready())
+    return;
+  PROFILE_ZONE("advanceAnimation");
+  auto dt = m_clock.tick();
+  applyWeights(m_clock.time());
+  if (m_crowdMode && m_crowd.update(m_clock.time(), dt))
   {
-    m_weight2 += 0.2;
-    if (m_weight2 > 1.1)
-      right = Direction::DOWN;
+    m_crowdDirty = true;
+    m_state.mark(SceneState::WEIGHTS);
   }
-  else if (right == Direction::DOWN)
+}
+
+void NGLScene::startAnimation()
+{
+  if (m_animation && !m_timerAnimation->isActive())
+    m_timerAnimation->start(c_animationTick);
+}
+
+void NGLScene::toggleAnimation()
+{
+  m_animation ^= true;
+  m_clock.setPaused(!m_animation);
+  if (m_animation)
+    startAnimation();
+  else
+    m_timerAnimation->stop();
+}
+
+void NGLScene::applyWeights(double _time)
+{
+  m_animatedWeights = m_keyWeights;
+  m_animator.evaluate(_time, m_animatedWeights.data(), m_animatedWeights.size());
+  for (size_t t = 0; t < m_animatedWeights.size(); ++t)
   {
-    m_weight2 -= 0.2f;
-    if (m_weight2 <= 0.0)
-    {
-      m_weight2 = 0.0;
-      m_timerRight->stop();
-      right = Direction::UP;
-      m_punchRight = false;
-    }
+    // setWeight clamps so overlapping clips can't push past 1.0
+    auto w = m_morph.weight(t);
+    m_morph.setWeight(t, m_animatedWeights[t]);
+    if (m_morph.weight(t) != w)
+      m_state.mark(SceneState::WEIGHTS);
   }
-  update();
+}
+
+void NGLScene::requestFrame()
+{
+  if (m_state.requestFrame())
+    update();
 }
@@ -20,7 +20,8 @@ void NGLScene::mouseMoveEvent(QMouseEvent *_event)
     m_win.spinYFace += static_cast<int>(0.5f * diffx);
     m_win.origX = position.x();
     m_win.origY = position.y();
-    update();
+    m_state.mark(SceneState::CAMERA);
+    requestFrame();
   }
   // right mouse translate code
   else if (m_win.translate && _event->buttons() == Qt::RightButton)
@@ -31,7 +32,8 @@ void NGLScene::mouseMoveEvent(QMouseEvent *_event)
     m_win.origYPos = position.y();
     m_modelPos.m_x += INCREMENT * diffX;
     m_modelPos.m_y -= INCREMENT * diffY;
-    update();
+    m_state.mark(SceneState::CAMERA);
+    requestFrame();
   }
 }
 
@@ -51,6 +53,8 @@ void NGLScene::mousePressEvent(QMouseEvent *_event)
     m_win.origX = position.x();
     m_win.origY = position.y();
     m_win.rotate = true;
+    // a click also picks, dragging from here still rotates
+    pick(position.x(), position.y());
   }
   // right mouse translate mode
   else if (_event->button() == Qt::RightButton)
@@ -86,10 +90,12 @@ void NGLScene::wheelEvent(QWheelEvent *_event)
   if (_event->angleDelta().y() > 0)
   {
     m_modelPos.m_z += ZOOM;
+    m_state.mark(SceneState::CAMERA);
   }
   else if (_event->angleDelta().y() < 0)
   {
     m_modelPos.m_z -= ZOOM;
+    m_state.mark(SceneState::CAMERA);
   }
-  update();
+  requestFrame();
 }
@@ -0,0 +1,168 @@
+#include "OffscreenBenchmark.h"
+#include "NGLScene.h"
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+// the GL_TIME_ELAPSED results are read this many frames after they were issued
+constexpr size_t c_queryLatency = 4;
+// the scripted animation runs at this rate whatever the real frame rate
+constexpr double c_benchmarkStep = 1.0 / 60.0;
+
+OffscreenBenchmark::Stats OffscreenBenchmark::stats(std::vector<double> _times)
+{
+  Stats s;
+  if (_times.empty())
+    return s;
+  std::sort(_times.begin(), _times.end());
+  auto n = _times.size();
+  auto rank = [&](double _p) { return _times[std::min(n - 1, static_cast<size_t>(std::ceil(_p * n)) - 1)]; };
+  s.mean = std::accumulate(_times.begin(), _times.end(), 0.0) / n;
+  s.p50 = rank(0.50);
+  s.p95 = rank(0.95);
+  s.p99 = rank(0.99);
+  s.min = _times.front();
+  s.max = _times.back();
+  return s;
+}
+
+void OffscreenBenchmark::script(NGLScene &_scene, size_t _frame)
+{
+  constexpr float twoPi = 6.28318530718f;
+  // every target sweeps 0 -> 1 -> 0 over two seconds, each a little out of phase with the last
+  for (size_t t = 0; t < _scene.numTargets(); ++t)
+  {
+    _scene.setKeyWeight(t, 0.5f + 0.5f * std::sin(twoPi * _frame / 120.0f + static_cast<float>(t)));
+  }
+  if (_frame % 30 == 0 && _scene.numTargets() > 0)
+    _scene.punch((_frame / 30) % _scene.numTargets());
+  _scene.advanceAnimation();
+}
+
+static QJsonObject toJson(const OffscreenBenchmark::Stats &_s)
+{
+  QJsonObject o;
+  o["mean"] = _s.mean;
+  o["p50"] = _s.p50;
+  o["p95"] = _s.p95;
+  o["p99"] = _s.p99;
+  o["min"] = _s.min;
+  o["max"] = _s.max;
+  return o;
+}
+
+int OffscreenBenchmark::run(NGLScene &_scene, const QSurfaceFormat &_format)
+{
+  QOffscreenSurface surface;
+  surface.setFormat(_format);
+  surface.create();
+  QOpenGLContext context;
+  context.setFormat(_format);
+  if (!surface.isValid() || !context.create() || !context.makeCurrent(&surface))
+  {
+    std::cerr << "Unable to create an offscreen OpenGL " << _format.majorVersion() << "." << _format.minorVersion() << " context\n";
+    return EXIT_FAILURE;
+  }
+  // the scene draws into whatever framebuffer is bound, it never binds 0 itself
+  QOpenGLFramebufferObjectFormat fboFormat;
+  fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+  fboFormat.setSamples(_format.samples());
+  QOpenGLFramebufferObject fbo(m_options.width, m_options.height, fboFormat);
+  if (!fbo.isValid())
+  {
+    std::cerr << "Unable to create the " << m_options.width << "x" << m_options.height << " benchmark FBO\n";
+    return EXIT_FAILURE;
+  }
+  fbo.bind();
+  _scene.resize(m_options.width, m_options.height);
+  _scene.setFixedTimestep(c_benchmarkStep);
+  _scene.initializeGL();
+  // no frames are drawn until the measured loop so do the whole load and upload now
+  if (!_scene.finishLoading())
+    return EXIT_FAILURE;
+  _scene.resizeGL(m_options.width, m_options.height);
+
+  std::string renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  std::string version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+  std::cout << "Benchmarking " << m_options.frames << " frames at " << m_options.width << "x" << m_options.height << " on "
+            << renderer << " (" << version << ")\n";
+
+  GLuint queries[c_queryLatency];
+  glGenQueries(c_queryLatency, queries);
+  std::vector<double> cpuTimes;
+  std::vector<double> gpuTimes;
+  cpuTimes.reserve(m_options.frames);
+  gpuTimes.reserve(m_options.frames);
+  auto readQuery = [&](GLuint _query)
+  {
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(_query, GL_QUERY_RESULT, &ns);
+    gpuTimes.push_back(ns * 1e-6);
+  };
+  auto start = std::chrono::steady_clock::now();
+  for (size_t frame = 0; frame < m_options.frames; ++frame)
+  {
+    auto &query = queries[frame % c_queryLatency];
+    if (frame >= c_queryLatency)
+      readQuery(query);
+    auto frameStart = std::chrono::steady_clock::now();
+    script(_scene, frame);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    _scene.paintGL();
+    glEndQuery(GL_TIME_ELAPSED);
+    glFlush();
+    cpuTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+  }
+  // collect the queries still in flight, oldest first
+  for (size_t i = 0; i < std::min(c_queryLatency, m_options.frames); ++i)
+  {
+    readQuery(queries[(m_options.frames + i) % c_queryLatency]);
+  }
+  glFinish();
+  double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  glDeleteQueries(c_queryLatency, queries);
+
+  auto cpu = stats(cpuTimes);
+  auto gpu = stats(gpuTimes);
+  auto print = [](const char *_name, const Stats &_s)
+  {
+    std::cout << _name << " ms mean " << _s.mean << " p50 " << _s.p50 << " p95 " << _s.p95 << " p99 " << _s.p99 << " min "
+              << _s.min << " max " << _s.max << '\n';
+  };
+  print("CPU", cpu);
+  print("GPU", gpu);
+  std::cout << "Wall " << wall / m_options.frames << " ms per frame (" << 1000.0 * m_options.frames / wall << " fps)\n";
+
+  QJsonObject results;
+  results["frames"] = static_cast<qint64>(m_options.frames);
+  results["width"] = m_options.width;
+  results["height"] = m_options.height;
+  results["samples"] = _format.samples();
+  results["renderer"] = QString::fromStdString(renderer);
+  results["version"] = QString::fromStdString(version);
+  results["vertices"] = static_cast<qint64>(_scene.numVerts());
+  results["targets"] = static_cast<qint64>(_scene.numTargets());
+  results["instances"] = static_cast<qint64>(_scene.crowdSize());
+  results["cpu_ms"] = toJson(cpu);
+  results["gpu_ms"] = toJson(gpu);
+  results["wall_ms_per_frame"] = wall / m_options.frames;
+  QFile file(QString::fromStdString(m_options.output));
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    std::cerr << "Unable to write " << m_options.output << '\n';
+    return EXIT_FAILURE;
+  }
+  file.write(QJsonDocument(results).toJson());
+  std::cout << "Results written to " << m_options.output << '\n';
+  fbo.release();
+  context.doneCurrent();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,464 @@
+#include "PoseSetLoader.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a read only view of a whole file, mapped where mmap is available else read into memory
+//----------------------------------------------------------------------------------------------------------------------
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::string &_path)
+    {
+#if !defined(_WIN32)
+      int fd = open(_path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0)
+      {
+        void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED)
+        {
+          m_data = static_cast<const char *>(ptr);
+          m_size = static_cast<size_t>(st.st_size);
+          m_mapped = true;
+        }
+      }
+      // the mapping keeps its own reference to the file
+      close(fd);
+#else
+      std::ifstream in(_path, std::ios::binary | std::ios::ate);
+      if (!in.is_open())
+        return;
+      m_fallback.resize(static_cast<size_t>(in.tellg()));
+      in.seekg(0);
+      if (in.read(m_fallback.data(), static_cast<std::streamsize>(m_fallback.size())) && !m_fallback.empty())
+      {
+        m_data = m_fallback.data();
+        m_size = m_fallback.size();
+      }
+#endif
+    }
+    ~MappedFile()
+    {
+#if !defined(_WIN32)
+      if (m_mapped)
+        munmap(const_cast<char *>(m_data), m_size);
+#endif
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    bool valid() const { return m_data != nullptr; }
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+  private:
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false;
+    std::vector<char> m_fallback;
+};
+
+bool isSpace(char _c)
+{
+  return _c == ' ' || _c == '\t' || _c == '\r';
+}
+
+bool isDigit(char _c)
+{
+  return _c >= '0' && _c <= '9';
+}
+
+const char *skipSpace(const char *_p, const char *_end)
+{
+  while (_p < _end && isSpace(*_p))
+    ++_p;
+  return _p;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the kind of line, only the ones we use are told apart
+//----------------------------------------------------------------------------------------------------------------------
+enum class Line
+{
+  VERTEX,
+  NORMAL,
+  FACE,
+  OTHER
+};
+
+Line classify(const char *&io_p, const char *_end)
+{
+  auto keyword = [&](const char *_word, size_t _length)
+  {
+    if (static_cast<size_t>(_end - io_p) < _length || !std::equal(_word, _word + _length, io_p))
+      return false;
+    if (io_p + _length < _end && !isSpace(io_p[_length]))
+      return false;
+    io_p += _length;
+    return true;
+  };
+  io_p = skipSpace(io_p, _end);
+  if (keyword("v", 1))
+    return Line::VERTEX;
+  if (keyword("vn", 2))
+    return Line::NORMAL;
+  if (keyword("f", 1))
+    return Line::FACE;
+  return Line::OTHER;
+}
+
+bool parseInt(const char *&io_p, const char *_end, int64_t &o_value)
+{
+  bool negative = false;
+  if (io_p < _end && (*io_p == '-' || *io_p == '+'))
+    negative = *io_p++ == '-';
+  if (io_p == _end || !isDigit(*io_p))
+    return false;
+  int64_t value = 0;
+  for (; io_p < _end && isDigit(*io_p); ++io_p)
+  {
+    value = std::min<int64_t>(value * 10 + (*io_p - '0'), INT64_C(1) << 40);
+  }
+  o_value = negative ? -value : value;
+  return true;
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief locale independent float parse that doesn't need a terminated string (the mapped file isn't). The digits
+/// are gathered into an integer and scaled once so it is within an ulp of strtof for anything an exporter writes.
+//----------------------------------------------------------------------------------------------------------------------
+bool parseFloat(const char *&io_p, const char *_end, float &o_value)
+{
+  static constexpr double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  io_p = skipSpace(io_p, _end);
+  bool negative = false;
+  if (io_p < _end && (*io_p == '-' || *io_p == '+'))
+    negative = *io_p++ == '-';
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  // past 18 digits the rest can't change a float so they only move the exponent
+  constexpr uint64_t limit = UINT64_C(100000000000000000);
+  for (; io_p < _end && isDigit(*io_p); ++io_p, digits = true)
+  {
+    if (mantissa < limit)
+      mantissa = mantissa * 10 + static_cast<uint64_t>(*io_p - '0');
+    else
+      ++exponent;
+  }
+  if (io_p < _end && *io_p == '.')
+  {
+    for (++io_p; io_p < _end && isDigit(*io_p); ++io_p, digits = true)
+    {
+      if (mantissa < limit)
+      {
+        mantissa = mantissa * 10 + static_cast<uint64_t>(*io_p - '0');
+        --exponent;
+      }
+    }
+  }
+  if (!digits)
+    return false;
+  if (io_p < _end && (*io_p == 'e' || *io_p == 'E'))
+  {
+    ++io_p;
+    int64_t e;
+    if (!parseInt(io_p, _end, e))
+      return false;
+    exponent += static_cast<int>(std::clamp<int64_t>(e, -1000, 1000));
+  }
+  double value = static_cast<double>(mantissa);
+  if (exponent >= 0)
+    value *= exponent <= 22 ? powers[exponent] : std::pow(10.0, exponent);
+  else
+    value /= -exponent <= 22 ? powers[-exponent] : std::pow(10.0, -exponent);
+  o_value = static_cast<float>(negative ? -value : value);
+  return true;
+}
+
+bool parseVec3(const char *&io_p, const char *_end, ngl::Vec3 &o_v)
+{
+  return parseFloat(io_p, _end, o_v.m_x) && parseFloat(io_p, _end, o_v.m_y) && parseFloat(io_p, _end, o_v.m_z);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief hash of one triangle corner at its place in the face list, these are summed so chunks can be hashed apart
+//----------------------------------------------------------------------------------------------------------------------
+uint64_t cornerHash(uint64_t _index, const MorphTargetSet::Corner &_c)
+{
+  // splitmix64 finaliser
+  auto mix = [](uint64_t _x)
+  {
+    _x += 0x9e3779b97f4a7c15ULL;
+    _x = (_x ^ (_x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    _x = (_x ^ (_x >> 27)) * 0x94d049bb133111ebULL;
+    return _x ^ (_x >> 31);
+  };
+  return mix(mix(_index) ^ ((static_cast<uint64_t>(_c.vert) << 32) | _c.normal));
+}
+} // end anon namespace
+
+struct PoseSetLoader::Chunk
+{
+  const char *begin;
+  const char *end;
+  size_t file;
+  // counted in the first pass, then where the chunk's data starts in the file's arrays
+  size_t verts = 0;
+  size_t normals = 0;
+  size_t triangles = 0;
+  size_t firstVert = 0;
+  size_t firstNormal = 0;
+  size_t firstTriangle = 0;
+  uint64_t topology = 0;
+  const char *error = nullptr;
+};
+
+struct PoseSetLoader::File
+{
+  std::unique_ptr<MappedFile> map;
+  MorphTargetSet::Pose *pose = nullptr;
+  size_t verts = 0;
+  size_t normals = 0;
+  size_t triangles = 0;
+  uint64_t topology = 0;
+  const char *error = nullptr;
+};
+
+void PoseSetLoader::countChunk(Chunk &io_chunk) const
+{
+  for (auto *p = io_chunk.begin; p < io_chunk.end;)
+  {
+    auto *eol = std::find(p, io_chunk.end, '\n');
+    switch (classify(p, eol))
+    {
+    case Line::VERTEX:
+      ++io_chunk.verts;
+      break;
+    case Line::NORMAL:
+      ++io_chunk.normals;
+      break;
+    case Line::FACE:
+    {
+      // a polygon of n corners is fanned into n - 2 triangles
+      size_t corners = 0;
+      for (p = skipSpace(p, eol); p < eol; p = skipSpace(p, eol), ++corners)
+      {
+        while (p < eol && !isSpace(*p))
+          ++p;
+      }
+      io_chunk.triangles += corners > 2 ? corners - 2 : 0;
+      break;
+    }
+    case Line::OTHER:
+      break;
+    }
+    p = eol + 1;
+  }
+}
+
+void PoseSetLoader::parseChunk(File &io_file, Chunk &io_chunk, bool _keepCorners)
+{
+  auto *verts = io_file.pose->verts.data() + io_chunk.firstVert;
+  auto *normals = io_file.pose->normals.data() + io_chunk.firstNormal;
+  size_t numVerts = 0;
+  size_t numNormals = 0;
+  size_t triangle = io_chunk.firstTriangle;
+  // obj indices start at 1, negative ones count back from the last element read
+  auto resolve = [](int64_t _index, size_t _before, size_t _count, uint32_t &o_index)
+  {
+    auto index = _index > 0 ? _index - 1 : static_cast<int64_t>(_before) + _index;
+    if (_index == 0 || index < 0 || static_cast<size_t>(index) >= _count)
+      return false;
+    o_index = static_cast<uint32_t>(index);
+    return true;
+  };
+  for (auto *p = io_chunk.begin; p < io_chunk.end && io_chunk.error == nullptr;)
+  {
+    auto *eol = std::find(p, io_chunk.end, '\n');
+    switch (classify(p, eol))
+    {
+    case Line::VERTEX:
+      if (!parseVec3(p, eol, verts[numVerts++]))
+        io_chunk.error = "bad vertex";
+      break;
+    case Line::NORMAL:
+      if (!parseVec3(p, eol, normals[numNormals++]))
+        io_chunk.error = "bad normal";
+      break;
+    case Line::FACE:
+    {
+      MorphTargetSet::Corner first{}, previous{};
+      size_t corners = 0;
+      for (p = skipSpace(p, eol); p < eol && io_chunk.error == nullptr; p = skipSpace(p, eol), ++corners)
+      {
+        // v, v/t, v//n or v/t/n, we need the v and n
+        int64_t v, t, n;
+        MorphTargetSet::Corner corner;
+        if (!parseInt(p, eol, v) || !resolve(v, io_chunk.firstVert + numVerts, io_file.verts, corner.vert))
+        {
+          io_chunk.error = "bad face vertex index";
+          break;
+        }
+        if (p == eol || *p++ != '/' || p == eol || (*p != '/' && !parseInt(p, eol, t)) || p == eol || *p++ != '/' ||
+            !parseInt(p, eol, n) || !resolve(n, io_chunk.firstNormal + numNormals, io_file.normals, corner.normal))
+        {
+          io_chunk.error = "face without a valid normal index";
+          break;
+        }
+        if (corners == 0)
+          first = corner;
+        if (corners >= 2)
+        {
+          const MorphTargetSet::Corner tri[3] = {first, previous, corner};
+          for (size_t j = 0; j < 3; ++j)
+          {
+            io_chunk.topology += cornerHash(3 * triangle + j, tri[j]);
+            if (_keepCorners)
+              m_corners[3 * triangle + j] = tri[j];
+          }
+          ++triangle;
+        }
+        previous = corner;
+      }
+      break;
+    }
+    case Line::OTHER:
+      break;
+    }
+    p = eol + 1;
+  }
+}
+
+bool PoseSetLoader::load(const std::vector<std::string> &_poseFiles)
+{
+  PROFILE_ZONE("PoseSetLoader::load");
+  clear();
+  if (_poseFiles.empty())
+    return false;
+  auto start = std::chrono::steady_clock::now();
+  m_targets.resize(_poseFiles.size() - 1);
+  std::vector<File> files(_poseFiles.size());
+  std::vector<Chunk> chunks;
+  size_t bytes = 0;
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    auto &file = files[i];
+    file.pose = i == 0 ? &m_base : &m_targets[i - 1];
+    file.map = std::make_unique<MappedFile>(_poseFiles[i]);
+    if (!file.map->valid())
+    {
+      file.error = "unable to read the file";
+      continue;
+    }
+    // cut at the first line break after every c_chunkSize bytes
+    auto *end = file.map->data() + file.map->size();
+    for (auto *p = file.map->data(); p < end;)
+    {
+      auto *split = static_cast<size_t>(end - p) > c_chunkSize ? std::find(p + c_chunkSize, end, '\n') : end;
+      if (split != end)
+        ++split;
+      chunks.push_back({p, split, i});
+      p = split;
+    }
+    bytes += file.map->size();
+  }
+
+  // each chunk is a step in both passes, parsing is a little slower than counting but it is only a progress bar
+  std::atomic<size_t> stepsDone{0};
+  auto step = [&]()
+  {
+    auto done = ++stepsDone;
+    if (m_progress)
+      m_progress(static_cast<float>(done) / static_cast<float>(2 * chunks.size()));
+  };
+  m_pool.run(chunks.size(), [&](size_t _chunk, size_t)
+  {
+    countChunk(chunks[_chunk]);
+    step();
+  });
+  // the chunks are in file order so a running total gives each one its place
+  for (auto &c : chunks)
+  {
+    auto &file = files[c.file];
+    c.firstVert = file.verts;
+    c.firstNormal = file.normals;
+    c.firstTriangle = file.triangles;
+    file.verts += c.verts;
+    file.normals += c.normals;
+    file.triangles += c.triangles;
+  }
+  for (auto &file : files)
+  {
+    file.pose->verts.resize(file.verts);
+    file.pose->normals.resize(file.normals);
+  }
+  m_corners.resize(files[0].triangles * 3);
+  m_pool.run(chunks.size(), [&](size_t _chunk, size_t)
+  {
+    parseChunk(files[chunks[_chunk].file], chunks[_chunk], chunks[_chunk].file == 0);
+    step();
+  });
+  for (auto &c : chunks)
+  {
+    files[c.file].topology += c.topology;
+    if (files[c.file].error == nullptr)
+      files[c.file].error = c.error;
+  }
+
+  auto &base = files[0];
+  if (base.error == nullptr && (base.verts == 0 || base.normals == 0 || base.triangles == 0))
+    base.error = "no triangles with normals";
+  if (base.error != nullptr)
+  {
+    std::cerr << "Unable to load base pose " << _poseFiles[0] << ", " << base.error << '\n';
+    clear();
+    return false;
+  }
+  for (size_t i = 1; i < files.size(); ++i)
+  {
+    auto &file = files[i];
+    if (file.error == nullptr && (file.verts != base.verts || file.normals != base.normals))
+      file.error = "the vertex or normal count doesn't match the base";
+    if (file.error != nullptr)
+    {
+      std::cerr << "Pose " << _poseFiles[i] << " ignored, " << file.error << '\n';
+      m_targets[i - 1] = MorphTargetSet::Pose();
+    }
+    else if (file.triangles != base.triangles || file.topology != base.topology)
+    {
+      // the indices still line up so the target is usable, this is normally an exporter splitting some quads along
+      // the other diagonal (the Bruce poses do) but may be a different mesh with the same counts
+      std::cerr << "Pose " << _poseFiles[i] << " has different faces to the base, the base faces are used\n";
+    }
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "Parsed " << files.size() << " poses (" << bytes / (1024 * 1024) << " MB, " << base.verts << " vertices) in "
+            << chunks.size() << " chunks on " << m_pool.numWorkers() << " threads in " << elapsed.count() << " ms\n";
+  return true;
+}
+
+void PoseSetLoader::clear()
+{
+  m_base = MorphTargetSet::Pose();
+  m_corners = std::vector<MorphTargetSet::Corner>();
+  m_targets = std::vector<MorphTargetSet::Pose>();
+}
@@ -0,0 +1,176 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// the GPU and CPU clocks are re-aligned this often
+constexpr uint32_t c_calibrationFrames = 600;
+
+static int64_t steadyNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler &Profiler::instance()
+{
+  static Profiler s_profiler;
+  return s_profiler;
+}
+
+Profiler::Profiler() : m_ring(std::make_unique<Slot[]>(c_capacity)), m_origin(steadyNow())
+{
+}
+
+int64_t Profiler::now() const
+{
+  return steadyNow() - m_origin;
+}
+
+// 0 until the thread first asks for its id (or registers as the main thread)
+static thread_local uint32_t t_thread = 0;
+static std::atomic<bool> s_mainRegistered{false};
+
+uint32_t Profiler::threadID()
+{
+  static std::atomic<uint32_t> s_nextThread{c_mainThread + 1};
+  if (t_thread == 0)
+    t_thread = s_nextThread++;
+  return t_thread;
+}
+
+void Profiler::registerMainThread()
+{
+  t_thread = c_mainThread;
+  s_mainRegistered = true;
+}
+
+void Profiler::record(const char *_name, int64_t _start, int64_t _end, uint32_t _thread)
+{
+  // threads each claim their own slot so there is no lock, a slot is only re-used c_capacity zones later
+  auto zone = m_next.fetch_add(1, std::memory_order_relaxed);
+  auto &slot = m_ring[zone % c_capacity];
+  // mark the slot as being written before any field changes and publish it once they all have
+  slot.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(_name, std::memory_order_relaxed);
+  slot.start.store(_start, std::memory_order_relaxed);
+  slot.duration.store(_end - _start, std::memory_order_relaxed);
+  slot.frame.store(m_frame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  slot.thread.store(_thread, std::memory_order_relaxed);
+  slot.sequence.store(zone + 1, std::memory_order_release);
+}
+
+void Profiler::calibrate()
+{
+  GLint64 gpu = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpu);
+  m_gpuOffset = now() - gpu;
+  m_calibratedFrame = m_frame.load(std::memory_order_relaxed);
+  m_calibrated = true;
+}
+
+size_t Profiler::beginGPU(const char *_name)
+{
+  if (!m_calibrated)
+    calibrate();
+  size_t handle;
+  if (m_free.empty())
+  {
+    GPUZone zone{_name, 0, 0};
+    glGenQueries(1, &zone.begin);
+    glGenQueries(1, &zone.end);
+    m_gpuZones.push_back(zone);
+    handle = m_gpuZones.size() - 1;
+  }
+  else
+  {
+    handle = m_free.back();
+    m_free.pop_back();
+    m_gpuZones[handle].name = _name;
+  }
+  glQueryCounter(m_gpuZones[handle].begin, GL_TIMESTAMP);
+  return handle;
+}
+
+void Profiler::endGPU(size_t _handle)
+{
+  glQueryCounter(m_gpuZones[_handle].end, GL_TIMESTAMP);
+  m_pending.push_back(_handle);
+}
+
+void Profiler::frame()
+{
+  auto frame = m_frame.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (m_pending.empty())
+    return;
+  // zones finish in order so stop at the first one that isn't ready
+  size_t done = 0;
+  for (; done < m_pending.size(); ++done)
+  {
+    auto &zone = m_gpuZones[m_pending[done]];
+    GLint available = 0;
+    glGetQueryObjectiv(zone.end, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(zone.begin, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(zone.end, GL_QUERY_RESULT, &end);
+    record(zone.name, static_cast<int64_t>(begin) + m_gpuOffset, static_cast<int64_t>(end) + m_gpuOffset, c_gpuThread);
+    m_free.push_back(m_pending[done]);
+  }
+  m_pending.erase(m_pending.begin(), m_pending.begin() + static_cast<std::ptrdiff_t>(done));
+  if (frame - m_calibratedFrame >= c_calibrationFrames)
+    calibrate();
+}
+
+std::vector<Profiler::Zone> Profiler::zones() const
+{
+  auto next = m_next.load();
+  auto count = std::min<uint64_t>(next, c_capacity);
+  std::vector<Zone> out;
+  out.reserve(count);
+  for (auto i = next - count; i < next; ++i)
+  {
+    // skip zones still being written and ones overwritten since next was read, re-reading the sequence after the
+    // fields catches a writer that started part way through
+    auto &slot = m_ring[i % c_capacity];
+    if (slot.sequence.load(std::memory_order_acquire) != i + 1)
+      continue;
+    Zone zone{slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+              slot.duration.load(std::memory_order_relaxed), slot.frame.load(std::memory_order_relaxed),
+              slot.thread.load(std::memory_order_relaxed)};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) == i + 1)
+      out.push_back(zone);
+  }
+  return out;
+}
+
+bool Profiler::writeChromeTrace(std::string_view _fileName) const
+{
+  std::ofstream file{std::string(_fileName)};
+  if (!file.is_open())
+  {
+    std::cerr << "Unable to write trace " << _fileName << '\n';
+    return false;
+  }
+  auto zones = this->zones();
+  // complete ("X") events with times in microseconds, plus names for the GPU and (if registered) main thread tracks
+  // ns to us with the ns kept, the default precision would lose them (and go to exponents) after a few seconds
+  file << std::fixed << std::setprecision(3);
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << c_gpuThread << ",\"args\":{\"name\":\"GPU\"}}";
+  if (s_mainRegistered)
+    file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << c_mainThread << ",\"args\":{\"name\":\"Main\"}}";
+  for (auto &z : zones)
+  {
+    file << ",\n{\"name\":\"" << z.name << "\",\"cat\":\"" << (z.thread == c_gpuThread ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"ts\":" << z.start / 1000.0
+         << ",\"dur\":" << z.duration / 1000.0 << ",\"pid\":1,\"tid\":" << z.thread << ",\"args\":{\"frame\":" << z.frame << "}}";
+  }
+  file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  std::cout << "Wrote " << zones.size() << " profile zones to " << _fileName << '\n';
+  return true;
+}
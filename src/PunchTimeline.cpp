@@ -0,0 +1,63 @@
+#include "PunchTimeline.h"
+#include <algorithm>
+
+void PunchTimeline::create(size_t _numChannels, size_t _numTargets, uint32_t _seed)
+{
+  m_numTargets = _numTargets;
+  m_weights.assign(_numChannels * _numTargets, 0.0f);
+  m_busyUntil.assign(_numChannels * _numTargets, 0.0);
+  m_animator = WeightAnimator();
+  m_punch = m_animator.addCurve(WeightAnimator::pulse(c_punchTime, c_punchTime));
+  m_wasActive = false;
+  m_rng.seed(_seed);
+}
+
+void PunchTimeline::punchAll(size_t _target, double _time)
+{
+  if (_target >= m_numTargets)
+    return;
+  auto length = m_animator.curveLength(m_punch);
+  for (size_t i = _target; i < m_busyUntil.size(); i += m_numTargets)
+  {
+    m_animator.play(m_punch, i / m_numTargets, _target, _time);
+    m_busyUntil[i] = std::max(m_busyUntil[i], _time + length);
+  }
+}
+
+bool PunchTimeline::update(double _time, double _dt)
+{
+  // chance of an idle target starting a random punch this step
+  std::bernoulli_distribution trigger(std::min(1.0, _dt / c_meanPunchInterval));
+  auto length = m_animator.curveLength(m_punch);
+  for (size_t i = 0; i < m_busyUntil.size(); ++i)
+  {
+    if (_time >= m_busyUntil[i] && trigger(m_rng))
+    {
+      m_animator.play(m_punch, i / m_numTargets, i % m_numTargets, _time + c_triggerLead);
+      m_busyUntil[i] = _time + c_triggerLead + length;
+    }
+  }
+  bool changed = m_wasActive || m_animator.active();
+  if (changed)
+  {
+    std::fill(m_weights.begin(), m_weights.end(), 0.0f);
+    m_animator.evaluate(_time, m_weights.data(), m_numTargets);
+    // overlapping punches sum so keep the result in the range the shader expects
+    for (auto &w : m_weights)
+    {
+      w = std::min(w, 1.0f);
+    }
+  }
+  m_wasActive = m_animator.active();
+  return changed;
+}
+
+bool PunchTimeline::targetInUse(size_t _target) const
+{
+  for (size_t i = _target; i < m_weights.size(); i += m_numTargets)
+  {
+    if (m_weights[i] != 0.0f)
+      return true;
+  }
+  return false;
+}
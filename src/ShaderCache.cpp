@@ -0,0 +1,204 @@
+#include "ShaderCache.h"
+#include "MorphCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr char c_magic[4] = {'M', 'S', 'P', 'B'};
+
+struct BinaryHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t size;
+};
+
+std::string glString(GLenum _name)
+{
+  auto s = glGetString(_name);
+  return s != nullptr ? reinterpret_cast<const char *>(s) : "";
+}
+} // end anon namespace
+
+ShaderCache::ShaderCache(std::string_view _directory) : m_directory(_directory)
+{
+  m_driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  m_supported = formats > 0;
+}
+
+bool ShaderCache::readSources(const Program &_program, std::vector<std::string> &o_sources)
+{
+  std::string defines;
+  for (auto &d : _program.defines)
+    defines += "#define " + d + '\n';
+  o_sources.clear();
+  for (auto &stage : _program.stages)
+  {
+    std::ifstream in(stage.file, std::ios::binary);
+    if (!in.is_open())
+    {
+      std::cerr << "Unable to read shader " << stage.file << '\n';
+      return false;
+    }
+    std::string source{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    // the defines have to come after #version, which must be the first thing in the shader
+    size_t at = 0;
+    auto version = source.find("#version");
+    if (version != std::string::npos)
+    {
+      auto eol = source.find('\n', version);
+      if (eol == std::string::npos)
+        source += '\n';
+      at = eol == std::string::npos ? source.size() : eol + 1;
+    }
+    source.insert(at, defines);
+    o_sources.push_back(std::move(source));
+  }
+  return true;
+}
+
+uint64_t ShaderCache::key(const Program &_program, const std::vector<std::string> &_sources) const
+{
+  // the defines are already in the sources, the varyings change what is linked
+  auto h = MorphCache::hash(&c_version, sizeof(c_version));
+  h = MorphCache::hash(m_driver.data(), m_driver.size(), h);
+  for (auto &s : _sources)
+    h = MorphCache::hash(s.data(), s.size() + 1, h);
+  for (auto &v : _program.feedbackVaryings)
+    h = MorphCache::hash(v.data(), v.size() + 1, h);
+  return h;
+}
+
+std::string ShaderCache::fileName(const Program &_program) const
+{
+  return m_directory + '/' + _program.name + ".bin";
+}
+
+bool ShaderCache::build(const Program &_program)
+{
+  std::vector<std::string> sources;
+  if (!readSources(_program, sources))
+    return false;
+  ngl::ShaderLib::createShaderProgram(_program.name);
+  auto id = ngl::ShaderLib::getProgramID(_program.name);
+  auto file = fileName(_program);
+  auto programKey = key(_program, sources);
+  if (m_supported && loadBinary(id, file, programKey))
+  {
+    // nothing was linked through ShaderLib so it has to be told to look up the uniforms
+    ngl::ShaderLib::autoRegisterUniforms(_program.name);
+    ++m_hits;
+    return true;
+  }
+  ++m_misses;
+  if (!compile(_program, sources))
+    return false;
+  if (m_supported)
+    storeBinary(id, file, programKey);
+  return true;
+}
+
+bool ShaderCache::loadBinary(GLuint _id, const std::string &_file, uint64_t _key) const
+{
+  std::ifstream in(_file, std::ios::binary);
+  if (!in.is_open())
+    return false;
+  BinaryHeader header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(BinaryHeader)) || std::memcmp(header.magic, c_magic, sizeof(c_magic)) != 0 ||
+      header.version != c_version || header.key != _key)
+    return false;
+  std::vector<char> binary(header.size);
+  if (!in.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+    return false;
+  glProgramBinary(_id, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+  GLint linked = GL_FALSE;
+  glGetProgramiv(_id, GL_LINK_STATUS, &linked);
+  if (linked != GL_TRUE)
+  {
+    std::cerr << "Shader binary " << _file << " rejected by the driver, compiling from source\n";
+    return false;
+  }
+  return true;
+}
+
+void ShaderCache::storeBinary(GLuint _id, const std::string &_file, uint64_t _key) const
+{
+  GLint size = 0;
+  glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0)
+    return;
+  std::vector<char> binary(static_cast<size_t>(size));
+  GLenum format = 0;
+  glGetProgramBinary(_id, size, &size, &format, binary.data());
+  BinaryHeader header;
+  std::memcpy(header.magic, c_magic, sizeof(c_magic));
+  header.version = c_version;
+  header.key = _key;
+  header.format = format;
+  header.size = static_cast<uint32_t>(size);
+
+  std::error_code ec;
+  std::filesystem::create_directories(m_directory, ec);
+  // written to a temp file then renamed so another instance never reads half a binary
+#if !defined(_WIN32)
+  auto tmpFile = _file + ".tmp" + std::to_string(getpid());
+#else
+  auto tmpFile = _file + ".tmp";
+#endif
+  {
+    std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(BinaryHeader));
+    out.write(binary.data(), size);
+    if (!out)
+    {
+      std::cerr << "Unable to write shader binary " << tmpFile << '\n';
+      return;
+    }
+  }
+  std::filesystem::rename(tmpFile, _file, ec);
+  if (ec)
+  {
+    std::cerr << "Unable to rename shader binary " << ec.message() << '\n';
+    std::filesystem::remove(tmpFile, ec);
+  }
+}
+
+bool ShaderCache::compile(const Program &_program, const std::vector<std::string> &_sources)
+{
+  auto id = ngl::ShaderLib::getProgramID(_program.name);
+  for (size_t i = 0; i < _program.stages.size(); ++i)
+  {
+    auto &stage = _program.stages[i];
+    // a stage with defines is specific to this program so gets its own shader object
+    auto name = _program.defines.empty() ? stage.name : _program.name + stage.name;
+    if (m_compiledStages.insert(name).second)
+    {
+      ngl::ShaderLib::attachShader(name, stage.type);
+      ngl::ShaderLib::loadShaderSourceFromString(name, _sources[i]);
+      ngl::ShaderLib::compileShader(name);
+    }
+    ngl::ShaderLib::attachShaderToProgram(_program.name, name);
+  }
+  // the varyings to capture have to be set before the program is linked
+  if (!_program.feedbackVaryings.empty())
+  {
+    std::vector<const GLchar *> varyings;
+    for (auto &v : _program.feedbackVaryings)
+      varyings.push_back(v.c_str());
+    glTransformFeedbackVaryings(id, static_cast<GLsizei>(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+  }
+  if (m_supported)
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  return ngl::ShaderLib::linkProgramObject(_program.name);
+}
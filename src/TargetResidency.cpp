@@ -0,0 +1,143 @@
+#include "TargetResidency.h"
+#include <algorithm>
+
+void TargetResidency::create(size_t _numTargets, size_t _targetBytes, size_t _gpuBudget, size_t _hostBudget, size_t _minSlots)
+{
+  m_targetBytes = std::max<size_t>(_targetBytes, 1);
+  auto slots = std::min(_numTargets, std::max(_gpuBudget / m_targetBytes, _minSlots));
+  // the host budget can't be less than what is being streamed in one frame, which is at most the pool
+  m_hostLimit = std::max(_hostBudget / m_targetBytes, slots);
+  m_frame = 1;
+  m_targetSlot.assign(_numTargets, c_notResident);
+  m_slotTarget.assign(slots, c_notResident);
+  m_lastUsed.assign(_numTargets, 0);
+  m_requested.assign(_numTargets, 0);
+  m_hostUsed.assign(_numTargets, 0);
+  m_onHost.assign(_numTargets, 0);
+  m_hostCount = 0;
+  m_misses.clear();
+  m_prefetches.clear();
+  m_stats = Stats();
+}
+
+uint32_t TargetResidency::preload(size_t _target)
+{
+  auto slot = findSlot();
+  if (slot == c_notResident || m_slotTarget[slot] != c_notResident)
+    return c_notResident;
+  m_slotTarget[slot] = static_cast<uint32_t>(_target);
+  m_targetSlot[_target] = slot;
+  return slot;
+}
+
+void TargetResidency::beginFrame()
+{
+  ++m_frame;
+  m_misses.clear();
+  m_prefetches.clear();
+}
+
+void TargetResidency::request(size_t _target)
+{
+  // only the first request in a frame counts
+  if (m_requested[_target] == m_frame)
+    return;
+  m_requested[_target] = m_frame;
+  m_lastUsed[_target] = m_frame;
+  if (m_targetSlot[_target] != c_notResident)
+  {
+    ++m_stats.hits;
+    return;
+  }
+  ++m_stats.misses;
+  m_misses.push_back(static_cast<uint32_t>(_target));
+}
+
+void TargetResidency::prefetch(size_t _target)
+{
+  if (m_requested[_target] == m_frame)
+    return;
+  if (m_targetSlot[_target] != c_notResident)
+  {
+    // keep it from being the next one evicted
+    m_lastUsed[_target] = m_frame;
+    return;
+  }
+  m_prefetches.push_back(static_cast<uint32_t>(_target));
+}
+
+uint32_t TargetResidency::findSlot() const
+{
+  uint32_t best = c_notResident;
+  uint64_t oldest = m_frame;
+  for (uint32_t s = 0; s < m_slotTarget.size(); ++s)
+  {
+    auto target = m_slotTarget[s];
+    if (target == c_notResident)
+      return s;
+    if (m_lastUsed[target] < oldest)
+    {
+      oldest = m_lastUsed[target];
+      best = s;
+    }
+  }
+  return best;
+}
+
+void TargetResidency::touchHost(uint32_t _target, std::vector<uint32_t> &o_released)
+{
+  m_hostUsed[_target] = m_frame;
+  if (m_onHost[_target])
+    return;
+  m_onHost[_target] = 1;
+  ++m_hostCount;
+  while (m_hostCount > m_hostLimit)
+  {
+    // the least recently streamed copy, never one streamed this frame as the limit is at least the pool size
+    uint32_t oldest = c_notResident;
+    for (uint32_t t = 0; t < m_onHost.size(); ++t)
+    {
+      if (m_onHost[t] && (oldest == c_notResident || m_hostUsed[t] < m_hostUsed[oldest]))
+        oldest = t;
+    }
+    m_onHost[oldest] = 0;
+    --m_hostCount;
+    ++m_stats.hostReleases;
+    o_released.push_back(oldest);
+  }
+}
+
+void TargetResidency::update(std::vector<Upload> &o_uploads, std::vector<uint32_t> &o_released)
+{
+  o_uploads.clear();
+  o_released.clear();
+  auto load = [&](uint32_t _target)
+  {
+    auto slot = findSlot();
+    if (slot == c_notResident)
+      return false;
+    auto old = m_slotTarget[slot];
+    if (old != c_notResident)
+    {
+      m_targetSlot[old] = c_notResident;
+      ++m_stats.evictions;
+    }
+    m_slotTarget[slot] = _target;
+    m_targetSlot[_target] = slot;
+    m_lastUsed[_target] = m_frame;
+    o_uploads.push_back({_target, slot});
+    touchHost(_target, o_released);
+    return true;
+  };
+  // the misses all fit as the pool is at least as big as the most that can be needed at once
+  for (auto t : m_misses)
+    load(t);
+  for (auto t : m_prefetches)
+  {
+    if (m_targetSlot[t] != c_notResident || !load(t))
+      continue;
+    ++m_stats.prefetches;
+  }
+  m_misses.clear();
+  m_prefetches.clear();
+}
@@ -0,0 +1,130 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t _numWorkers)
+{
+  if (_numWorkers == 0)
+    _numWorkers = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < _numWorkers; ++i)
+  {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  // worker 0 is whoever calls run
+  for (size_t i = 1; i < _numWorkers; ++i)
+  {
+    m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_start.notify_all();
+  for (auto &t : m_threads)
+  {
+    t.join();
+  }
+}
+
+void ThreadPool::run(size_t _numTasks, const Task &_task)
+{
+  if (_numTasks == 0)
+    return;
+  // hand out contiguous runs so neighbouring tiles start on the same worker
+  auto workers = m_queues.size();
+  for (size_t w = 0; w < workers; ++w)
+  {
+    std::lock_guard<std::mutex> lock(m_queues[w]->mutex);
+    size_t begin = _numTasks * w / workers;
+    size_t end = _numTasks * (w + 1) / workers;
+    for (size_t t = begin; t < end; ++t)
+    {
+      m_queues[w]->tasks.push_back(t);
+    }
+  }
+  m_remaining = _numTasks;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_task = &_task;
+    m_busy = m_threads.size();
+    ++m_generation;
+  }
+  m_start.notify_all();
+  drain(0);
+  // wait for the other workers to leave drain so the task reference is no longer used
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_done.wait(lock, [this] { return m_busy == 0; });
+  m_task = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t _worker)
+{
+  size_t generation = 0;
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_start.wait(lock, [this, generation] { return m_quit || m_generation != generation; });
+      if (m_quit)
+        return;
+      generation = m_generation;
+    }
+    drain(_worker);
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_busy;
+    }
+    m_done.notify_all();
+  }
+}
+
+void ThreadPool::drain(size_t _worker)
+{
+  size_t task;
+  while (m_remaining.load() != 0)
+  {
+    if (pop(_worker, task) || steal(_worker, task))
+    {
+      (*m_task)(task, _worker);
+      --m_remaining;
+    }
+    else
+    {
+      // everything left is being run by someone else
+      break;
+    }
+  }
+}
+
+bool ThreadPool::pop(size_t _worker, size_t &o_task)
+{
+  auto &q = *m_queues[_worker];
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.tasks.empty())
+    return false;
+  o_task = q.tasks.front();
+  q.tasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::steal(size_t _worker, size_t &o_task)
+{
+  auto workers = m_queues.size();
+  for (size_t i = 1; i < workers; ++i)
+  {
+    auto &q = *m_queues[(_worker + i) % workers];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty())
+    {
+      // take from the far end, that is the work the owner would get to last
+      o_task = q.tasks.back();
+      q.tasks.pop_back();
+      ++m_steals;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,85 @@
+#include "UniformRing.h"
+#include "Profiler.h"
+
+// how long to block in one glClientWaitSync call (ns), it is called again until the fence signals
+constexpr GLuint64 c_fenceTimeout = 1000000;
+
+void UniformRing::create(size_t _frameBytes)
+{
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  if (alignment > 0)
+    m_alignment = static_cast<size_t>(alignment);
+  m_frameBytes = (_frameBytes + m_alignment - 1) / m_alignment * m_alignment;
+  auto total = static_cast<GLsizeiptr>(m_frameBytes * c_frames);
+  GLint major = 0;
+  GLint minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  m_persistent = major > 4 || (major == 4 && minor >= 4);
+
+  glGenBuffers(1, &m_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+  if (m_persistent)
+  {
+    // coherent so the writes are seen by the draws without a flush or barrier, the fences keep us off live regions
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_UNIFORM_BUFFER, total, nullptr, flags);
+    m_mapped = static_cast<unsigned char *>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, total, flags));
+    m_persistent = m_mapped != nullptr;
+  }
+  if (!m_persistent)
+  {
+    glBufferData(GL_UNIFORM_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    m_staging.resize(static_cast<size_t>(total));
+  }
+  m_region = c_frames - 1;
+}
+
+void UniformRing::beginFrame()
+{
+  m_region = (m_region + 1) % c_frames;
+  m_used = 0;
+  auto &fence = m_fences[m_region];
+  if (fence == nullptr)
+    return;
+  if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+  {
+    PROFILE_ZONE("UniformRing stall");
+    ++m_stalls;
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, c_fenceTimeout) == GL_TIMEOUT_EXPIRED)
+      ;
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+bool UniformRing::allocate(size_t _size, Block &o_block)
+{
+  auto size = (_size + m_alignment - 1) / m_alignment * m_alignment;
+  if (m_used + size > m_frameBytes)
+    return false;
+  o_block.offset = m_region * m_frameBytes + m_used;
+  o_block.size = _size;
+  o_block.data = (m_persistent ? m_mapped : m_staging.data()) + o_block.offset;
+  m_used += size;
+  return true;
+}
+
+void UniformRing::bind(GLuint _binding, const Block &_block)
+{
+  if (!m_persistent)
+  {
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(_block.offset), static_cast<GLsizeiptr>(_block.size), _block.data);
+  }
+  glBindBufferRange(GL_UNIFORM_BUFFER, _binding, m_buffer, static_cast<GLintptr>(_block.offset), static_cast<GLsizeiptr>(_block.size));
+}
+
+void UniformRing::endFrame()
+{
+  auto &fence = m_fences[m_region];
+  if (fence != nullptr)
+    glDeleteSync(fence);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,93 @@
+#include "WeightAnimator.h"
+#include <cassert>
+
+WeightAnimator::CurveID WeightAnimator::addCurve(const std::vector<Key> &_keys)
+{
+  assert(!_keys.empty());
+  m_curves.push_back({static_cast<uint32_t>(m_keys.size()), static_cast<uint32_t>(_keys.size())});
+  m_keys.insert(m_keys.end(), _keys.begin(), _keys.end());
+  return static_cast<CurveID>(m_curves.size() - 1);
+}
+
+std::vector<WeightAnimator::Key> WeightAnimator::pulse(float _rise, float _fall, float _peak)
+{
+  return {{0.0f, 0.0f}, {_rise, _peak}, {_rise + _fall, 0.0f}};
+}
+
+float WeightAnimator::curveLength(CurveID _curve) const
+{
+  auto &c = m_curves[_curve];
+  return m_keys[c.first + c.count - 1].time;
+}
+
+void WeightAnimator::play(CurveID _curve, size_t _channel, size_t _target, double _start, float _gain)
+{
+  m_clips.push_back({_start, _gain, _curve, 0, static_cast<uint32_t>(_channel), static_cast<uint32_t>(_target)});
+}
+
+bool WeightAnimator::playing(CurveID _curve, size_t _channel, size_t _target) const
+{
+  for (auto &clip : m_clips)
+  {
+    if (clip.curve == _curve && clip.channel == _channel && clip.target == _target)
+      return true;
+  }
+  return false;
+}
+
+void WeightAnimator::upcoming(double _time, double _window, std::vector<uint32_t> &o_targets) const
+{
+  o_targets.clear();
+  for (auto &clip : m_clips)
+  {
+    if (clip.start > _time && clip.start <= _time + _window)
+      o_targets.push_back(clip.target);
+  }
+}
+
+void WeightAnimator::evaluate(double _time, float *io_weights, size_t _stride)
+{
+  size_t i = 0;
+  while (i < m_clips.size())
+  {
+    auto &clip = m_clips[i];
+    auto local = static_cast<float>(_time - clip.start);
+    if (local < 0.0f)
+    {
+      // not started yet
+      ++i;
+      continue;
+    }
+    auto &curve = m_curves[clip.curve];
+    const Key *keys = &m_keys[curve.first];
+    // move the cursor on to the key span containing local
+    while (clip.cursor + 1 < curve.count && keys[clip.cursor + 1].time <= local)
+    {
+      ++clip.cursor;
+    }
+    float value;
+    bool finished = clip.cursor + 1 >= curve.count;
+    if (finished)
+    {
+      value = keys[curve.count - 1].value;
+    }
+    else
+    {
+      auto &k0 = keys[clip.cursor];
+      auto &k1 = keys[clip.cursor + 1];
+      float t = (local - k0.time) / (k1.time - k0.time);
+      value = k0.value + t * (k1.value - k0.value);
+    }
+    io_weights[clip.channel * _stride + clip.target] += clip.gain * value;
+    if (finished)
+    {
+      // order doesn't matter so swap the last clip into this slot and look at it next
+      clip = m_clips.back();
+      m_clips.pop_back();
+    }
+    else
+    {
+      ++i;
+    }
+  }
+}
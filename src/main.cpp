@@ -2,13 +2,47 @@
 basic OpenGL demo modified from http://qt-project.org/doc/qt-5.0/qtgui/openglwindow.html
 ****************************************************************************/
 #include <QtGui/QGuiApplication>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <iterator>
 #include "NGLScene.h"
+#include "OffscreenBenchmark.h"
+#include "Profiler.h"
 
+namespace
+{
+  // any obj files on the command line are used as the poses (base first), else the default models are
+  constexpr const char *c_usage = R"(
+  --delta-format rgb32f|rgba16f|rgba16|rgba8|auto selects how the morph deltas are stored
+  --compress-targets tolerance stores the targets as the fewest shared basis shapes that get each within tolerance
+  --crowd n draws n characters with one instanced call
+  --prepass blends once per weight change with transform feedback and draws the result as plain geometry
+  --fixed-step ms advances the animation clock by a fixed time every tick so runs are repeatable
+  --benchmark renders a scripted animation offscreen with no window and writes frame time stats as JSON
+    --benchmark-frames n (default 600) --benchmark-output file (default benchmark.json)
+    on a machine with no display run it under xvfb-run or with QT_QPA_PLATFORM set to a platform with GL
+  --trace file writes the profiler zones as a Chrome / Perfetto trace on exit (T writes one at any time)
+  --warm-shaders builds every shader program into the binary cache (shadercache next to the exe) and exits
+  --gpu-target-budget mb (default 256) the size of the GPU pool the morph targets are streamed through
+  --host-target-budget mb (default 1024) how much of the streamed targets' host copies is kept mapped
+)";
+  // the options that are followed by a value, the rest are switches
+  constexpr const char *c_valueOptions[] = {"--delta-format",     "--compress-targets",  "--crowd",
+                                            "--fixed-step",       "--benchmark-frames",  "--benchmark-output",
+                                            "--trace",            "--gpu-target-budget", "--host-target-budget"};
 
+  int usage(const char *_exe)
+  {
+    std::cerr << "usage : " << _exe << " [options] [obj pose files...]" << c_usage;
+    return EXIT_FAILURE;
+  }
+} // end anonymous namespace
 
 int main(int argc, char **argv)
 {
+  // before anything records a zone so this thread gets the "Main" track in the trace
+  Profiler::registerMainThread();
   QGuiApplication app(argc, argv);
   // create an OpenGL format specifier
   QSurfaceFormat format;
@@ -29,8 +63,118 @@ int main(int argc, char **argv)
   format.setProfile(QSurfaceFormat::CoreProfile);
   // now set the depth buffer to 24 bits
   format.setDepthBufferSize(24);
+  // see c_usage for the command line
+  std::vector<std::string> poses;
+  auto deltaFormat = MorphTargetSet::DeltaFormat::AUTO;
+  ngl::Real basisTolerance = 0.0f;
+  size_t crowdSize = 1;
+  bool prePass = false;
+  double fixedStep = 0.0;
+  bool benchmark = false;
+  OffscreenBenchmark::Options benchmarkOptions;
+  std::string traceFile;
+  bool warmShaders = false;
+  size_t gpuTargetBudget = 256;
+  size_t hostTargetBudget = 1024;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    if (arg == "--prepass")
+    {
+      prePass = true;
+    }
+    else if (arg == "--benchmark")
+    {
+      benchmark = true;
+    }
+    else if (arg == "--warm-shaders")
+    {
+      warmShaders = true;
+    }
+    else if (arg.compare(0, 2, "--") != 0)
+    {
+      poses.push_back(arg);
+    }
+    else if (std::find(std::begin(c_valueOptions), std::end(c_valueOptions), arg) == std::end(c_valueOptions))
+    {
+      std::cerr << "unknown option " << arg << '\n';
+      return usage(argv[0]);
+    }
+    else if (i + 1 == argc)
+    {
+      std::cerr << arg << " needs a value\n";
+      return usage(argv[0]);
+    }
+    else if (arg == "--delta-format")
+    {
+      std::string name = argv[++i];
+      if (name == "rgb32f")
+        deltaFormat = MorphTargetSet::DeltaFormat::RGB32F;
+      else if (name == "rgba16f")
+        deltaFormat = MorphTargetSet::DeltaFormat::RGBA16F;
+      else if (name == "rgba16")
+        deltaFormat = MorphTargetSet::DeltaFormat::RGBA16;
+      else if (name == "rgba8")
+        deltaFormat = MorphTargetSet::DeltaFormat::RGBA8;
+      else if (name == "auto")
+        deltaFormat = MorphTargetSet::DeltaFormat::AUTO;
+      else
+      {
+        std::cerr << "unknown delta format " << name << '\n';
+        return usage(argv[0]);
+      }
+    }
+    else if (arg == "--compress-targets")
+    {
+      basisTolerance = std::strtof(argv[++i], nullptr);
+    }
+    else if (arg == "--crowd")
+    {
+      crowdSize = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if (arg == "--fixed-step")
+    {
+      fixedStep = std::strtod(argv[++i], nullptr) / 1000.0;
+    }
+    else if (arg == "--benchmark-frames")
+    {
+      benchmarkOptions.frames = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if (arg == "--benchmark-output")
+    {
+      benchmarkOptions.output = argv[++i];
+    }
+    else if (arg == "--trace")
+    {
+      traceFile = argv[++i];
+    }
+    else if (arg == "--gpu-target-budget")
+    {
+      gpuTargetBudget = std::strtoul(argv[++i], nullptr, 10);
+    }
+    else if (arg == "--host-target-budget")
+    {
+      hostTargetBudget = std::strtoul(argv[++i], nullptr, 10);
+    }
+  }
+  if (warmShaders)
+  {
+    return NGLScene::warmShaderCache(format);
+  }
   // now we are going to create our scene window
-  NGLScene window;
+  NGLScene window(poses);
+  window.setDeltaFormat(deltaFormat);
+  window.setBasisTolerance(basisTolerance);
+  window.setCrowdSize(crowdSize);
+  window.setPrePass(prePass);
+  window.setFixedTimestep(fixedStep);
+  window.setTraceFile(traceFile);
+  window.setTargetBudget(gpuTargetBudget << 20, hostTargetBudget << 20);
+  if (benchmark)
+  {
+    // the window is never shown, the scene is initialised and drawn in an offscreen context
+    return OffscreenBenchmark(benchmarkOptions).run(window, format);
+  }
   // and set the OpenGL format
   window.setFormat(format);
   // we can now query the version to see if it worked
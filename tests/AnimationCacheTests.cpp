@@ -0,0 +1,240 @@
+// Bakes a small synthetic blend to an AnimationCache file and checks every frame reads back within half a
+// quantisation step of the engine however the frames are visited, and that a cut short file or one whose header
+// offsets wrap is refused.
+#include "AnimationBaker.h"
+#include "AnimationCache.h"
+#include "MorphEngine.h"
+#include "ThreadPool.h"
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // odd so no SIMD width or zero run lines up with the end of a frame
+  constexpr size_t c_numVerts = 37;
+  constexpr size_t c_numTargets = 3;
+  constexpr size_t c_framesPerChunk = 8;
+  // not a multiple of c_framesPerChunk so the last chunk is short
+  constexpr size_t c_numFrames = 101;
+
+  // a random base pose and targets, the normals are roughly unit length as the engine renormalises them
+  struct Rig
+  {
+    std::vector<float> base;
+    std::vector<std::vector<float>> targets;
+    MorphEngine engine;
+    Rig()
+    {
+      std::mt19937 rng(1234);
+      std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+      base.resize(c_numVerts * MorphEngine::c_components);
+      std::generate(base.begin(), base.end(), [&] { return 10.0f * dist(rng); });
+      for (size_t v = 0; v < c_numVerts; ++v)
+      {
+        auto *n = &base[v * MorphEngine::c_components + 3];
+        auto l = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (size_t c = 0; c < 3; ++c)
+          n[c] /= l;
+      }
+      engine.setBase(&base[0], &base[3], c_numVerts, MorphEngine::c_components);
+      for (size_t t = 0; t < c_numTargets; ++t)
+      {
+        targets.emplace_back(base.size());
+        // only some vertices move so the encoder has zero runs to find
+        for (size_t v = 0; v < c_numVerts; ++v)
+        {
+          if ((v + t) % 3 == 0)
+            continue;
+          for (size_t c = 0; c < MorphEngine::c_components; ++c)
+            targets.back()[v * MorphEngine::c_components + c] = dist(rng);
+        }
+        engine.addTarget(&targets.back()[0], &targets.back()[3], MorphEngine::c_components);
+      }
+    }
+  };
+
+  // every target swings at its own rate, with some frames held still
+  void weightsAt(size_t _frame, float *o_weights)
+  {
+    for (size_t t = 0; t < c_numTargets; ++t)
+      o_weights[t] = _frame % 10 < 3 ? 0.5f : 0.5f + 0.5f * std::sin(0.1f * (t + 1) * static_cast<float>(_frame));
+  }
+
+  std::string tempFile(const std::string &_name)
+  {
+    return (std::filesystem::temp_directory_path() / _name).string();
+  }
+
+  // the frame read back is within half a step of the engine's blend, plus the rounding of the floats themselves
+  void checkFrame(const Rig &_rig, AnimationCache &_cache, size_t _frame, const AnimationCache::Options &_options)
+  {
+    float weights[c_numTargets];
+    weightsAt(_frame, weights);
+    auto result = _rig.engine.createResult();
+    _rig.engine.evaluate(weights, result);
+    std::vector<float> expected(c_numVerts * AnimationCache::c_components);
+    result.interleave(expected.data(), 0, c_numVerts);
+    std::vector<float> frame(expected.size());
+    INFO("frame " << _frame);
+    REQUIRE(_cache.frame(_frame, frame.data()));
+    size_t outOfStep = 0;
+    for (size_t i = 0; i < frame.size(); ++i)
+    {
+      auto step = i % AnimationCache::c_components < 3 ? _options.positionStep : _options.normalStep;
+      if (std::abs(frame[i] - expected[i]) > 0.5f * step + 2.0f * std::numeric_limits<float>::epsilon() * std::abs(expected[i]))
+        ++outOfStep;
+    }
+    CHECK(outOfStep == 0);
+  }
+} // end anonymous namespace
+
+TEST_CASE("AnimationCache round trips a bake", "[AnimationCache]")
+{
+  Rig rig;
+  AnimationCache::Options options;
+  options.framesPerChunk = c_framesPerChunk;
+  auto file = tempFile("MorphTestsRoundTrip.mbak");
+  {
+    ThreadPool pool(2);
+    AnimationBaker baker(rig.engine, pool);
+    REQUIRE(baker.bake(file, c_numFrames, 24.0f, weightsAt, options));
+  }
+  AnimationCache cache;
+  REQUIRE(cache.open(file));
+  REQUIRE(cache.numVerts() == c_numVerts);
+  REQUIRE(cache.numFrames() == c_numFrames);
+  REQUIRE(cache.numChunks() == (c_numFrames + c_framesPerChunk - 1) / c_framesPerChunk);
+  CHECK(cache.fps() == 24.0f);
+
+  SECTION("forward playback")
+  {
+    for (size_t f = 0; f < c_numFrames; ++f)
+      checkFrame(rig, cache, f, options);
+  }
+  SECTION("backward playback")
+  {
+    for (size_t f = c_numFrames; f-- > 0;)
+      checkFrame(rig, cache, f, options);
+  }
+  SECTION("seeks either way across chunk boundaries")
+  {
+    // the last of one chunk then the first of the next and back, then into the short last chunk
+    for (size_t f : {c_framesPerChunk - 1, c_framesPerChunk, c_framesPerChunk - 1, 3 * c_framesPerChunk, c_framesPerChunk + 1,
+                     c_numFrames - 1, size_t(0), c_numFrames - 2, 2 * c_framesPerChunk - 1})
+      checkFrame(rig, cache, f, options);
+    std::mt19937 rng(4321);
+    std::uniform_int_distribution<size_t> pick(0, c_numFrames - 1);
+    for (size_t s = 0; s < 200; ++s)
+      checkFrame(rig, cache, pick(rng), options);
+  }
+  SECTION("frames past the end")
+  {
+    std::vector<float> frame(c_numVerts * AnimationCache::c_components);
+    CHECK_FALSE(cache.frame(c_numFrames, frame.data()));
+    // and it still reads after a failed call
+    checkFrame(rig, cache, c_numFrames - 1, options);
+  }
+  cache.close();
+  std::filesystem::remove(file);
+}
+
+TEST_CASE("AnimationCache refuses a truncated file", "[AnimationCache]")
+{
+  Rig rig;
+  AnimationCache::Options options;
+  options.framesPerChunk = c_framesPerChunk;
+  auto file = tempFile("MorphTestsWhole.mbak");
+  {
+    ThreadPool pool(1);
+    AnimationBaker baker(rig.engine, pool);
+    REQUIRE(baker.bake(file, c_numFrames, 24.0f, weightsAt, options));
+  }
+  std::vector<char> data;
+  {
+    std::ifstream in(file, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  std::filesystem::remove(file);
+  REQUIRE(data.size() > sizeof(AnimationCache::Header));
+
+  // part of the header, the header alone, part way through the chunks and one byte short of the chunk index
+  auto size = GENERATE_COPY(sizeof(AnimationCache::Header) / 2, sizeof(AnimationCache::Header), data.size() / 2, data.size() - 1);
+  INFO("cut to " << size << " of " << data.size() << " bytes");
+  auto truncated = tempFile("MorphTestsTruncated.mbak");
+  {
+    std::ofstream out(truncated, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(size));
+  }
+  AnimationCache cache;
+  CHECK_FALSE(cache.open(truncated));
+  CHECK(cache.numFrames() == 0);
+  std::filesystem::remove(truncated);
+}
+
+TEST_CASE("AnimationCache refuses offsets and sizes that wrap", "[AnimationCache]")
+{
+  Rig rig;
+  AnimationCache::Options options;
+  options.framesPerChunk = c_framesPerChunk;
+  auto file = tempFile("MorphTestsUnpatched.mbak");
+  {
+    ThreadPool pool(1);
+    AnimationBaker baker(rig.engine, pool);
+    REQUIRE(baker.bake(file, c_numFrames, 24.0f, weightsAt, options));
+  }
+  std::vector<char> data;
+  {
+    std::ifstream in(file, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  std::filesystem::remove(file);
+  AnimationCache::Header header;
+  REQUIRE(data.size() > sizeof(header));
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  // each is in range when the sum wraps, the file must be refused rather than read out of bounds
+  constexpr uint64_t c_max = std::numeric_limits<uint64_t>::max();
+  auto patch = GENERATE(range(0, 4));
+  switch (patch)
+  {
+  case 0:
+    header.referenceOffset = c_max - 7;
+    header.referenceSize = 16;
+    break;
+  case 1:
+    header.indexOffset = c_max - 15;
+    break;
+  case 2:
+  {
+    // the first chunk's record
+    AnimationCache::ChunkRecord chunk{c_max - 7, 16};
+    std::memcpy(&data[header.indexOffset], &chunk, sizeof(chunk));
+    break;
+  }
+  default:
+    // the 32 bit chunk count for this many frames wraps to 0, which then matches the index
+    header.numFrames = std::numeric_limits<uint32_t>::max();
+    header.numChunks = static_cast<uint32_t>((header.numFrames + header.framesPerChunk - 1) / header.framesPerChunk);
+    break;
+  }
+  INFO("patch " << patch);
+  std::memcpy(data.data(), &header, sizeof(header));
+  auto patched = tempFile("MorphTestsPatched.mbak");
+  {
+    std::ofstream out(patched, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+  }
+  AnimationCache cache;
+  CHECK_FALSE(cache.open(patched));
+  CHECK(cache.numFrames() == 0);
+  std::filesystem::remove(patched);
+}
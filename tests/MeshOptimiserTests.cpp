@@ -0,0 +1,132 @@
+// Checks the vertex cache reorder keeps every triangle (degenerate ones included) and never makes the FIFO cache
+// misses worse, and that the fetch remap and the cache simulator do what they say.
+#include "MeshOptimiser.h"
+#include "TestPoses.h"
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace
+{
+  // the triangles as a sorted list, the reorder moves whole triangles so their corners stay in the same order
+  std::vector<std::array<uint32_t, 3>> triangles(const std::vector<uint32_t> &_indices)
+  {
+    std::vector<std::array<uint32_t, 3>> tris;
+    for (size_t i = 0; i + 2 < _indices.size(); i += 3)
+      tris.push_back({_indices[i], _indices[i + 1], _indices[i + 2]});
+    std::sort(tris.begin(), tris.end());
+    return tris;
+  }
+
+  // a _size x _size grid of quads with the triangles shuffled, so there is plenty for the reorder to win back
+  std::vector<uint32_t> shuffledGrid(uint32_t _size, std::mt19937 &io_rng)
+  {
+    std::vector<std::array<uint32_t, 3>> tris;
+    auto row = _size + 1;
+    for (uint32_t y = 0; y < _size; ++y)
+    {
+      for (uint32_t x = 0; x < _size; ++x)
+      {
+        auto v = y * row + x;
+        tris.push_back({v, v + row, v + 1});
+        tris.push_back({v + 1, v + row, v + row + 1});
+      }
+    }
+    std::shuffle(tris.begin(), tris.end(), io_rng);
+    std::vector<uint32_t> indices;
+    for (auto &t : tris)
+      indices.insert(indices.end(), t.begin(), t.end());
+    return indices;
+  }
+
+  void checkReorder(const std::vector<uint32_t> &_indices, size_t _numVerts)
+  {
+    auto reordered = _indices;
+    MeshOptimiser::optimiseVertexCache(reordered.data(), reordered.size(), _numVerts);
+    REQUIRE(triangles(reordered) == triangles(_indices));
+    auto before = MeshOptimiser::simulate(_indices.data(), _indices.size(), _numVerts);
+    auto after = MeshOptimiser::simulate(reordered.data(), reordered.size(), _numVerts);
+    CHECK(after.acmr <= before.acmr);
+    CHECK(after.atvr <= before.atvr);
+  }
+} // end anonymous namespace
+
+TEST_CASE("vertex cache reorder keeps degenerate triangles once", "[MeshOptimiser]")
+{
+  // a triangle with a repeated corner used to be listed twice around that vertex, drawn twice and lose another one
+  std::vector<uint32_t> indices{7, 7, 8, 0, 1, 2, 1, 3, 2, 2, 3, 4, 3, 5, 4, 4, 5, 6};
+  auto reordered = indices;
+  MeshOptimiser::optimiseVertexCache(reordered.data(), reordered.size(), 9);
+  CHECK(triangles(reordered) == triangles(indices));
+  // all three corners the same as well
+  indices = {2, 2, 2, 0, 1, 2, 1, 1, 1, 2, 1, 3, 0, 0, 3};
+  reordered = indices;
+  MeshOptimiser::optimiseVertexCache(reordered.data(), reordered.size(), 4);
+  CHECK(triangles(reordered) == triangles(indices));
+}
+
+TEST_CASE("vertex cache reorder keeps every triangle and doesn't add misses", "[MeshOptimiser]")
+{
+  std::mt19937 rng(1234);
+  SECTION("shuffled grid")
+  {
+    checkReorder(shuffledGrid(40, rng), 41 * 41);
+  }
+  SECTION("shuffled grid with degenerate triangles")
+  {
+    auto indices = shuffledGrid(40, rng);
+    std::uniform_int_distribution<uint32_t> vertex(0, 41 * 41 - 1);
+    for (size_t i = 0; i < 200; ++i)
+    {
+      auto a = vertex(rng);
+      auto b = vertex(rng);
+      indices.insert(indices.end(), {a, a, b});
+      indices.insert(indices.end(), {b, a, b});
+      indices.insert(indices.end(), {a, a, a});
+    }
+    std::vector<std::array<uint32_t, 3>> tris;
+    for (size_t i = 0; i < indices.size(); i += 3)
+      tris.push_back({indices[i], indices[i + 1], indices[i + 2]});
+    std::shuffle(tris.begin(), tris.end(), rng);
+    indices.clear();
+    for (auto &t : tris)
+      indices.insert(indices.end(), t.begin(), t.end());
+    checkReorder(indices, 41 * 41);
+  }
+  SECTION("the Bruce poses as loaded")
+  {
+    // pack has already reordered these, doing it again must not lose anything or make them worse
+    auto &morph = bruce();
+    std::vector<uint32_t> indices(morph.indices(), morph.indices() + morph.numIndices());
+    checkReorder(indices, morph.numVerts());
+  }
+}
+
+TEST_CASE("fetch remap numbers vertices by first use", "[MeshOptimiser]")
+{
+  std::vector<uint32_t> indices{4, 2, 4, 0, 2, 5};
+  auto remap = MeshOptimiser::fetchRemap(indices.data(), indices.size(), 7);
+  // 4 2 0 5 in use order then the unused 1 3 6 in their old order
+  CHECK(remap == std::vector<uint32_t>{2, 4, 1, 5, 0, 3, 6});
+}
+
+TEST_CASE("FIFO simulator counts misses", "[MeshOptimiser]")
+{
+  // one triangle is three misses for three vertices
+  std::vector<uint32_t> indices{0, 1, 2};
+  auto stats = MeshOptimiser::simulate(indices.data(), indices.size(), 3);
+  CHECK(stats.acmr == 3.0f);
+  CHECK(stats.atvr == 1.0f);
+  // a strip of two triangles sharing an edge misses only on the new vertex
+  indices = {0, 1, 2, 2, 1, 3};
+  stats = MeshOptimiser::simulate(indices.data(), indices.size(), 4);
+  CHECK(stats.acmr == 2.0f);
+  CHECK(stats.atvr == 1.0f);
+  // a one entry cache only hits when a vertex follows itself, so 1 is transformed twice
+  stats = MeshOptimiser::simulate(indices.data(), indices.size(), 4, 1);
+  CHECK(stats.acmr == 2.5f);
+  CHECK(stats.atvr == 1.25f);
+}
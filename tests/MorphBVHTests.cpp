@@ -0,0 +1,121 @@
+// Checks the pick BVH finds the same nearest hit as testing every triangle, on the base pose it was built from and
+// after refitting it to a blend.
+#include "MorphBVH.h"
+#include "MorphEngine.h"
+#include "TestPoses.h"
+#include <catch2/catch.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  constexpr size_t c_numRays = 2000;
+  // a ray through a shared vertex or edge can hit a neighbour of the brute force triangle a rounding nearer or further
+  constexpr float c_tolerance = 1e-5f;
+
+  // the same Moller Trumbore test the tree uses at its leaves
+  bool bruteForce(const float *_x, const float *_y, const float *_z, size_t _stride, const uint32_t *_indices, size_t _numIndices,
+                  const float *_origin, const float *_direction, MorphBVH::Hit &o_hit)
+  {
+    bool found = false;
+    for (size_t i = 0; i + 2 < _numIndices; i += 3)
+    {
+      float p0[3] = {_x[_indices[i] * _stride], _y[_indices[i] * _stride], _z[_indices[i] * _stride]};
+      float p1[3] = {_x[_indices[i + 1] * _stride], _y[_indices[i + 1] * _stride], _z[_indices[i + 1] * _stride]};
+      float p2[3] = {_x[_indices[i + 2] * _stride], _y[_indices[i + 2] * _stride], _z[_indices[i + 2] * _stride]};
+      float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+      float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+      float p[3] = {_direction[1] * e2[2] - _direction[2] * e2[1], _direction[2] * e2[0] - _direction[0] * e2[2],
+                    _direction[0] * e2[1] - _direction[1] * e2[0]};
+      auto det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+      if (std::abs(det) < 1e-12f)
+        continue;
+      auto inv = 1.0f / det;
+      float s[3] = {_origin[0] - p0[0], _origin[1] - p0[1], _origin[2] - p0[2]};
+      auto u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+      if (u < 0.0f || u > 1.0f)
+        continue;
+      float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+      auto v = (_direction[0] * q[0] + _direction[1] * q[1] + _direction[2] * q[2]) * inv;
+      if (v < 0.0f || u + v > 1.0f)
+        continue;
+      auto t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+      if (t < 0.0f || t >= o_hit.distance)
+        continue;
+      o_hit.distance = t;
+      o_hit.triangle = static_cast<uint32_t>(i / 3);
+      found = true;
+    }
+    return found;
+  }
+
+  // rays from a box around the mesh, most aimed at one of its vertices and the rest in any direction
+  void checkRays(const MorphBVH &_bvh, const float *_x, const float *_y, const float *_z, size_t _stride, size_t _numVerts,
+                 const uint32_t *_indices, size_t _numIndices)
+  {
+    float box[6];
+    _bvh.bounds(box);
+    float centre[3];
+    float radius = 0.0f;
+    for (size_t c = 0; c < 3; ++c)
+    {
+      centre[c] = 0.5f * (box[c] + box[c + 3]);
+      radius += (box[c + 3] - box[c]) * (box[c + 3] - box[c]);
+    }
+    radius = std::sqrt(radius);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<size_t> vertex(0, _numVerts - 1);
+    size_t hits = 0;
+    for (size_t r = 0; r < c_numRays; ++r)
+    {
+      float origin[3];
+      float direction[3];
+      for (size_t c = 0; c < 3; ++c)
+        origin[c] = centre[c] + radius * unit(rng);
+      auto v = vertex(rng) * _stride;
+      float target[3] = {_x[v], _y[v], _z[v]};
+      for (size_t c = 0; c < 3; ++c)
+        direction[c] = r % 4 != 0 ? target[c] - origin[c] : unit(rng);
+      MorphBVH::Hit expected;
+      MorphBVH::Hit hit;
+      auto found = bruteForce(_x, _y, _z, _stride, _indices, _numIndices, origin, direction, expected);
+      INFO("ray " << r);
+      REQUIRE(_bvh.intersect(origin, direction, hit) == found);
+      if (found)
+      {
+        REQUIRE(std::abs(hit.distance - expected.distance) <= c_tolerance * expected.distance);
+        ++hits;
+      }
+    }
+    // make sure the rays actually test the tree
+    CHECK(hits > c_numRays / 2);
+  }
+} // end anonymous namespace
+
+TEST_CASE("BVH picks the same triangles as testing them all", "[MorphBVH]")
+{
+  auto &morph = bruce();
+  auto *base = &morph.vertices()[0].p1.m_x;
+  MorphBVH bvh;
+  bvh.build(base, base + 1, base + 2, 6, morph.numVerts(), morph.indices(), morph.numIndices());
+  REQUIRE(bvh.numTriangles() == morph.numIndices() / 3);
+
+  SECTION("the base pose it was built from")
+  {
+    checkRays(bvh, base, base + 1, base + 2, 6, morph.numVerts(), morph.indices(), morph.numIndices());
+  }
+  SECTION("refitted to a blend")
+  {
+    MorphEngine engine;
+    morph.loadEngine(engine);
+    std::vector<float> weights(engine.numTargets());
+    for (size_t t = 0; t < weights.size(); ++t)
+      weights[t] = 0.8f - 0.3f * t;
+    auto result = engine.createResult();
+    engine.evaluate(weights.data(), result);
+    bvh.refit(result.component(0), result.component(1), result.component(2), 1);
+    checkRays(bvh, result.component(0), result.component(1), result.component(2), 1, morph.numVerts(), morph.indices(), morph.numIndices());
+  }
+}
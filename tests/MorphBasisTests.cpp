@@ -0,0 +1,167 @@
+// Rebuilds every target from the basis shapes and coefficients and checks it is within the tolerance the basis was
+// built for (and what it reports), that a folded blend is no further out than the documented bound, and that the
+// shape cap is honoured.
+#include "MorphBasis.h"
+#include "TestPoses.h"
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  // odd so nothing lines up with a power of two
+  constexpr size_t c_numVerts = 501;
+  constexpr size_t c_numShapes = 3;
+  constexpr size_t c_numTargets = 12;
+  // the float shapes and coefficients only rebuild a target to within rounding of the residual build() measured
+  constexpr float c_rounding = 1e-5f;
+
+  // c_numTargets targets that are each a random mix of c_numShapes random shapes plus noise well under _tolerance
+  std::vector<std::vector<float>> correlatedTargets(float _tolerance)
+  {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<std::vector<float>> shapes(c_numShapes, std::vector<float>(c_numVerts * 6));
+    for (auto &shape : shapes)
+      std::generate(shape.begin(), shape.end(), [&] { return dist(rng); });
+    std::vector<std::vector<float>> targets(c_numTargets, std::vector<float>(c_numVerts * 6));
+    for (auto &target : targets)
+    {
+      float mix[c_numShapes];
+      for (auto &m : mix)
+        m = dist(rng);
+      for (size_t e = 0; e < target.size(); ++e)
+      {
+        for (size_t s = 0; s < c_numShapes; ++s)
+          target[e] += mix[s] * shapes[s][e];
+        target[e] += 0.1f * _tolerance * dist(rng);
+      }
+    }
+    return targets;
+  }
+
+  // the largest distance of any position or normal delta of _exact from the same blend of the shapes
+  MorphBasis::Error blendError(const MorphBasis &_basis, const std::vector<std::vector<float>> &_targets, const std::vector<float> &_weights)
+  {
+    auto floats = _targets[0].size();
+    std::vector<float> shapeWeights(_basis.numShapes());
+    _basis.fold(_weights.data(), shapeWeights.data());
+    std::vector<double> difference(floats, 0.0);
+    for (size_t t = 0; t < _targets.size(); ++t)
+    {
+      for (size_t e = 0; e < floats; ++e)
+        difference[e] += static_cast<double>(_weights[t]) * _targets[t][e];
+    }
+    for (size_t s = 0; s < _basis.numShapes(); ++s)
+    {
+      for (size_t e = 0; e < floats; ++e)
+        difference[e] -= static_cast<double>(shapeWeights[s]) * _basis.shapes()[s * floats + e];
+    }
+    MorphBasis::Error error;
+    for (size_t i = 0; i < floats; i += 6)
+    {
+      auto *d = &difference[i];
+      error.maxPosition = std::max(error.maxPosition, static_cast<float>(std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2])));
+      error.maxNormal = std::max(error.maxNormal, static_cast<float>(std::sqrt(d[3] * d[3] + d[4] * d[4] + d[5] * d[5])));
+    }
+    return error;
+  }
+
+  // each target on its own, the worst of them
+  MorphBasis::Error targetError(const MorphBasis &_basis, const std::vector<std::vector<float>> &_targets)
+  {
+    MorphBasis::Error worst;
+    for (size_t t = 0; t < _targets.size(); ++t)
+    {
+      std::vector<float> weights(_targets.size(), 0.0f);
+      weights[t] = 1.0f;
+      auto error = blendError(_basis, _targets, weights);
+      worst.maxPosition = std::max(worst.maxPosition, error.maxPosition);
+      worst.maxNormal = std::max(worst.maxNormal, error.maxNormal);
+    }
+    return worst;
+  }
+
+  MorphBasis build(const std::vector<std::vector<float>> &_targets, const MorphBasis::Options &_options)
+  {
+    MorphBasis basis;
+    basis.setVertexCount(_targets[0].size() / 6);
+    for (auto &target : _targets)
+      basis.addTarget(target.data());
+    basis.build(_options);
+    REQUIRE(basis.numTargets() == _targets.size());
+    REQUIRE(basis.shapes().size() == basis.numShapes() * _targets[0].size());
+    REQUIRE(basis.coefficients().size() == basis.numShapes() * _targets.size());
+    return basis;
+  }
+} // end anonymous namespace
+
+TEST_CASE("MorphBasis rebuilds correlated targets within the tolerance", "[MorphBasis]")
+{
+  MorphBasis::Options options;
+  options.tolerance = 1e-3f;
+  auto targets = correlatedTargets(options.tolerance);
+  auto basis = build(targets, options);
+  // the noise is under the tolerance so the shapes the targets were mixed from are all it needs
+  CHECK(basis.numShapes() == c_numShapes);
+  CHECK(basis.compressionRatio() > 3.0f);
+
+  auto error = targetError(basis, targets);
+  CHECK(error.maxPosition <= options.tolerance + c_rounding);
+  CHECK(error.maxNormal <= options.tolerance + c_rounding);
+  // and it reports what it actually achieved
+  CHECK(basis.targetError().maxPosition == Approx(error.maxPosition).margin(c_rounding));
+  CHECK(basis.targetError().maxNormal == Approx(error.maxNormal).margin(c_rounding));
+  auto all = blendError(basis, targets, std::vector<float>(targets.size(), 1.0f));
+  CHECK(basis.blendError().maxPosition == Approx(all.maxPosition).margin(c_rounding));
+
+  // any other blend is within the weighted sum of the single target errors
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  for (size_t i = 0; i < 10; ++i)
+  {
+    std::vector<float> weights(targets.size());
+    std::generate(weights.begin(), weights.end(), [&] { return dist(rng); });
+    float weightSum = 0.0f;
+    for (auto w : weights)
+      weightSum += w;
+    auto blend = blendError(basis, targets, weights);
+    CHECK(blend.maxPosition <= weightSum * basis.targetError().maxPosition + c_rounding);
+    CHECK(blend.maxNormal <= weightSum * basis.targetError().maxNormal + c_rounding);
+  }
+}
+
+TEST_CASE("MorphBasis stops at the shape cap", "[MorphBasis]")
+{
+  MorphBasis::Options options;
+  options.tolerance = 1e-3f;
+  options.maxShapes = c_numShapes - 1;
+  auto targets = correlatedTargets(options.tolerance);
+  auto basis = build(targets, options);
+  CHECK(basis.numShapes() == options.maxShapes);
+  // it can't reach the tolerance but still says how far out it is
+  auto error = targetError(basis, targets);
+  CHECK(error.maxPosition > options.tolerance);
+  CHECK(basis.targetError().maxPosition == Approx(error.maxPosition).epsilon(1e-4));
+}
+
+TEST_CASE("MorphBasis rebuilds the Bruce targets within the tolerance", "[MorphBasis]")
+{
+  auto &morph = bruce();
+  std::vector<std::vector<float>> targets;
+  for (size_t t = 0; t < morph.numTargets(); ++t)
+  {
+    auto *deltas = &morph.deltas()[t * morph.numVerts() * 2].m_x;
+    targets.emplace_back(deltas, deltas + morph.numVerts() * 6);
+  }
+  MorphBasis::Options options;
+  options.tolerance = 1e-3f;
+  auto basis = build(targets, options);
+  REQUIRE(basis.numShapes() > 0);
+  REQUIRE(basis.numShapes() <= targets.size());
+  auto error = targetError(basis, targets);
+  CHECK(error.maxPosition <= options.tolerance + c_rounding);
+  CHECK(error.maxNormal <= options.tolerance + c_rounding);
+}
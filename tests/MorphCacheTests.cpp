@@ -0,0 +1,75 @@
+// Checks the cache is only used while its sources match, and that a source which was only touched (same contents, new
+// timestamp) is hashed once and then trusted on its timestamp again.
+#include "MorphCache.h"
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+  std::string tempFile(const std::string &_name)
+  {
+    return (std::filesystem::temp_directory_path() / _name).string();
+  }
+
+  void writeSource(const std::string &_path, const std::string &_contents)
+  {
+    std::ofstream out(_path, std::ios::binary | std::ios::trunc);
+    out << _contents;
+  }
+
+  // the tests move timestamps by an hour so every filesystem's resolution sees the change
+  void touch(const std::string &_path, std::filesystem::file_time_type _time)
+  {
+    std::filesystem::last_write_time(_path, _time);
+  }
+} // end anonymous namespace
+
+TEST_CASE("MorphCache is only used while its sources match", "[MorphCache]")
+{
+  auto source = tempFile("MorphTestsSource.obj");
+  auto cacheFile = tempFile("MorphTestsSource.mtbo");
+  writeSource(source, "v 0 0 0\n");
+  auto written = std::filesystem::last_write_time(source);
+  const std::vector<float> data{1.0f, 2.0f, 3.0f};
+  {
+    MorphCache cache(cacheFile, {source});
+    cache.addSection(MorphCache::Section::VERTDATA, data.data(), data.size() * sizeof(float), data.size());
+    REQUIRE(cache.write());
+  }
+  MorphCache cache(cacheFile, {source});
+  REQUIRE(cache.load());
+  auto blob = cache.section(MorphCache::Section::VERTDATA);
+  REQUIRE(blob.count == data.size());
+  CHECK(std::memcmp(blob.data, data.data(), blob.size) == 0);
+  CHECK(cache.section(MorphCache::Section::TARGETS).data == nullptr);
+
+  SECTION("a touched source is hashed once then trusted on its new timestamp")
+  {
+    auto touched = written + std::chrono::hours(1);
+    touch(source, touched);
+    REQUIRE(cache.load());
+    // the same size and timestamp with different contents is only missed if the new timestamp was stored
+    writeSource(source, "v 1 1 1\n");
+    touch(source, touched);
+    CHECK(cache.load());
+  }
+  SECTION("changed contents with a new timestamp rebuild")
+  {
+    writeSource(source, "v 1 1 1\n");
+    touch(source, written + std::chrono::hours(1));
+    CHECK_FALSE(cache.load());
+  }
+  SECTION("a changed size rebuilds")
+  {
+    writeSource(source, "v 0 0 0\nv 1 1 1\n");
+    touch(source, written);
+    CHECK_FALSE(cache.load());
+  }
+  std::filesystem::remove(source);
+  std::filesystem::remove(cacheFile);
+}
@@ -0,0 +1,178 @@
+// Checks every kernel the CPU supports, the scalar one included, against the untiled evaluateReference. The engines are
+// built from the first few vertices of the Bruce poses as well as the whole mesh so the counts that aren't a multiple
+// of the vector width or of a tile exercise the padded tails, and from synthetic targets that only move a few vertices.
+// The sparse scatter in MorphTargetSet is checked against the same reference.
+#include "MorphEngine.h"
+#include "TestPoses.h"
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+  // the kernels differ from the reference only by rounding (fused multiply adds and the order of the sums)
+  constexpr float c_tolerance = 1e-5f;
+
+  // an engine over the first _numVerts vertices of the poses
+  void loadPrefix(const MorphTargetSet &_morph, size_t _numVerts, MorphEngine &o_engine)
+  {
+    auto *verts = _morph.vertices();
+    o_engine.setBase(&verts[0].p1.m_x, &verts[0].n1.m_x, _numVerts, 6);
+    for (size_t t = 0; t < _morph.numTargets(); ++t)
+    {
+      auto *deltas = _morph.deltas() + t * _morph.numVerts() * 2;
+      o_engine.addTarget(&deltas[0].m_x, &deltas[1].m_x, 6);
+    }
+  }
+
+  // none, each target on its own, all of them and some random blends
+  std::vector<std::vector<float>> weightSets(size_t _numTargets)
+  {
+    std::vector<std::vector<float>> sets{std::vector<float>(_numTargets, 0.0f), std::vector<float>(_numTargets, 1.0f)};
+    for (size_t t = 0; t < _numTargets; ++t)
+    {
+      sets.emplace_back(_numTargets, 0.0f);
+      sets.back()[t] = 1.0f;
+    }
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    for (size_t i = 0; i < 8; ++i)
+    {
+      sets.emplace_back(_numTargets);
+      // some weights exactly zero so the skipped targets are covered too
+      std::generate(sets.back().begin(), sets.back().end(), [&] { return i % 2 == 0 && dist(rng) < 0.3f ? 0.0f : dist(rng); });
+    }
+    return sets;
+  }
+
+  // largest difference of any component relative to the reference (or absolute below 1)
+  float largestError(const MorphEngine::Result &_result, const MorphEngine::Result &_expected, size_t _first, size_t _last)
+  {
+    float largest = 0.0f;
+    for (size_t c = 0; c < MorphEngine::c_components; ++c)
+    {
+      for (size_t i = _first; i < _last; ++i)
+      {
+        auto e = _expected.component(c)[i];
+        largest = std::max(largest, std::abs(_result.component(c)[i] - e) / std::max(1.0f, std::abs(e)));
+      }
+    }
+    return largest;
+  }
+
+  // the whole mesh then in padded ranges that start and stop part way through tiles
+  void checkKernel(MorphEngine &io_engine, MorphEngine::Kernel _kernel)
+  {
+    REQUIRE(io_engine.setKernel(_kernel) == _kernel);
+    auto numVerts = io_engine.numVerts();
+    auto expected = io_engine.createResult();
+    auto result = io_engine.createResult();
+    for (auto &weights : weightSets(io_engine.numTargets()))
+    {
+      io_engine.evaluateReference(weights.data(), expected);
+      io_engine.evaluate(weights.data(), result);
+      CHECK(largestError(result, expected, 0, numVerts) <= c_tolerance);
+      constexpr size_t c_range = MorphEngine::c_tileSize + 3 * MorphEngine::c_padding;
+      for (size_t first = MorphEngine::c_padding; first < numVerts; first += c_range)
+      {
+        auto last = std::min(numVerts, first + c_range - 5);
+        io_engine.evaluate(weights.data(), first, last, result);
+        INFO("range " << first << " to " << last);
+        CHECK(largestError(result, expected, first, last) <= c_tolerance);
+      }
+    }
+  }
+} // end anonymous namespace
+
+TEST_CASE("kernels match the reference blend", "[MorphEngine]")
+{
+  auto &morph = bruce();
+  REQUIRE(morph.numVerts() > 1029);
+  // 0 stands for every vertex, the rest either side of the vector widths and one and two tiles
+  auto numVerts = GENERATE(size_t(1), size_t(5), size_t(17), size_t(511), size_t(513), size_t(1029), size_t(0));
+  if (numVerts == 0)
+    numVerts = morph.numVerts();
+  auto kernel = GENERATE(MorphEngine::Kernel::SCALAR, MorphEngine::Kernel::SSE, MorphEngine::Kernel::AVX2);
+  if (!MorphEngine::kernelSupported(kernel))
+  {
+    WARN(MorphEngine::kernelName(kernel) << " isn't supported by this CPU, skipped");
+    return;
+  }
+  INFO(MorphEngine::kernelName(kernel) << " kernel with " << numVerts << " vertices");
+
+  MorphEngine engine;
+  loadPrefix(morph, numVerts, engine);
+  REQUIRE(engine.numVerts() == numVerts);
+  checkKernel(engine, kernel);
+}
+
+TEST_CASE("kernels match the reference blend with sparse targets", "[MorphEngine]")
+{
+  // odd so the moved vertices land in the padded tail as well
+  constexpr size_t c_numVerts = 1037;
+  constexpr size_t c_numTargets = 5;
+  auto kernel = GENERATE(MorphEngine::Kernel::SCALAR, MorphEngine::Kernel::SSE, MorphEngine::Kernel::AVX2);
+  if (!MorphEngine::kernelSupported(kernel))
+  {
+    WARN(MorphEngine::kernelName(kernel) << " isn't supported by this CPU, skipped");
+    return;
+  }
+  INFO(MorphEngine::kernelName(kernel) << " kernel");
+
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> base(c_numVerts * MorphEngine::c_components);
+  std::generate(base.begin(), base.end(), [&] { return 10.0f * dist(rng); });
+  MorphEngine engine;
+  engine.setBase(&base[0], &base[3], c_numVerts, MorphEngine::c_components);
+  std::vector<std::vector<float>> targets;
+  for (size_t t = 0; t < c_numTargets; ++t)
+  {
+    targets.emplace_back(base.size(), 0.0f);
+    // a handful of scattered vertices plus the very last one, target 0 moves nothing at all
+    for (size_t v = 0; v < c_numVerts && t != 0; ++v)
+    {
+      if (v % (37 * t) != t && v != c_numVerts - 1)
+        continue;
+      for (size_t c = 0; c < MorphEngine::c_components; ++c)
+        targets.back()[v * MorphEngine::c_components + c] = dist(rng);
+    }
+    engine.addTarget(&targets.back()[0], &targets.back()[3], MorphEngine::c_components);
+  }
+  checkKernel(engine, kernel);
+}
+
+TEST_CASE("sparse scatter matches the reference blend", "[MorphEngine]")
+{
+  // a set of our own as the scatter writes into it
+  MorphTargetSet morph;
+  REQUIRE(morph.load(MorphTargetSet::defaultPoseFiles(), MorphTargetSet::cacheFileName(MorphTargetSet::defaultPoseFiles())));
+  morph.buildSparse();
+  MorphEngine engine;
+  morph.loadEngine(engine);
+  auto expected = engine.createResult();
+  // the scatter drops deltas below the sparse threshold, well inside the tolerance
+  for (auto &weights : weightSets(morph.numTargets()))
+  {
+    for (size_t t = 0; t < weights.size(); ++t)
+      morph.setWeight(t, weights[t]);
+    size_t first;
+    size_t last;
+    morph.applySparse(first, last);
+    engine.evaluateReference(weights.data(), expected);
+    auto *morphed = morph.morphedVertices();
+    float largest = 0.0f;
+    for (size_t i = 0; i < morph.numVerts(); ++i)
+    {
+      const float *v = &morphed[i].p1.m_x;
+      for (size_t c = 0; c < MorphEngine::c_components; ++c)
+      {
+        auto e = expected.component(c)[i];
+        largest = std::max(largest, std::abs(v[c] - e) / std::max(1.0f, std::abs(e)));
+      }
+    }
+    CHECK(largest <= c_tolerance);
+  }
+}
@@ -0,0 +1,165 @@
+// Checks the parallel obj parser reads v//n corners and negative (relative) indices, including across chunk
+// boundaries, fans polygons, refuses a base without normals and reports targets whose counts or faces differ.
+#include "PoseSetLoader.h"
+#include "ThreadPool.h"
+#include <catch2/catch.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  std::string tempFile(const std::string &_name)
+  {
+    return (std::filesystem::temp_directory_path() / _name).string();
+  }
+
+  std::string writeObj(const std::string &_name, const std::string &_contents)
+  {
+    auto path = tempFile(_name);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << _contents;
+    return path;
+  }
+
+  // a unit quad with its four corners given as relative indices, the same quad split along the other diagonal and
+  // the same with a vertex too many
+  const std::string c_quad = "# a quad\r\nv 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvn 0 0 1\nf -4//-1 -3//-1 -2//-1 -1//-1\n";
+  const std::string c_otherDiagonal = "v 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1\nvn 0 0 1\nf 2//1 3//1 4//1\nf 2//1 4//1 1//1\n";
+  const std::string c_extraVertex = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 2 2\nvn 0 0 1\nf 1//1 2//1 3//1 4//1\n";
+
+  // load with std::cerr captured so the reports can be checked
+  bool load(PoseSetLoader &io_loader, const std::vector<std::string> &_files, std::string &o_report)
+  {
+    std::ostringstream report;
+    auto *old = std::cerr.rdbuf(report.rdbuf());
+    auto loaded = io_loader.load(_files);
+    std::cerr.rdbuf(old);
+    o_report = report.str();
+    return loaded;
+  }
+
+  // vertex / normal index pairs, easier to compare and print than the corners
+  using Corners = std::vector<std::pair<uint32_t, uint32_t>>;
+  Corners corners(const PoseSetLoader &_loader)
+  {
+    Corners out;
+    for (auto &c : _loader.corners())
+      out.push_back({c.vert, c.normal});
+    return out;
+  }
+} // end anonymous namespace
+
+TEST_CASE("PoseSetLoader reads v//n corners and relative indices", "[PoseSetLoader]")
+{
+  ThreadPool pool(2);
+  PoseSetLoader loader(pool);
+  std::string report;
+
+  SECTION("a quad is fanned from its first corner")
+  {
+    auto base = writeObj("MorphTestsQuad.obj", c_quad);
+    REQUIRE(load(loader, {base}, report));
+    REQUIRE(loader.base().verts.size() == 4);
+    REQUIRE(loader.base().normals.size() == 1);
+    CHECK(loader.base().verts[2].m_x == 1.0f);
+    CHECK(loader.base().verts[2].m_y == 1.0f);
+    CHECK(corners(loader) == Corners{{0, 0}, {1, 0}, {2, 0}, {0, 0}, {2, 0}, {3, 0}});
+    std::filesystem::remove(base);
+  }
+  SECTION("relative indices count back from the last element read so far")
+  {
+    // the second face is read after two more vertices and a normal so its -1 is a different vertex
+    auto base = writeObj("MorphTestsRelative.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf -3//-1 -2//-1 -1//-1\n"
+                                                   "v 1 1 0\nvn 0 0 -1\nf -3//-2 -1//-1 1//1\n");
+    REQUIRE(load(loader, {base}, report));
+    CHECK(corners(loader) == Corners{{0, 0}, {1, 0}, {2, 0}, {1, 0}, {3, 1}, {0, 0}});
+    std::filesystem::remove(base);
+  }
+  SECTION("v/t/n corners and a relative index past the start are told apart from v//n")
+  {
+    auto base = writeObj("MorphTestsUV.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf 1/5/1 2/6/1 3//1\n");
+    REQUIRE(load(loader, {base}, report));
+    CHECK(corners(loader) == Corners{{0, 0}, {1, 0}, {2, 0}});
+    auto bad = writeObj("MorphTestsBadIndex.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf -4//1 2//1 3//1\n");
+    CHECK_FALSE(load(loader, {bad}, report));
+    CHECK(report.find("bad face vertex index") != std::string::npos);
+    std::filesystem::remove(base);
+    std::filesystem::remove(bad);
+  }
+  SECTION("a base without normal indices is refused")
+  {
+    auto base = writeObj("MorphTestsNoNormals.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf 1 2 3\n");
+    CHECK_FALSE(load(loader, {base}, report));
+    CHECK(report.find("face without a valid normal index") != std::string::npos);
+    CHECK(loader.corners().empty());
+    std::filesystem::remove(base);
+  }
+}
+
+TEST_CASE("PoseSetLoader resolves relative indices across chunks", "[PoseSetLoader]")
+{
+  // a long strip of quads, each written after its two new vertices, big enough to be cut into several chunks. The
+  // same strip with absolute indices must give the same corners.
+  std::string relative = "vn 0 0 1\nv 0 0 0\nv 0 1 0\n";
+  std::string absolute = relative;
+  size_t numQuads = 0;
+  for (size_t i = 1; relative.size() < 3 * PoseSetLoader::c_chunkSize; ++i, ++numQuads)
+  {
+    auto verts = "v " + std::to_string(i) + " 0 0\nv " + std::to_string(i) + " 1 0\n";
+    relative += verts + "f -4//1 -2//1 -1//1 -3//1\n";
+    auto first = std::to_string(2 * i - 1);
+    absolute += verts + "f " + first + "//1 " + std::to_string(2 * i + 1) + "//1 " + std::to_string(2 * i + 2) + "//1 " +
+                std::to_string(2 * i) + "//1\n";
+  }
+  auto relativeFile = writeObj("MorphTestsStripRelative.obj", relative);
+  auto absoluteFile = writeObj("MorphTestsStripAbsolute.obj", absolute);
+  ThreadPool pool(4);
+  PoseSetLoader loader(pool);
+  std::string report;
+  REQUIRE(load(loader, {absoluteFile}, report));
+  auto expected = corners(loader);
+  REQUIRE(expected.size() == numQuads * 6);
+  REQUIRE(load(loader, {relativeFile}, report));
+  CHECK(loader.base().verts.size() == 2 * numQuads + 2);
+  CHECK(corners(loader) == expected);
+  std::filesystem::remove(relativeFile);
+  std::filesystem::remove(absoluteFile);
+}
+
+TEST_CASE("PoseSetLoader reports targets that don't match the base", "[PoseSetLoader]")
+{
+  ThreadPool pool(2);
+  PoseSetLoader loader(pool);
+  auto base = writeObj("MorphTestsBase.obj", c_quad);
+  auto same = writeObj("MorphTestsSame.obj", "v 0 0 1\nv 1 0 1\nv 1 1 1\nv 0 1 1\nvn 0 0 1\nf 1//1 2//1 3//1 4//1\n");
+  auto diagonal = writeObj("MorphTestsDiagonal.obj", c_otherDiagonal);
+  auto extra = writeObj("MorphTestsExtra.obj", c_extraVertex);
+  auto missing = tempFile("MorphTestsMissing.obj");
+  std::string report;
+  REQUIRE(load(loader, {base, same, diagonal, extra, missing}, report));
+  auto &targets = loader.targets();
+  REQUIRE(targets.size() == 4);
+  INFO(report);
+
+  // the same faces are not mentioned
+  CHECK(targets[0].verts.size() == 4);
+  CHECK(targets[0].verts[0].m_z == 1.0f);
+  CHECK(report.find(same) == std::string::npos);
+  // different faces with the same counts are kept (the base faces are used) but reported
+  CHECK(targets[1].verts.size() == 4);
+  CHECK(report.find("Pose " + diagonal + " has different faces to the base") != std::string::npos);
+  // a different count or an unreadable file is reported and left empty
+  CHECK(targets[2].verts.empty());
+  CHECK(report.find("Pose " + extra + " ignored, the vertex or normal count doesn't match the base") != std::string::npos);
+  CHECK(targets[3].verts.empty());
+  CHECK(report.find("Pose " + missing + " ignored, unable to read the file") != std::string::npos);
+  // the base faces are the base file's
+  CHECK(corners(loader) == Corners{{0, 0}, {1, 0}, {2, 0}, {0, 0}, {2, 0}, {3, 0}});
+  for (auto &file : {base, same, diagonal, extra})
+    std::filesystem::remove(file);
+}
@@ -0,0 +1,18 @@
+#ifndef TESTPOSES_H_
+#define TESTPOSES_H_
+#include "MorphTargetSet.h"
+#include <catch2/catch.hpp>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file TestPoses.h
+/// @brief the Bruce poses from models/, loaded (through the cache) the first time a test asks for them
+//----------------------------------------------------------------------------------------------------------------------
+inline const MorphTargetSet &bruce()
+{
+  static MorphTargetSet morph;
+  static bool loaded = morph.load(MorphTargetSet::defaultPoseFiles(), MorphTargetSet::cacheFileName(MorphTargetSet::defaultPoseFiles()));
+  REQUIRE(loaded);
+  return morph;
+}
+
+#endif